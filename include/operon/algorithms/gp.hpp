@@ -86,22 +86,13 @@ public:
         auto& config       = GetConfig();
         auto& initializer  = GetInitializer();
         auto& generator    = GetGenerator();
-        auto& reinserter   = GetReinserter();
-        auto& problem      = GetProblem();
-        auto& grammar      = problem.GetGrammar();
-        auto targetValues  = problem.TargetValues();
         // easier to work with indices
-        std::vector<gsl::index> indices(std::max(config.PopulationSize, config.PoolSize));
+        std::vector<gsl::index> indices(config.PopulationSize);
         std::iota(indices.begin(), indices.end(), 0L);
         // random seeds for each thread
         std::vector<Operon::Random::result_type> seeds(config.PopulationSize);
         std::generate(seeds.begin(), seeds.end(), [&]() { return random(); });
 
-        const auto& inputs = problem.InputVariables();
-
-        std::vector<size_t> treeLengths(config.PopulationSize);
-        std::uniform_int_distribution<size_t> treeLengthDistribution(1, 50);
-
         auto create = [&](gsl::index i) {
             // create one random generator per thread
             Operon::Random rndlocal{seeds[i]};
@@ -117,12 +108,38 @@ public:
 
         // generate the initial population and perform evaluation
         ExecutionPolicy executionPolicy;
-        std::for_each(executionPolicy, indices.begin(), indices.begin() + config.PopulationSize, create);
+        std::for_each(executionPolicy, indices.begin(), indices.end(), create);
         std::for_each(executionPolicy, parents.begin(), parents.end(), evaluate);
+        if (evaluator.IsBulk()) {
+            evaluator.EvaluatePopulation(random, gsl::span<T>(parents));
+        }
+        // the reinserter reads the hash values of the survivors without sorting them (only the offspring are sorted)
+        if (GetReinserter().RejectDuplicates()) {
+            std::for_each(executionPolicy, parents.begin(), parents.end(), [](T& ind) { ind.Genotype.Sort(Operon::HashMode::Strict); });
+        }
+        generation = 0;
 
         // run report callback
         if (report) { std::invoke(report); }
 
+        Evolve(random, config.Generations, report);
+    }
+
+    // continues the evolution of the current population for the given number of generations (eg. after the
+    // training data changed, see OnlineEvaluator). returns false if the algorithm terminated early
+    bool Evolve(Operon::Random& random, size_t generations, std::function<void()> report = nullptr)
+    {
+        auto& config       = GetConfig();
+        auto& generator    = GetGenerator();
+        auto& reinserter   = GetReinserter();
+        const auto& evaluator = generator.Evaluator();
+        // easier to work with indices
+        std::vector<gsl::index> indices(std::max(config.PopulationSize, config.PoolSize));
+        std::iota(indices.begin(), indices.end(), 0L);
+        // random seeds for each thread
+        std::vector<Operon::Random::result_type> seeds(indices.size());
+
+        ExecutionPolicy executionPolicy;
         // flag to signal algorithm termination
         std::atomic_bool terminate = false;
         // produce some offspring
@@ -137,7 +154,7 @@ public:
             }
         };
 
-        for (generation = 0; generation < config.Generations; ++generation) {
+        for (size_t i = 0; i < generations; ++i, ++generation) {
             // get some new seeds
             std::generate(seeds.begin(), seeds.end(), [&]() { return random(); });
             // preserve one elite
@@ -148,6 +165,9 @@ public:
             generator.Prepare(parents);
             // we always allow one elite (maybe this should be more configurable?)
             std::for_each(executionPolicy, indices.cbegin() + 1, indices.cbegin() + config.PoolSize, iterate);
+            if (evaluator.IsBulk()) {
+                evaluator.EvaluatePopulation(random, gsl::span<T>(offspring).subspan(1, config.PoolSize - 1));
+            }
             // merge pool back into pop
             reinserter(random, parents, offspring);
 
@@ -155,8 +175,9 @@ public:
             if (report) { std::invoke(report); }
 
             // stop if termination requested
-            if (terminate || best->Fitness[Idx] < 1e-6) { return; }
+            if (terminate || best->Fitness[Idx] < 1e-6) { return false; }
         }
+        return true;
     }
 };
 } // namespace operon
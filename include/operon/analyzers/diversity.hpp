@@ -31,13 +31,18 @@
 
 namespace Operon {
 namespace {
-    static inline Operon::Distance::HashVector MakeHashes(Tree& tree, Operon::HashMode mode) {
+    // the sorted hash values of a tree that is already sorted
+    static inline Operon::Distance::HashVector CollectHashes(const Tree& tree) {
         Operon::Distance::HashVector hashes(tree.Length());
-        tree.Sort(mode);
         std::transform(std::execution::unseq, tree.Nodes().begin(), tree.Nodes().end(), hashes.begin(), [](const auto& node) { return node.CalculatedHashValue; });
         std::sort(std::execution::unseq, hashes.begin(), hashes.end());
         return hashes;
     }
+
+    static inline Operon::Distance::HashVector MakeHashes(Tree& tree, Operon::HashMode mode) {
+        tree.Sort(mode);
+        return CollectHashes(tree);
+    }
 }
 
 template <typename T, Operon::HashMode H = Operon::HashMode::Strict, typename ExecutionPolicy = std::execution::parallel_unsequenced_policy>
@@ -48,6 +53,10 @@ public:
         return diversity;
     }
 
+    // the genotypes are kept sorted in mode H by the variation operators (see SubtreeCrossover::MaintainHashes and
+    // MutatorBase::MaintainHashes), so their hash values are used directly instead of sorting a copy of every tree
+    void AssumeSorted(bool sorted) { assumeSorted = sorted; }
+
     void Prepare(gsl::span<const T> pop)
     {
         hashes.clear();
@@ -60,6 +69,10 @@ public:
 
         // hybrid (strict) hashing
         std::for_each(ep, indices.begin(), indices.end(), [&](gsl::index i) {
+            if (assumeSorted) {
+                hashes[i] = CollectHashes(pop[i].Genotype);
+                return;
+            }
             auto tree = pop[i].Genotype; // make a copy because the tree will be sorted
             hashes[i] = MakeHashes(tree, H);
         });
@@ -90,6 +103,7 @@ public:
 
     private:
         double diversity;
+        bool assumeSorted = false;
         std::vector<Operon::Distance::HashVector> hashes; 
     };
 } // namespace Operon
@@ -0,0 +1,146 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "gsl/gsl"
+#include "tree.hpp"
+
+namespace Operon {
+// contiguous node storage for a population of trees. the arena holds two buffers of fixed capacity: the current
+// generation, where each individual is a view (offset, length) into the buffer, and the next generation, where
+// the variation operators write the offspring directly (see Allocate, SubtreeCrossover and MutatorBase). after
+// reinsertion, the buffers are swapped and the old one is reused, so no memory is allocated between generations.
+// since the offspring are written one after the other, the next generation is always compact
+class PopulationArena {
+public:
+    struct Slot {
+        size_t Offset;
+        size_t Length;
+    };
+
+    // the capacity (in nodes) of each buffer is the population size times the maximum tree length
+    PopulationArena(size_t individuals, size_t maxLength)
+        : PopulationArena(individuals, maxLength, individuals * maxLength)
+    {
+    }
+
+    // an explicit capacity leaves room for offspring that are allocated but then rejected (they are only
+    // reclaimed on Swap)
+    PopulationArena(size_t individuals, size_t maxLength, size_t capacity)
+        : maxLength_(maxLength)
+        , current_(0)
+        , top_(0)
+    {
+        Expects(capacity >= individuals * maxLength);
+        for (auto& buffer : buffers_) {
+            buffer.resize(capacity);
+        }
+        for (auto& slots : slots_) {
+            slots.resize(individuals, Slot { 0, 0 });
+        }
+    }
+
+    PopulationArena(const PopulationArena&) = delete;
+    PopulationArena& operator=(const PopulationArena&) = delete;
+
+    // individual i of the current generation
+    gsl::span<const Node> operator[](gsl::index i) const { return View(current_, i); }
+    gsl::span<Node> operator[](gsl::index i) { return View(current_, i); }
+
+    Tree ToTree(gsl::index i) const
+    {
+        auto nodes = (*this)[i];
+        return Tree(std::vector<Node>(nodes.begin(), nodes.end()));
+    }
+
+    // reserves the nodes of individual i of the next generation. this method is thread-safe, as long as every
+    // thread writes different individuals
+    gsl::span<Node> Allocate(gsl::index i, size_t length)
+    {
+        Expects(length <= maxLength_);
+        auto offset = top_.fetch_add(length, std::memory_order_relaxed);
+        auto& buffer = buffers_[Next()];
+        Expects(offset + length <= buffer.size());
+        slots_[Next()][i] = Slot { offset, length };
+        return gsl::span<Node>(buffer).subspan(offset, length);
+    }
+
+    // copies a tree into individual i of the next generation (eg. during initialization)
+    gsl::span<Node> Assign(gsl::index i, const Tree& tree)
+    {
+        auto nodes = Allocate(i, tree.Length());
+        std::copy(tree.Nodes().begin(), tree.Nodes().end(), nodes.begin());
+        return nodes;
+    }
+
+    // copies individual `from` of the current generation into individual `to` of the next generation (eg. the
+    // elite or the survivors after reinsertion, or the parent before an in-place mutation)
+    gsl::span<Node> Keep(gsl::index from, gsl::index to)
+    {
+        auto src = (*this)[from];
+        auto nodes = Allocate(to, src.size());
+        std::copy(src.begin(), src.end(), nodes.begin());
+        return nodes;
+    }
+
+    // the next generation becomes the current one, the storage of the old generation is reused
+    void Swap()
+    {
+        current_ = Next();
+        top_ = 0;
+    }
+
+    size_t Size() const { return slots_[current_].size(); }
+    size_t Capacity() const { return buffers_[current_].size(); }
+    size_t MaxLength() const { return maxLength_; }
+
+    // number of nodes used in the next generation so far
+    size_t Used() const { return top_.load(std::memory_order_relaxed); }
+
+private:
+    size_t Next() const { return 1 - current_; }
+
+    gsl::span<Node> View(size_t generation, gsl::index i)
+    {
+        auto [offset, length] = slots_[generation][i];
+        return gsl::span<Node>(buffers_[generation]).subspan(offset, length);
+    }
+
+    gsl::span<const Node> View(size_t generation, gsl::index i) const
+    {
+        auto [offset, length] = slots_[generation][i];
+        return gsl::span<const Node>(buffers_[generation]).subspan(offset, length);
+    }
+
+    size_t maxLength_;
+    size_t current_;
+    std::atomic_size_t top_;
+    std::array<std::vector<Node>, 2> buffers_;
+    std::array<std::vector<Slot>, 2> slots_;
+};
+} // namespace Operon
+
+#endif
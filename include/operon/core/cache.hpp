@@ -0,0 +1,121 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "gsl/gsl"
+#include "tree.hpp"
+
+namespace Operon {
+// bounded fitness cache keyed by the strict hash value of a tree (before evaluation). an entry holds the fitness
+// and the coefficients after local optimization, as well as the length of the tree (a lookup with a different
+// length is a miss, which guards against hash collisions between trees of different shapes), so that a duplicate offspring can take both without being
+// evaluated. the cache is a direct-mapped table: a new entry replaces the one in its slot, so the memory is fixed
+// by the capacity. the slots are guarded by a fixed number of mutexes (lock striping), which makes the cache safe
+// to use from the offspring generators running concurrently
+class FitnessCache {
+public:
+    static constexpr size_t DefaultCapacity = 1UL << 16;
+
+    struct Entry {
+        Operon::Hash Key;
+        size_t Length;
+        Operon::Scalar Fitness;
+        std::vector<double> Coefficients;
+    };
+
+    explicit FitnessCache(size_t capacity = DefaultCapacity)
+        : slots_(std::max(capacity, size_t { 1 }))
+        , locks_(std::min(slots_.size(), Stripes))
+    {
+    }
+
+    FitnessCache(const FitnessCache&) = delete;
+    FitnessCache& operator=(const FitnessCache&) = delete;
+
+    std::optional<Entry> Lookup(Operon::Hash key, size_t length) const
+    {
+        auto i = Index(key);
+        {
+            std::lock_guard<std::mutex> lock(locks_[i % locks_.size()]);
+            if (const auto& slot = slots_[i]; slot.has_value() && slot->Key == key && slot->Length == length) {
+                ++hits_;
+                return slot;
+            }
+        }
+        ++misses_;
+        return std::nullopt;
+    }
+
+    void Insert(Operon::Hash key, size_t length, Operon::Scalar fitness, std::vector<double> coefficients)
+    {
+        auto i = Index(key);
+        std::lock_guard<std::mutex> lock(locks_[i % locks_.size()]);
+        slots_[i] = Entry { key, length, fitness, std::move(coefficients) };
+    }
+
+    // the entries become invalid when the fitness function changes (eg. when the training data changes)
+    void Clear()
+    {
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            std::lock_guard<std::mutex> lock(locks_[i % locks_.size()]);
+            slots_[i].reset();
+        }
+    }
+
+    // whether the hits count against the evaluation budget (as one fitness evaluation each)
+    void ChargeHits(bool value) { chargeHits_ = value; }
+    bool ChargeHits() const { return chargeHits_; }
+
+    size_t Capacity() const { return slots_.size(); }
+    size_t Hits() const { return hits_; }
+    size_t Misses() const { return misses_; }
+    double HitRate() const
+    {
+        auto lookups = Hits() + Misses();
+        return lookups == 0 ? 0.0 : static_cast<double>(Hits()) / lookups;
+    }
+
+    void ResetStatistics()
+    {
+        hits_ = 0;
+        misses_ = 0;
+    }
+
+private:
+    static constexpr size_t Stripes = 64;
+
+    size_t Index(Operon::Hash key) const { return key % slots_.size(); }
+
+    std::vector<std::optional<Entry>> slots_;
+    mutable std::vector<std::mutex> locks_;
+    mutable std::atomic_ulong hits_ = 0;
+    mutable std::atomic_ulong misses_ = 0;
+    bool chargeHits_ = true;
+};
+} // namespace Operon
+
+#endif
@@ -0,0 +1,107 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef COMPACT_HPP
+#define COMPACT_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "common.hpp"
+#include "constants.hpp"
+#include "gsl/gsl"
+#include "tree.hpp"
+
+namespace Operon {
+// structure-of-arrays tree representation for storing very large populations. evaluation only needs the node
+// types, subtree lengths and coefficients, so each node is packed into 4 bytes (type, arity, length), while the
+// coefficients of the leaves (constant values and variable weights) and the hash values of the variable leaves
+// are kept in separate arrays, in postfix order. node hash values are not stored but computed on demand (see
+// HashValue). Evaluate, SubtreeCrossover and the mutation operators work on this representation directly
+class CompactTree {
+public:
+    struct Code {
+        uint8_t Type; // index of the node type (see NodeTypes::GetIndex)
+        uint8_t Arity;
+        uint16_t Length;
+
+        NodeType GetType() const noexcept { return static_cast<NodeType>(1u << Type); }
+        bool IsLeaf() const noexcept { return Arity == 0; }
+        bool IsConstant() const noexcept { return GetType() == NodeType::Constant; }
+        bool IsVariable() const noexcept { return GetType() == NodeType::Variable; }
+        bool IsCommutative() const noexcept { return GetType() < NodeType::Sub; }
+    };
+    static_assert(sizeof(Code) == 4);
+
+    CompactTree() = default;
+    explicit CompactTree(const Tree& tree);
+
+    // expands the compact representation into a tree (the node hash values are those of an unsorted tree)
+    Tree ToTree() const;
+
+    const std::vector<Code>& Codes() const noexcept { return code; }
+    const Code& operator[](gsl::index i) const noexcept { return code[i]; }
+
+    // coefficients of the leaves, in postfix order
+    gsl::span<Operon::Scalar> Coefficients() noexcept { return coefficients; }
+    gsl::span<const Operon::Scalar> Coefficients() const noexcept { return coefficients; }
+
+    // hash values of the variables referenced by the variable leaves, in postfix order
+    gsl::span<Operon::Hash> Variables() noexcept { return variables; }
+    gsl::span<const Operon::Hash> Variables() const noexcept { return variables; }
+
+    // position in Coefficients (resp. Variables) of the first leaf (resp. variable leaf) at or after node i
+    size_t LeafIndex(gsl::index i) const noexcept;
+    size_t VariableIndex(gsl::index i) const noexcept;
+
+    size_t Length() const noexcept { return code.size(); }
+    bool Empty() const noexcept { return code.empty(); }
+    size_t Depth() const noexcept;
+    size_t Level(gsl::index i) const noexcept; // distance of node i to the root
+
+    // depth of the subtree rooted at each node (as Node::Depth)
+    std::vector<uint16_t> Depths() const;
+
+    // computes the hash value of the tree as it is, with the same scheme as Tree::Sort (which also sorts the
+    // children of commutative nodes, so the hash values are the same for trees converted after sorting)
+    Operon::Hash HashValue(Operon::HashMode mode) const;
+
+    // memory used by this tree (object and arrays), in bytes
+    size_t MemoryBytes() const noexcept
+    {
+        return sizeof(CompactTree) + code.capacity() * sizeof(Code) + coefficients.capacity() * sizeof(Operon::Scalar) + variables.capacity() * sizeof(Operon::Hash);
+    }
+
+    // returns a copy of lhs where the subtree at index i is replaced by the subtree of rhs at index j
+    static CompactTree Cross(const CompactTree& lhs, const CompactTree& rhs, gsl::index i, gsl::index j);
+
+    // changes the type of internal node i (to a type with the same arity)
+    void SetType(gsl::index i, NodeType type) noexcept
+    {
+        Expects(!code[i].IsLeaf());
+        code[i].Type = static_cast<uint8_t>(NodeTypes::GetIndex(type));
+    }
+
+private:
+    std::vector<Code> code;
+    std::vector<Operon::Scalar> coefficients;
+    std::vector<Operon::Hash> variables;
+};
+} // namespace Operon
+#endif
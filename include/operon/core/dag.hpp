@@ -0,0 +1,88 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef DAG_HPP
+#define DAG_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "gsl/gsl"
+#include "tree.hpp"
+
+namespace Operon {
+// hash-consed store of the subtrees of a population. every unique subtree (by its strict hash value, see
+// Tree::Sort) is interned once, as its root node and the ids of its children, so that the individuals are roots
+// of a directed acyclic graph and the memory scales with the number of unique subtrees instead of the total
+// number of nodes. the children of a subtree are always interned before it, so their ids are smaller, which
+// gives a topological order for the evaluation (see Evaluate in eval.hpp)
+class SubtreeStore {
+public:
+    using Id = uint32_t;
+
+    struct Entry {
+        Node Root;           // the root node of the subtree (its Parent field is meaningless)
+        uint32_t Children;   // offset of the ids of the children (from left to right) in the children array
+    };
+
+    SubtreeStore() = default;
+    SubtreeStore(const SubtreeStore&) = delete;
+    SubtreeStore& operator=(const SubtreeStore&) = delete;
+
+    // interns the subtrees of the given tree and returns the id of its root. the tree must be sorted in strict
+    // mode (see Tree::Sort), as its subtrees are identified by their calculated hash values. a subtree that is
+    // already in the store is not visited, so interning a tree that shares most of its subtrees with other
+    // individuals is cheap. a subtree whose hash value is taken by a subtree with a different root (type, arity
+    // or length) is a collision and is stored separately. this method is thread-safe
+    Id Intern(const Tree& tree);
+
+    // expands the subtree with the given id into a tree (in postfix order)
+    Tree ToTree(Id id) const;
+
+    const Entry& operator[](Id id) const noexcept { return entries_[id]; }
+    gsl::span<const Id> Children(Id id) const noexcept { return { children_.data() + entries_[id].Children, entries_[id].Root.Arity }; }
+
+    // the number of unique subtrees
+    size_t Size() const noexcept { return entries_.size(); }
+    bool Empty() const noexcept { return entries_.empty(); }
+
+    // memory used by the store, in bytes
+    size_t MemoryBytes() const noexcept
+    {
+        return sizeof(SubtreeStore) + entries_.capacity() * sizeof(Entry) + children_.capacity() * sizeof(Id) + index_.size() * (sizeof(Operon::Hash) + sizeof(Id) + sizeof(void*));
+    }
+
+    // removes the subtrees which are not reachable from the given roots (eg. those of the individuals that did
+    // not survive a generation) and updates the roots to their new ids. the relative order of the subtrees is kept
+    void Collect(gsl::span<Id> roots);
+
+    void Clear();
+
+private:
+    Id Intern(gsl::span<const Node> nodes, gsl::index i);
+
+    std::vector<Entry> entries_;
+    std::vector<Id> children_;
+    std::unordered_map<Operon::Hash, Id> index_;
+    std::mutex mutex_;
+};
+} // namespace Operon
+#endif
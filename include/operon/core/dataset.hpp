@@ -26,8 +26,12 @@
 #include <Eigen/Dense>
 #include <Eigen/Eigen>
 #include <algorithm>
+#include <array>
 #include <exception>
 #include <fmt/core.h>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <unordered_map>
 #include <vector>
@@ -42,34 +46,142 @@ namespace {
 }
 
 class Dataset {
-private:
-    std::vector<Variable> variables;
+public:
     using MatrixType = Eigen::Array<Operon::Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
-    MatrixType values;
+    // column-major view over the values, columns may be padded (eg. for alignment in memory-mapped files)
+    using MapType = Eigen::Map<const MatrixType, Eigen::Unaligned, Eigen::OuterStride<>>;
 
-    Dataset();
+    // storage type of a column. integer columns store quantized values q, decoded as Offset + Scale * q
+    enum class StorageType : uint32_t {
+        Float64 = 0,
+        Float32 = 1,
+        Float16 = 2,
+        BFloat16 = 3,
+        Int8 = 4,
+        Int16 = 5,
+    };
 
-public:
-    Dataset(const std::string& file, bool hasHeader = false);
-    Dataset(const Dataset& rhs)
-        : variables(rhs.variables)
-        , values(rhs.values)
+    static constexpr StorageType NativeStorageType = std::is_same_v<Operon::Scalar, float> ? StorageType::Float32 : StorageType::Float64;
+
+    // number of rows in a block of the tiled layout (see Tile), equal to the evaluation batch size
+    static constexpr gsl::index TileRows = 64;
+
+    static size_t StorageSize(StorageType type)
     {
+        switch (type) {
+        case StorageType::Float64:
+            return sizeof(double);
+        case StorageType::Float32:
+            return sizeof(float);
+        case StorageType::Float16:
+        case StorageType::BFloat16:
+        case StorageType::Int16:
+            return sizeof(int16_t);
+        case StorageType::Int8:
+            return sizeof(int8_t);
+        }
+        return 0;
     }
-    Dataset(Dataset&& rhs) noexcept
-        : variables(rhs.variables)
-        , values(std::move(rhs.values))
+
+private:
+    // columns of row-selection views, gathered on first access through GetValues or Values
+    struct GatherCache {
+        std::mutex mutex;
+        std::unordered_map<gsl::index, std::unique_ptr<Operon::Vector<Operon::Scalar>>> columns;
+        std::unique_ptr<MatrixType> matrix;
+    };
+
+    // location and encoding of a column, used when at least one column is not stored as Operon::Scalar
+    struct Column {
+        StorageType Type = NativeStorageType;
+        void const* Data = nullptr;
+        Operon::Scalar Scale = 1;
+        Operon::Scalar Offset = 0;
+        std::shared_ptr<const void> Storage; // keeps the values alive
+    };
+
+    // a lagged variable reads column Base shifted down by Offset rows
+    struct Lag {
+        gsl::index Base;
+        gsl::index Offset;
+    };
+
+    std::vector<Variable> variables;
+
+    // the storage is immutable and shared between copies and views of the dataset: it is either owned
+    // (allocated on the heap) or memory-mapped. operations that modify the values detach the dataset first,
+    // copying the storage if it is shared with anyone else (copy-on-write)
+    std::shared_ptr<MatrixType> owned;
+    std::shared_ptr<const void> mapping; // keeps the mapped file alive
+
+    // location of the column-major values, either inside the owned storage or inside the mapping
+    Operon::Scalar const* data = nullptr;
+    gsl::index rows = 0;
+    gsl::index cols = 0;
+    gsl::index stride = 0; // distance between consecutive columns, in elements
+
+    // optional row selection: row i of the dataset is row (*rowIndices)[i] of the storage
+    std::shared_ptr<const std::vector<gsl::index>> rowIndices;
+    // optional per-column encoding, if set it takes precedence over data and stride
+    std::shared_ptr<const std::vector<Column>> encoding;
+    // optional tiled layout, if set it replaces the other storage: column j of block t occupies column
+    // t * cols + j of the matrix, which has TileRows rows (the last block is padded with zeros)
+    std::shared_ptr<const MatrixType> tiles;
+    // optional lagged variables, which have no storage of their own: variable index cols + k is described by
+    // (*lags)[k] and is resolved to an offset into its base column when loaded
+    std::shared_ptr<const std::vector<Lag>> lags;
+    // lagged variables that were materialized as regular columns (see Reallocate): they occupy the last columns,
+    // column cols - size + k is described by (*materializedLags)[k] and is still transformed with its base column
+    std::shared_ptr<const std::vector<Lag>> materializedLags;
+    std::shared_ptr<GatherCache> cache;
+
+    Dataset() = default;
+
+    // points the view to the owned storage
+    void Bind()
     {
+        data = owned->data();
+        rows = owned->rows();
+        cols = owned->cols();
+        stride = owned->rows();
     }
+
+    // makes the storage private to this dataset, must be called before modifying the values
+    void Detach();
+
+    // true if the encoded column keeps the owned or mapped storage alive
+    bool RefersToStorage(Column const& column) const;
+
+    // true if the values are stored in the owned storage, which is not shared with any other dataset
+    bool IsPrivate() const { return owned && owned.use_count() == 1 && !rowIndices && !encoding && !tiles; }
+
+    // copies the values into new private storage with room for the given number of rows
+    void Reallocate(gsl::index capacity);
+
+    // adds a lagged variable without reassigning the hash values (see AddLag)
+    gsl::index AppendLag(gsl::index index, gsl::index lag);
+
+    void ReadBinary(const std::string& file);
+    void ReadCsv(const std::string& file, bool hasHeader);
+    void ReadArrow(const std::string& file);
+
+public:
+    // the file can be a csv file, a binary dataset file (see Save) or an arrow ipc file (feather v2, requires
+    // USE_ARROW), the format is detected automatically. uncompressed arrow files with a single record batch are
+    // read in place from the memory-mapped file
+    Dataset(const std::string& file, bool hasHeader = false);
+    Dataset(const Dataset& rhs) = default;
+    Dataset(Dataset&& rhs) noexcept = default;
     Dataset(const std::vector<Variable>& vars, const std::vector<std::vector<Operon::Scalar>>& vals)
         : variables(vars)
+        , owned(std::make_shared<MatrixType>(vals.front().size(), vals.size()))
     {
-        values = MatrixType(vals.front().size(), vals.size());
         for (size_t i = 0; i < vals.size(); ++i) {
             for (size_t j = 0; j < vals[i].size(); ++j) {
-                values(j, i) = vals[i][j];
+                (*owned)(j, i) = vals[i][j];
             }
         }
+        Bind();
     }
 
     Dataset& operator=(Dataset rhs)
@@ -81,14 +193,157 @@ public:
     void swap(Dataset& rhs) noexcept
     {
         variables.swap(rhs.variables);
-        values.swap(rhs.values);
+        owned.swap(rhs.owned);
+        mapping.swap(rhs.mapping);
+        std::swap(data, rhs.data);
+        std::swap(rows, rhs.rows);
+        std::swap(cols, rhs.cols);
+        std::swap(stride, rhs.stride);
+        rowIndices.swap(rhs.rowIndices);
+        encoding.swap(rhs.encoding);
+        tiles.swap(rhs.tiles);
+        lags.swap(rhs.lags);
+        materializedLags.swap(rhs.materializedLags);
+        cache.swap(rhs.cache);
+    }
+
+    // returns a view sharing the storage of this dataset, restricted to the given variables
+    Dataset View(const std::vector<std::string>& names) const;
+
+    // returns a view sharing the storage of this dataset, where row i of the view is row indices[i] of this dataset
+    Dataset View(gsl::span<const gsl::index> indices) const;
+
+    // returns a copy of the given rows in the column layout (without lagged variables)
+    Dataset Slice(Range range) const;
+
+    // position of a sequential reader in a dataset file (see ReadRows)
+    struct Cursor {
+        size_t Row = 0; // index of the next row
+        size_t Offset = 0; // byte offset of the next line (csv files only)
+    };
+
+    // reads the next rows of a dataset file (at most count, none at the end of the file) and advances the cursor,
+    // for datasets that do not fit in memory (see DatasetStream). the file is mapped only for the duration of the
+    // call, so only the returned rows stay in memory. the variables and their hash values are the same as when
+    // the whole file is read
+    static Dataset ReadRows(const std::string& file, Cursor& cursor, size_t count, bool hasHeader = false);
+
+    // appends the rows of the given dataset, which must contain all the stored variables of this dataset (they
+    // are matched by name, other variables are ignored). the storage grows geometrically, so appending is amortized
+    // constant time per row, and rows are appended in place while they fit in the reserved capacity (existing
+    // values are neither moved nor copied). copies of this dataset are not affected (copy-on-write). lagged
+    // variables extend to the new rows
+    void Append(const Dataset& block);
+
+    // reserves storage for the given number of rows (see Append)
+    void Reserve(size_t capacity);
+
+    // the number of rows that fit in the storage of this dataset without reallocating it
+    size_t Capacity() const { return IsPrivate() ? static_cast<size_t>(owned->rows()) : Rows(); }
+
+    // stores column index in the given type. for integer types the values are quantized using the given scale
+    // and offset, which by default are chosen such that the range of the column fits the range of the type
+    // (integer-valued columns that fit are stored exactly)
+    void Encode(gsl::index index, StorageType type);
+    void Encode(gsl::index index, StorageType type, Operon::Scalar scale, Operon::Scalar offset);
+
+    // reorganizes the values such that the rows are grouped into blocks of TileRows rows, with the values of all
+    // variables within a block stored next to each other. this keeps the data touched by an evaluation batch
+    // together when trees reference a large part of the variables. the blocks are aligned for vectorized loads
+    // (see Block). on very wide datasets, trees using few of the variables are faster with the column layout.
+    // lagged variables are not part of the tiles, they are read from their base column
+    void Tile();
+
+    // returns the values of column index in the given block of the tiled layout
+    gsl::span<const Operon::Scalar> Block(gsl::index index, gsl::index block) const noexcept
+    {
+        Expects(tiles && !rowIndices);
+        return gsl::span<const Operon::Scalar>(tiles->col(block * cols + index).data(), TileRows);
+    }
+
+    // adds a lagged copy of the given column (for time series): row i of the new variable holds the value of row
+    // i - lag of the column, where rows are counted in storage order (so lags are not affected by shuffling or
+    // other row views). lagged variables store no values, the evaluator reads them through an offset into the
+    // base column. the first lag rows have no value and read as NaN, so the training range should not start
+    // before MaxLag(). the new variable is named <name>_lag<lag>. the hash values of all the variables are
+    // reassigned (see Variables), so lags should be added before any trees are created. returns the index
+    // of the new variable
+    gsl::index AddLag(gsl::index index, gsl::index lag);
+
+    // adds lags 1 to maxLag of all the stored columns
+    void AddLags(gsl::index maxLag);
+
+    // the largest lag of any lagged variable (zero if there are none)
+    gsl::index MaxLag() const
+    {
+        if (!lags) {
+            return 0;
+        }
+        return std::max_element(lags->begin(), lags->end(), [](auto const& a, auto const& b) { return a.Offset < b.Offset; })->Offset;
     }
 
-    size_t Rows() const { return values.rows(); }
-    size_t Cols() const { return values.cols(); }
+    // true if the variable with the given index is a lagged view of another column
+    bool IsLagged(gsl::index index) const noexcept { return index >= cols; }
+
+    // true if the variable with the given index is a lagged variable that was materialized (eg. in a row view)
+    bool IsMaterializedLag(gsl::index index) const noexcept
+    {
+        return materializedLags && index < cols && index >= cols - static_cast<gsl::index>(materializedLags->size());
+    }
+
+    StorageType GetStorageType(gsl::index index) const { return encoding ? (*encoding)[index].Type : NativeStorageType; }
+
+    // total size of the (possibly shared) column storage used by this dataset, in bytes
+    size_t StorageBytes() const;
+
+    // writes the dataset in binary columnar format: a small header (dimensions, variable names, hash values
+    // and column types) followed by the columns, each starting at an offset aligned to BinaryAlignment bytes.
+    // columns keep their storage type. binary files are memory-mapped when loaded, without parsing or copying
+    // the values. lagged variables are not written (see AddLag)
+    void Save(const std::string& file) const;
+
+    static constexpr size_t BinaryAlignment = 64;
+
+    size_t Rows() const { return rowIndices ? rowIndices->size() : rows; }
+    size_t Cols() const { return cols; } // stored columns, without lagged variables
     std::pair<size_t, size_t> Dimensions() const { return { Rows(), Cols() }; }
 
-    const MatrixType& Values() const { return values; }
+    // for row-selection views and encoded datasets, the values are gathered into a private copy on first access
+    const MapType Values() const;
+
+    // true if the values are read directly from a memory-mapped file
+    bool IsMapped() const { return static_cast<bool>(mapping); }
+
+    // true if the values share storage with another dataset
+    bool IsShared() const
+    {
+        if (tiles) {
+            return tiles.use_count() > 1;
+        }
+        return owned ? owned.use_count() > 1 : static_cast<bool>(mapping);
+    }
+
+    // true if the rows of the dataset are stored contiguously (no row selection)
+    bool IsContiguous() const { return !rowIndices; }
+
+    // true if some columns are not stored as Operon::Scalar
+    bool IsEncoded() const { return static_cast<bool>(encoding); }
+
+    // true if the values are stored in the tiled layout
+    bool IsTiled() const { return static_cast<bool>(tiles); }
+
+    // copies count values of column index, starting at the given row, into the output buffer (decoding and
+    // converting them to T). this is how the evaluator reads the data, so that views and encoded columns do
+    // not have to be materialized
+    template <typename T>
+    void Load(gsl::index index, gsl::index start, gsl::index count, T* out) const noexcept
+    {
+        if (index >= cols) {
+            LoadLagged(index, start, count, out);
+            return;
+        }
+        LoadStorage(index, rowIndices ? rowIndices->data() + start : nullptr, start, count, out);
+    }
 
     const std::vector<std::string> VariableNames() const
     {
@@ -100,18 +355,21 @@ public:
     const gsl::span<const Operon::Scalar> GetValues(const std::string& name) const noexcept
     {
         auto it = std::partition_point(variables.begin(), variables.end(), [&](const auto& v) { return CompareWithSize(v.Name, name); });
-        return gsl::span<const Operon::Scalar>(values.col(it->Index).data(), values.rows());
+        return GetValues(it->Index);
     }
 
     const gsl::span<const Operon::Scalar> GetValues(Operon::Hash hashValue) const noexcept
     {
         auto it = std::partition_point(variables.begin(), variables.end(), [=](const auto& v) { return v.Hash < hashValue; });
-        return gsl::span<const Operon::Scalar>(values.col(it->Index).data(), values.rows());
+        return GetValues(it->Index);
     }
 
     const gsl::span<const Operon::Scalar> GetValues(gsl::index index) const noexcept
     {
-        return gsl::span<const Operon::Scalar>(values.col(index).data(), values.rows());
+        if (rowIndices || encoding || tiles || index >= cols) {
+            return GatherColumn(index);
+        }
+        return gsl::span<const Operon::Scalar>(data + index * stride, rows);
     }
 
     const std::string& GetName(Operon::Hash hashValue) const
@@ -135,35 +393,184 @@ public:
 
     const gsl::span<const Variable> Variables() const { return gsl::span<const Variable>(variables); }
 
-    void Shuffle(Operon::Random& random) 
+    // permutes the rows through a row selection, without moving the values (see also Partition)
+    void Shuffle(Operon::Random& random)
     {
-        Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic> perm(values.rows());
-        perm.setIdentity();
-        // generate a random permutation
-        std::shuffle(perm.indices().data(), perm.indices().data() + perm.indices().size(), random);
-        values = perm * values.matrix(); // permute rows
+        std::vector<gsl::index> indices(Rows());
+        std::iota(indices.begin(), indices.end(), 0);
+        std::shuffle(indices.begin(), indices.end(), random);
+        *this = View(indices);
     }
 
-    void Normalize(gsl::index i, Range range) 
+    // lagged variables are transformed together with their base column
+    void Normalize(gsl::index i, Range range)
     {
-        Expects(range.Start() + range.Size() < static_cast<size_t>(values.rows()));
-        auto seg = values.col(i).segment(range.Start(), range.Size());
+        if (IsLagged(i) || IsMaterializedLag(i)) {
+            return;
+        }
+        Detach();
+        auto values = owned->col(i).head(rows); // the storage may have spare capacity (see Reserve)
+        Expects(range.Start() + range.Size() < static_cast<size_t>(rows));
+        auto seg = values.segment(range.Start(), range.Size());
         auto min = seg.minCoeff();
         auto max = seg.maxCoeff();
-        values.col(i) = (values.col(i).array() - min) / (max - min);
+        TransformMaterializedLags(i, [&](auto column) { column = (column.array() - min) / (max - min); });
+        values = (values.array() - min) / (max - min);
+        if (lags) {
+            cache = std::make_shared<GatherCache>(); // gathered lagged columns are stale
+        }
     }
 
     // standardize column i using mean and stddev calculated over the specified range
-    void Standardize(gsl::index i, Range range) 
+    void Standardize(gsl::index i, Range range)
     {
-        Expects(range.Start() + range.Size() < static_cast<size_t>(values.rows()));
-        auto seg = values.col(i).segment(range.Start(), range.Size());
+        if (IsLagged(i) || IsMaterializedLag(i)) {
+            return;
+        }
+        Detach();
+        auto values = owned->col(i).head(rows); // the storage may have spare capacity (see Reserve)
+        Expects(range.Start() + range.Size() < static_cast<size_t>(rows));
+        auto seg = values.segment(range.Start(), range.Size());
         MeanVarianceCalculator calc;
         auto vals = gsl::span<Operon::Scalar>(seg.data(), seg.size());
         calc.Reset();
         calc.Add(vals);
 
-        values.col(i) = (values.col(i).array() - calc.Mean()) / calc.StandardDeviation();
+        TransformMaterializedLags(i, [&](auto column) { column = (column.array() - calc.Mean()) / calc.StandardDeviation(); });
+        values = (values.array() - calc.Mean()) / calc.StandardDeviation();
+        if (lags) {
+            cache = std::make_shared<GatherCache>(); // gathered lagged columns are stale
+        }
+    }
+
+private:
+    gsl::span<const Operon::Scalar> GatherColumn(gsl::index index) const;
+
+    // applies f to the owned values of the materialized lagged variables of column i (see Normalize)
+    template <typename F>
+    void TransformMaterializedLags(gsl::index i, F&& f)
+    {
+        if (!materializedLags) {
+            return;
+        }
+        auto first = cols - static_cast<gsl::index>(materializedLags->size());
+        for (size_t k = 0; k < materializedLags->size(); ++k) {
+            if ((*materializedLags)[k].Base == i) {
+                f(owned->col(first + static_cast<gsl::index>(k)).head(rows));
+            }
+        }
+    }
+
+    // loads the given rows of a stored column: the storage rows idx[0..count) if idx is not null (row
+    // selection), otherwise the contiguous storage rows [start, start + count)
+    template <typename T>
+    void LoadStorage(gsl::index index, gsl::index const* idx, gsl::index start, gsl::index count, T* out) const noexcept
+    {
+        if (tiles) {
+            LoadTiled(index, idx, start, count, out);
+            return;
+        }
+        if (!encoding) {
+            Decode(data + index * stride, Operon::Scalar { 1 }, Operon::Scalar { 0 }, idx, start, count, out);
+            return;
+        }
+        auto const& c = (*encoding)[index];
+        switch (c.Type) {
+        case StorageType::Float64:
+            Decode(static_cast<double const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        case StorageType::Float32:
+            Decode(static_cast<float const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        case StorageType::Float16:
+            Decode(static_cast<Eigen::half const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        case StorageType::BFloat16:
+            Decode(static_cast<Eigen::bfloat16 const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        case StorageType::Int8:
+            Decode(static_cast<int8_t const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        case StorageType::Int16:
+            Decode(static_cast<int16_t const*>(c.Data), c.Scale, c.Offset, idx, start, count, out);
+            break;
+        }
+    }
+
+    // storage row r of a lagged variable is storage row r - lag of its base column. for contiguous rows this is
+    // just an offset into the base column. rows without a lagged value (r < lag) are NaN
+    template <typename T>
+    void LoadLagged(gsl::index index, gsl::index start, gsl::index count, T* out) const noexcept
+    {
+        auto const [base, lag] = (*lags)[index - cols];
+        auto const missing = T(std::numeric_limits<Operon::Scalar>::quiet_NaN());
+        if (!rowIndices) {
+            auto n = std::clamp(lag - start, gsl::index { 0 }, count);
+            std::fill_n(out, n, missing);
+            LoadStorage(base, nullptr, start + n - lag, count - n, out + n);
+            return;
+        }
+        std::array<gsl::index, TileRows> shifted;
+        for (gsl::index i = 0; i < count; i += TileRows) {
+            auto n = std::min(TileRows, count - i);
+            auto const* idx = rowIndices->data() + start + i;
+            for (gsl::index j = 0; j < n; ++j) {
+                shifted[j] = std::max(idx[j] - lag, gsl::index { 0 });
+            }
+            LoadStorage(base, shifted.data(), 0, n, out + i);
+            for (gsl::index j = 0; j < n; ++j) {
+                if (idx[j] < lag) {
+                    out[i + j] = missing;
+                }
+            }
+        }
+    }
+
+    template <typename T>
+    void LoadTiled(gsl::index index, gsl::index const* idx, gsl::index start, gsl::index count, T* out) const noexcept
+    {
+        auto value = [&](gsl::index row) { return tiles->data() + (row / TileRows * cols + index) * TileRows + row % TileRows; };
+        if (idx != nullptr) {
+            for (gsl::index i = 0; i < count; ++i) {
+                out[i] = T(*value(idx[i]));
+            }
+            return;
+        }
+        // the range may span several blocks
+        for (gsl::index i = 0; i < count;) {
+            auto n = std::min(count - i, TileRows - (start + i) % TileRows);
+            Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>>(out + i, n) = Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>>(value(start + i), n).template cast<T>();
+            i += n;
+        }
+    }
+
+    // the contiguous cases map to eigen casts, which are vectorized for the floating-point types (including
+    // half and bfloat16), and to a multiply-add loop the compiler vectorizes for the integer types
+    template <typename U, typename T>
+    void Decode(U const* column, Operon::Scalar scale, Operon::Scalar offset, gsl::index const* idx, gsl::index start, gsl::index count, T* out) const noexcept
+    {
+        if (idx != nullptr) {
+            for (gsl::index i = 0; i < count; ++i) {
+                if constexpr (std::is_integral_v<U>) {
+                    out[i] = T(offset + scale * static_cast<Operon::Scalar>(column[idx[i]]));
+                } else {
+                    out[i] = T(static_cast<Operon::Scalar>(column[idx[i]]));
+                }
+            }
+            return;
+        }
+        Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> dst(out, count);
+        if constexpr (std::is_integral_v<U>) {
+            // decoded in Operon::Scalar and then converted, so that every output type gets the same values
+            for (gsl::index i = 0; i < count; ++i) {
+                out[i] = T(offset + scale * static_cast<Operon::Scalar>(column[start + i]));
+            }
+        } else if constexpr (std::is_same_v<U, Eigen::half> || std::is_same_v<U, Eigen::bfloat16>) {
+            // convert to float first, for which eigen has packet casts
+            dst = Eigen::Map<const Eigen::Array<U, Eigen::Dynamic, 1>>(column + start, count).template cast<float>().template cast<T>();
+        } else {
+            dst = Eigen::Map<const Eigen::Array<U, Eigen::Dynamic, 1>>(column + start, count).template cast<T>();
+        }
     }
 };
 }
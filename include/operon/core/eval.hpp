@@ -20,6 +20,8 @@
 #ifndef EVALUATE_HPP
 #define EVALUATE_HPP
 
+#include "compact.hpp"
+#include "dag.hpp"
 #include "dataset.hpp"
 #include "grammar.hpp"
 #include "gsl/gsl"
@@ -34,6 +36,7 @@
 
 namespace Operon {
 constexpr gsl::index BATCHSIZE = 64;
+static_assert(BATCHSIZE == Dataset::TileRows, "evaluation batches must match the blocks of the tiled dataset layout");
 
 template <typename T>
 inline std::pair<T, T> MinMax(gsl::span<T> values) noexcept
@@ -68,10 +71,10 @@ Operon::Vector<T> Evaluate(const Tree& tree, const Dataset& dataset, const Range
     return result;
 }
 
+// evaluates a tree given as a sequence of nodes in postfix order (eg. stored in a PopulationArena)
 template <typename T>
-void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
+void Evaluate(gsl::span<const Node> nodes, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
 {
-    auto& nodes = tree.Nodes();
     Eigen::Array<T, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor> m(BATCHSIZE, nodes.size());
     Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor>> res(result.data(), result.size(), 1); 
 
@@ -93,7 +96,8 @@ void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T con
 
     auto lastCol = m.col(nodes.size()-1);
 
-    auto const& values = dataset.Values();
+    // with the tiled layout, full batches can be read directly from the (aligned) dataset blocks
+    bool useBlocks = dataset.IsTiled() && dataset.IsContiguous() && range.Start() % BATCHSIZE == 0;
 
     gsl::index numRows = range.Size();
     for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
@@ -133,7 +137,24 @@ void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T con
             }
             case NodeType::Variable: {
                 auto w = parameters == nullptr ? T(s.Value) : parameters[idx++];
-                r.segment(0, remainingRows) = w * values.col(indices[i]).segment(range.Start() + row, remainingRows).cast<T>();
+                if constexpr (std::is_same_v<T, Operon::Scalar>) {
+                    if (useBlocks && remainingRows == BATCHSIZE && !dataset.IsLagged(indices[i])) {
+                        auto block = (range.Start() + row) / BATCHSIZE;
+                        r = Eigen::Map<const Eigen::Array<T, BATCHSIZE, 1>, Eigen::AlignedMax>(dataset.Block(indices[i], block).data()) * w;
+#if defined(__GNUC__) || defined(__clang__)
+                        // the next block of this variable is far away in memory, beyond the reach of the hardware prefetcher
+                        if (row + 2 * BATCHSIZE <= numRows) {
+                            auto next = reinterpret_cast<char const*>(dataset.Block(indices[i], block + 1).data());
+                            for (size_t b = 0; b < BATCHSIZE * sizeof(T); b += 64) {
+                                __builtin_prefetch(next + b);
+                            }
+                        }
+#endif
+                        break;
+                    }
+                }
+                dataset.Load(indices[i], range.Start() + row, remainingRows, r.data());
+                r.segment(0, remainingRows) *= w;
                 break;
             }
             default: {
@@ -187,6 +208,459 @@ void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T con
     }
 }
 
+template <typename T>
+void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
+{
+    Evaluate(gsl::span<const Node>(tree.Nodes()), dataset, range, parameters, result);
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(gsl::span<const Node> nodes, const Dataset& dataset, const Range range, T const* const parameters = nullptr)
+{
+    Operon::Vector<T> result(range.Size());
+    Evaluate(nodes, dataset, range, parameters, gsl::span<T>(result));
+    return result;
+}
+
+// evaluates the compact representation directly, reading the coefficients from the leaf array (or from
+// parameters, in the same order)
+template <typename T>
+void Evaluate(const CompactTree& tree, const Dataset& dataset, const Range range, T const* const parameters, gsl::span<T> result) noexcept
+{
+    const auto& code = tree.Codes();
+    auto coefficients = tree.Coefficients();
+    auto variables = tree.Variables();
+    gsl::index n = code.size();
+    Eigen::Array<T, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor> m(BATCHSIZE, n);
+    Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1, Eigen::ColMajor>> res(result.data(), result.size(), 1);
+
+    std::vector<gsl::index> indices(variables.size());
+    std::transform(variables.begin(), variables.end(), indices.begin(), [&](auto h) { return dataset.GetIndex(h); });
+
+    gsl::index idx = 0;
+    for (gsl::index i = 0; i < n; ++i) {
+        if (code[i].IsConstant()) {
+            m.col(i).setConstant(parameters == nullptr ? T(coefficients[idx]) : parameters[idx]);
+        }
+        idx += code[i].IsLeaf();
+    }
+
+    auto lastCol = m.col(n - 1);
+
+    gsl::index numRows = range.Size();
+    for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+        idx = 0;
+        gsl::index v = 0;
+        auto remainingRows = std::min(BATCHSIZE, numRows - row);
+        for (gsl::index i = 0; i < n; ++i) {
+            auto r = m.col(i);
+            auto c1 = i - 1; // first child index
+            auto c2 = code[i].Arity == 2 ? c1 - 1 - code[c1].Length : c1; // second child index
+
+            switch (code[i].GetType()) {
+            case NodeType::Add: {
+                r = m.col(c1) + m.col(c2);
+                break;
+            }
+            case NodeType::Mul: {
+                r = m.col(c1) * m.col(c2);
+                break;
+            }
+            case NodeType::Sub: {
+                r = m.col(c1) - m.col(c2);
+                break;
+            }
+            case NodeType::Div: {
+                r = m.col(c1) / m.col(c2);
+                break;
+            }
+            case NodeType::Log: {
+                r = m.col(c1).log();
+                break;
+            }
+            case NodeType::Exp: {
+                r = m.col(c1).exp();
+                break;
+            }
+            case NodeType::Sin: {
+                r = m.col(c1).sin();
+                break;
+            }
+            case NodeType::Cos: {
+                r = m.col(c1).cos();
+                break;
+            }
+            case NodeType::Tan: {
+                r = m.col(c1).tan();
+                break;
+            }
+            case NodeType::Sqrt: {
+                r = m.col(c1).sqrt();
+                break;
+            }
+            case NodeType::Cbrt: {
+                r = m.col(c1).unaryExpr([](T x) { return T(ceres::cbrt(x)); });
+                break;
+            }
+            case NodeType::Square: {
+                r = m.col(c1).square();
+                break;
+            }
+            case NodeType::Constant: {
+                idx++;
+                break;
+            }
+            case NodeType::Variable: {
+                auto w = parameters == nullptr ? T(coefficients[idx]) : parameters[idx];
+                idx++;
+                dataset.Load(indices[v++], range.Start() + row, remainingRows, r.data());
+                r.segment(0, remainingRows) *= w;
+                break;
+            }
+            }
+        }
+        res.segment(row, remainingRows) = lastCol.segment(0, remainingRows).unaryExpr([](T x) { return ceres::IsFinite(x) ? x : Operon::Numeric::Max<T>(); });
+    }
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(const CompactTree& tree, const Dataset& dataset, const Range range, T const* const parameters = nullptr)
+{
+    Operon::Vector<T> result(range.Size());
+    Evaluate(tree, dataset, range, parameters, gsl::span<T>(result));
+    return result;
+}
+
+// evaluates the individuals given by their roots in a hash-consed store. every unique subtree reachable from the
+// roots is computed once per batch of rows, however many individuals contain it (the buffer holds one column per
+// reachable subtree). the values of the k-th root are written to result[k * range.Size(), (k + 1) * range.Size())
+template <typename T>
+void Evaluate(const SubtreeStore& store, gsl::span<const SubtreeStore::Id> roots, const Dataset& dataset, const Range range, gsl::span<T> result) noexcept
+{
+    Expects(result.size() == roots.size() * range.Size());
+
+    // the reachable subtrees, in topological (id) order, and their columns in the buffer
+    gsl::index size = store.Size();
+    std::vector<gsl::index> column(size, -1);
+    for (auto r : roots) {
+        column[r] = 0;
+    }
+    for (gsl::index i = size - 1; i >= 0; --i) {
+        if (column[i] < 0) {
+            continue;
+        }
+        for (auto c : store.Children(i)) {
+            column[c] = 0;
+        }
+    }
+    std::vector<SubtreeStore::Id> order;
+    for (gsl::index i = 0; i < size; ++i) {
+        if (column[i] >= 0) {
+            column[i] = order.size();
+            order.push_back(i);
+        }
+    }
+
+    gsl::index n = order.size();
+    Eigen::Array<T, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor> m(BATCHSIZE, n);
+    std::vector<gsl::index> indices(n);
+    for (gsl::index j = 0; j < n; ++j) {
+        const auto& s = store[order[j]].Root;
+        if (s.IsConstant()) {
+            m.col(j).setConstant(T(s.Value));
+        } else if (s.IsVariable()) {
+            indices[j] = dataset.GetIndex(s.HashValue);
+        }
+    }
+
+    gsl::index numRows = range.Size();
+    for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+        auto remainingRows = std::min(BATCHSIZE, numRows - row);
+        for (gsl::index j = 0; j < n; ++j) {
+            const auto& s = store[order[j]].Root;
+            auto children = store.Children(order[j]);
+            auto r = m.col(j);
+            // the first child is the one closest to the node in postfix order (see the tree evaluation above)
+            auto c1 = s.Arity > 0 ? column[children[s.Arity - 1]] : j;
+            auto c2 = s.Arity == 2 ? column[children[0]] : c1;
+
+            switch (s.Type) {
+            case NodeType::Add: {
+                r = m.col(c1) + m.col(c2);
+                break;
+            }
+            case NodeType::Mul: {
+                r = m.col(c1) * m.col(c2);
+                break;
+            }
+            case NodeType::Sub: {
+                r = m.col(c1) - m.col(c2);
+                break;
+            }
+            case NodeType::Div: {
+                r = m.col(c1) / m.col(c2);
+                break;
+            }
+            case NodeType::Log: {
+                r = m.col(c1).log();
+                break;
+            }
+            case NodeType::Exp: {
+                r = m.col(c1).exp();
+                break;
+            }
+            case NodeType::Sin: {
+                r = m.col(c1).sin();
+                break;
+            }
+            case NodeType::Cos: {
+                r = m.col(c1).cos();
+                break;
+            }
+            case NodeType::Tan: {
+                r = m.col(c1).tan();
+                break;
+            }
+            case NodeType::Sqrt: {
+                r = m.col(c1).sqrt();
+                break;
+            }
+            case NodeType::Cbrt: {
+                r = m.col(c1).unaryExpr([](T x) { return T(ceres::cbrt(x)); });
+                break;
+            }
+            case NodeType::Square: {
+                r = m.col(c1).square();
+                break;
+            }
+            case NodeType::Variable: {
+                dataset.Load(indices[j], range.Start() + row, remainingRows, r.data());
+                r.segment(0, remainingRows) *= T(s.Value);
+                break;
+            }
+            default: {
+                break;
+            }
+            }
+        }
+        for (size_t k = 0; k < roots.size(); ++k) {
+            Eigen::Map<Eigen::Array<T, Eigen::Dynamic, 1>> res(result.data() + k * numRows + row, remainingRows);
+            res = m.col(column[roots[k]]).segment(0, remainingRows).unaryExpr([](T x) { return ceres::IsFinite(x) ? x : Operon::Numeric::Max<T>(); });
+        }
+    }
+}
+
+template <typename T>
+Operon::Vector<T> Evaluate(const SubtreeStore& store, gsl::span<const SubtreeStore::Id> roots, const Dataset& dataset, const Range range)
+{
+    Operon::Vector<T> result(roots.size() * range.Size());
+    Evaluate(store, roots, dataset, range, gsl::span<T>(result));
+    return result;
+}
+
+namespace detail {
+    // evaluates a batch of rows for K coefficient sets in lockstep: node i occupies the columns [i*K, (i+1)*K)
+    // of the buffer and lane k holds the values obtained with the k-th coefficient set. parameters is a P x K
+    // array expression (one coefficient set per column) and indices maps variable nodes to dataset columns.
+    // nodes flagged in the optional skip mask are left untouched (eg. when their values were hoisted)
+    template <typename T, typename Parameters, typename Buffer>
+    void EvaluateLanes(const std::vector<Node>& nodes, const Dataset& dataset, gsl::span<const gsl::index> indices, const Parameters& parameters, gsl::index row, gsl::index remainingRows, Buffer& m, gsl::span<const uint8_t> skip = {}) noexcept
+    {
+        Eigen::Array<T, BATCHSIZE, 1> x;
+        gsl::index k = parameters.cols();
+        gsl::index idx = 0;
+        gsl::index n = nodes.size();
+
+        for (gsl::index i = 0; i < n; ++i) {
+            if (!skip.empty() && skip[i]) {
+                idx += nodes[i].IsLeaf();
+                continue;
+            }
+            auto r = m.middleCols(i * k, k);
+            auto c1 = i - 1; // first child index
+            auto c2 = nodes[i].Arity == 2 ? c1 - 1 - nodes[c1].Length : c1; // second child index
+
+            switch (nodes[i].Type) {
+            case NodeType::Add: {
+                r = m.middleCols(c1 * k, k) + m.middleCols(c2 * k, k);
+                break;
+            }
+            case NodeType::Mul: {
+                r = m.middleCols(c1 * k, k) * m.middleCols(c2 * k, k);
+                break;
+            }
+            case NodeType::Sub: {
+                r = m.middleCols(c1 * k, k) - m.middleCols(c2 * k, k);
+                break;
+            }
+            case NodeType::Div: {
+                r = m.middleCols(c1 * k, k) / m.middleCols(c2 * k, k);
+                break;
+            }
+            case NodeType::Log: {
+                r = m.middleCols(c1 * k, k).log();
+                break;
+            }
+            case NodeType::Exp: {
+                r = m.middleCols(c1 * k, k).exp();
+                break;
+            }
+            case NodeType::Sin: {
+                r = m.middleCols(c1 * k, k).sin();
+                break;
+            }
+            case NodeType::Cos: {
+                r = m.middleCols(c1 * k, k).cos();
+                break;
+            }
+            case NodeType::Tan: {
+                r = m.middleCols(c1 * k, k).tan();
+                break;
+            }
+            case NodeType::Sqrt: {
+                r = m.middleCols(c1 * k, k).sqrt();
+                break;
+            }
+            case NodeType::Cbrt: {
+                r = m.middleCols(c1 * k, k).unaryExpr([](T v) { return T(ceres::cbrt(v)); });
+                break;
+            }
+            case NodeType::Square: {
+                r = m.middleCols(c1 * k, k).square();
+                break;
+            }
+            case NodeType::Constant: {
+                r = parameters.row(idx++).replicate(r.rows(), 1);
+                break;
+            }
+            case NodeType::Variable: {
+                dataset.Load(indices[i], row, remainingRows, x.data());
+                r.topRows(remainingRows) = x.head(remainingRows).replicate(1, k) * parameters.row(idx++).replicate(remainingRows, 1);
+                break;
+            }
+            }
+        }
+    }
+
+    // reverse sweep computing the adjoints (derivatives of the root with respect to every node) for K lanes,
+    // the adjoints of the root must be set by the caller. parents come after their children in postfix order,
+    // so iterating backwards assigns the adjoint of every node before it is propagated further down
+    template <typename T, typename Buffer>
+    void DifferentiateLanes(const std::vector<Node>& nodes, gsl::index k, const Buffer& m, Buffer& d) noexcept
+    {
+        gsl::index n = nodes.size();
+
+        for (gsl::index i = n - 1; i >= 0; --i) {
+            if (nodes[i].IsLeaf()) {
+                continue;
+            }
+            auto c1 = i - 1; // first child index
+            auto c2 = nodes[i].Arity == 2 ? c1 - 1 - nodes[c1].Length : c1; // second child index
+
+            auto r = d.middleCols(i * k, k);
+            auto v = m.middleCols(i * k, k);
+            auto d1 = d.middleCols(c1 * k, k);
+            auto d2 = d.middleCols(c2 * k, k);
+            auto v1 = m.middleCols(c1 * k, k);
+            auto v2 = m.middleCols(c2 * k, k);
+
+            switch (nodes[i].Type) {
+            case NodeType::Add: {
+                d1 = r;
+                d2 = r;
+                break;
+            }
+            case NodeType::Mul: {
+                d1 = r * v2;
+                d2 = r * v1;
+                break;
+            }
+            case NodeType::Sub: {
+                d1 = r;
+                d2 = -r;
+                break;
+            }
+            case NodeType::Div: {
+                d1 = r / v2;
+                d2 = -r * v / v2;
+                break;
+            }
+            case NodeType::Log: {
+                d1 = r / v1;
+                break;
+            }
+            case NodeType::Exp: {
+                d1 = r * v;
+                break;
+            }
+            case NodeType::Sin: {
+                d1 = r * v1.cos();
+                break;
+            }
+            case NodeType::Cos: {
+                d1 = -r * v1.sin();
+                break;
+            }
+            case NodeType::Tan: {
+                d1 = r * (T(1) + v.square());
+                break;
+            }
+            case NodeType::Sqrt: {
+                d1 = r * T(0.5) / v;
+                break;
+            }
+            case NodeType::Cbrt: {
+                d1 = r / (T(3) * v.square());
+                break;
+            }
+            case NodeType::Square: {
+                d1 = T(2) * r * v1;
+                break;
+            }
+            default: {
+                break;
+            }
+            }
+        }
+    }
+}
+
+// evaluates the tree with K coefficient sets at once, sharing the traversal and the data loads between them.
+// parameters is a K x P array (one coefficient set per row, in the order given by Tree::GetCoefficients)
+// and the result is a rows x K array holding the model output for each coefficient set in its own column
+template <typename T>
+void Evaluate(const Tree& tree, const Dataset& dataset, const Range range, const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>& parameters, Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>& result) noexcept
+{
+    auto& nodes = tree.Nodes();
+    gsl::index k = parameters.rows();
+    Eigen::Array<T, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor> m(BATCHSIZE, nodes.size() * k);
+    result.resize(range.Size(), k);
+
+    auto indices = std::vector<gsl::index>(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].IsVariable()) {
+            indices[i] = dataset.GetIndex(nodes[i].HashValue);
+        }
+    }
+
+    auto lastCols = m.middleCols((nodes.size() - 1) * k, k);
+
+    gsl::index numRows = range.Size();
+    for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+        auto remainingRows = std::min(BATCHSIZE, numRows - row);
+        detail::EvaluateLanes<T>(nodes, dataset, indices, parameters.transpose(), range.Start() + row, remainingRows, m);
+        result.middleRows(row, remainingRows) = lastCols.topRows(remainingRows).unaryExpr([](T v) { return ceres::IsFinite(v) ? v : Operon::Numeric::Max<T>(); });
+    }
+}
+
+template <typename T>
+Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> Evaluate(const Tree& tree, const Dataset& dataset, const Range range, const Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic>& parameters)
+{
+    Eigen::Array<T, Eigen::Dynamic, Eigen::Dynamic> result;
+    Evaluate(tree, dataset, range, parameters, result);
+    return result;
+}
+
 struct TreeEvaluator {
     TreeEvaluator(const Tree& tree, const Dataset& dataset, const Range range)
         : tree_ref(tree)
@@ -23,9 +23,234 @@
 #include "core/eval.hpp"
 
 namespace Operon {
-// returns an array of optimized parameters
+// forward difference Jacobian obtained from a single multi-set evaluation: the current coefficients and
+// the P perturbed copies are evaluated in lockstep (see Evaluate) instead of P + 1 separate tree evaluations
+class ForwardDifferenceCostFunction : public ceres::DynamicCostFunction {
+public:
+    using Array = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic>;
+
+    ForwardDifferenceCostFunction(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+        : tree_ref(tree)
+        , dataset_ref(dataset)
+        , target_ref(targetValues)
+        , range(range)
+        , numParameters(tree.CoefficientsCount())
+    {
+    }
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override
+    {
+        constexpr double relativeStepSize = 1e-6; // same as ceres::NumericDiffOptions
+
+        auto p = numParameters;
+        auto n = range.Size();
+        bool derivatives = jacobians != nullptr && jacobians[0] != nullptr;
+
+        Eigen::Map<const Eigen::Array<double, 1, Eigen::Dynamic>> x(parameters[0], p);
+        coefficients.resize(derivatives ? p + 1 : 1, p);
+        coefficients.rowwise() = x;
+        for (gsl::index j = 0; derivatives && j < p; ++j) {
+            auto h = x(j) == 0 ? relativeStepSize : relativeStepSize * std::abs(x(j));
+            coefficients(j + 1, j) += h;
+        }
+
+        Operon::Evaluate(tree_ref.get(), dataset_ref.get(), range, coefficients, estimated);
+
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, 1>> res(residuals, n);
+        Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>> target(target_ref.data(), target_ref.size());
+        res = estimated.col(0) - target.cast<double>();
+
+        if (derivatives) {
+            // ceres expects row-major jacobians
+            Eigen::Map<Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> jac(jacobians[0], n, p);
+            for (gsl::index j = 0; j < p; ++j) {
+                // use the step that was actually taken after rounding
+                auto h = coefficients(j + 1, j) - x(j);
+                jac.col(j) = (estimated.col(j + 1) - estimated.col(0)) / h;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::reference_wrapper<const Tree> tree_ref;
+    std::reference_wrapper<const Dataset> dataset_ref;
+    gsl::span<const Operon::Scalar> target_ref;
+    Range range;
+    gsl::index numParameters;
+
+    // buffers reused between solver iterations
+    mutable Array coefficients;
+    mutable Array estimated;
+};
+
+// residuals and Jacobian computed analytically with a reverse sweep over the tree (see DifferentiateLanes).
+// the target subtraction is fused into the evaluation and the Jacobian is written directly in the storage
+// order expected by the solver (row-major for ceres cost functions, column-major for TinySolver). subtrees
+// without variables are constant over the data, so their values are computed once per call instead of
+// once per batch of rows
+template <int StorageOrder = Eigen::RowMajor>
+class JacobianEvaluator {
+public:
+    using Array = Eigen::Array<double, BATCHSIZE, Eigen::Dynamic, Eigen::ColMajor>;
+
+    JacobianEvaluator(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+        : tree_ref(tree)
+        , dataset_ref(dataset)
+        , target_ref(targetValues)
+        , range(range)
+    {
+        auto const& nodes = tree.Nodes();
+        indices.resize(nodes.size(), -1);
+        coefficientIndices.resize(nodes.size(), -1);
+        constant.resize(nodes.size());
+        variable.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].IsLeaf()) {
+                coefficientIndices[i] = numParameters++;
+            }
+            if (nodes[i].IsVariable()) {
+                indices[i] = dataset.GetIndex(nodes[i].HashValue);
+            }
+            // the subtree of node i spans the positions [i - Length, i]
+            variable[i] = std::any_of(nodes.begin() + i - nodes[i].Length, nodes.begin() + i + 1, [](auto const& s) { return s.IsVariable(); });
+            constant[i] = !variable[i];
+        }
+        values = Array::Zero(BATCHSIZE, nodes.size());
+        adjoints = Array::Zero(BATCHSIZE, nodes.size());
+    }
+
+    bool operator()(double const* parameters, double* residuals, double* jacobian) const
+    {
+        auto const& nodes = tree_ref.get().Nodes();
+        auto const& dataset = dataset_ref.get();
+        Eigen::Array<double, BATCHSIZE, 1> x;
+        gsl::index n = nodes.size();
+        gsl::index numRows = range.Size();
+
+        Eigen::Map<const Eigen::Array<double, Eigen::Dynamic, 1>> coef(parameters, numParameters);
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, 1>> res(residuals, numRows);
+        Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>> target(target_ref.data(), target_ref.size());
+        Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, StorageOrder>> jac(jacobian, numRows, numParameters);
+
+        // constant subtrees do not depend on the row
+        detail::EvaluateLanes<double>(nodes, dataset, indices, coef, range.Start(), 0, values, variable);
+
+        for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+            auto remainingRows = std::min(BATCHSIZE, numRows - row);
+            detail::EvaluateLanes<double>(nodes, dataset, indices, coef, range.Start() + row, remainingRows, values, constant);
+
+            auto output = values.col(n - 1).head(remainingRows);
+            res.segment(row, remainingRows) = output.unaryExpr([](double v) { return ceres::IsFinite(v) ? v : Operon::Numeric::Max<double>(); }) - target.segment(row, remainingRows).cast<double>();
+
+            if (jacobian == nullptr) {
+                continue;
+            }
+
+            adjoints.col(n - 1).setOnes();
+            detail::DifferentiateLanes<double>(nodes, 1, values, adjoints);
+            for (gsl::index i = 0; i < n; ++i) {
+                if (nodes[i].IsConstant()) {
+                    jac.col(coefficientIndices[i]).segment(row, remainingRows) = adjoints.col(i).head(remainingRows).matrix();
+                } else if (nodes[i].IsVariable()) {
+                    dataset.Load(indices[i], range.Start() + row, remainingRows, x.data());
+                    jac.col(coefficientIndices[i]).segment(row, remainingRows) = (adjoints.col(i).head(remainingRows) * x.head(remainingRows)).matrix();
+                }
+            }
+
+            // non-finite outputs are replaced by a constant (see Evaluate), so they have no derivatives
+            if (!output.allFinite()) {
+                for (gsl::index i = 0; i < remainingRows; ++i) {
+                    if (!ceres::IsFinite(output(i))) {
+                        jac.row(row + i).setZero();
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    gsl::index NumResiduals() const { return range.Size(); }
+    gsl::index NumParameters() const { return numParameters; }
+
+private:
+    std::reference_wrapper<const Tree> tree_ref;
+    std::reference_wrapper<const Dataset> dataset_ref;
+    gsl::span<const Operon::Scalar> target_ref;
+    Range range;
+    gsl::index numParameters = 0;
+
+    std::vector<gsl::index> indices;
+    std::vector<gsl::index> coefficientIndices;
+    std::vector<uint8_t> constant; // subtree without variables
+    std::vector<uint8_t> variable;
+
+    mutable Array values;
+    mutable Array adjoints;
+};
+
+// ceres cost function backed by the analytic Jacobian (row-major, as ceres expects it)
+class AnalyticCostFunction : public ceres::DynamicCostFunction {
+public:
+    AnalyticCostFunction(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range)
+        : evaluator(tree, dataset, targetValues, range)
+    {
+    }
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override
+    {
+        return evaluator(parameters[0], residuals, jacobians == nullptr ? nullptr : jacobians[0]);
+    }
+
+private:
+    JacobianEvaluator<Eigen::RowMajor> evaluator;
+};
+
+// weighted least squares on top of another cost function: the residuals and the rows of the Jacobian are
+// scaled by the square roots of the row weights, so that the solver minimizes sum_i w_i * r_i^2
+class WeightedCostFunction : public ceres::DynamicCostFunction {
+public:
+    WeightedCostFunction(ceres::DynamicCostFunction* function, const gsl::span<const Operon::Scalar> weights)
+        : function_ptr(function)
+        , sqrtWeights(weights.size())
+    {
+        Expects(static_cast<size_t>(function->num_residuals()) == weights.size());
+        std::transform(weights.begin(), weights.end(), sqrtWeights.begin(), [](auto w) { return std::sqrt(static_cast<double>(w)); });
+        *mutable_parameter_block_sizes() = function->parameter_block_sizes();
+        set_num_residuals(function->num_residuals());
+    }
+
+    bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const override
+    {
+        if (!function_ptr->Evaluate(parameters, residuals, jacobians)) {
+            return false;
+        }
+        auto n = static_cast<gsl::index>(sqrtWeights.size());
+        Eigen::Map<const Eigen::Array<double, Eigen::Dynamic, 1>> sw(sqrtWeights.data(), n);
+        Eigen::Map<Eigen::Array<double, Eigen::Dynamic, 1>>(residuals, n) *= sw;
+        if (jacobians == nullptr) {
+            return true;
+        }
+        auto const& sizes = parameter_block_sizes();
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if (jacobians[i] != nullptr) {
+                // ceres expects row-major jacobians
+                Eigen::Map<Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> jac(jacobians[i], n, sizes[i]);
+                jac.colwise() *= sw;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::unique_ptr<ceres::DynamicCostFunction> function_ptr;
+    std::vector<double> sqrtWeights;
+};
+
+// returns an array of optimized parameters. if weights are given (one per row of the range), each residual
+// is weighted accordingly (eg. bootstrap counts); an empty span means unit weights
 template <bool autodiff = true>
-ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const gsl::span<const Operon::Scalar> weights, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
 {
     using ceres::CauchyLoss;
     using ceres::DynamicAutoDiffCostFunction;
@@ -47,15 +272,18 @@ ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::s
         fmt::print("\n");
     }
 
-    auto eval = new ResidualEvaluator(tree, dataset, targetValues, range);
     DynamicCostFunction* costFunction;
     if constexpr (autodiff) {
-        costFunction = new DynamicAutoDiffCostFunction<ResidualEvaluator>(eval);
+        // exact derivatives from a hand-written reverse-mode sweep, cheaper than dual numbers
+        costFunction = new AnalyticCostFunction(tree, dataset, targetValues, range);
     } else {
-        costFunction = new DynamicNumericDiffCostFunction(eval);
+        costFunction = new ForwardDifferenceCostFunction(tree, dataset, targetValues, range);
     }
     costFunction->AddParameterBlock(coef.size());
     costFunction->SetNumResiduals(range.Size());
+    if (!weights.empty()) {
+        costFunction = new WeightedCostFunction(costFunction, weights);
+    }
     //auto lossFunction = new CauchyLoss(0.5); // see http://ceres-solver.org/nnls_tutorial.html#robust-curve-fitting
 
     Problem problem;
@@ -82,6 +310,230 @@ ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::s
     return summary;
 }
 
+template <bool autodiff = true>
+ceres::Solver::Summary Optimize(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    return Optimize<autodiff>(tree, dataset, targetValues, gsl::span<const Operon::Scalar> {}, range, iterations, writeCoefficients, report);
+}
+
+// identifies the coefficients which enter the model linearly, ie. leaf nodes whose path to the root
+// consists only of additions and subtractions. the returned vector is indexed in coefficient order
+// (same as Tree::GetCoefficients) and holds the sign with which each coefficient contributes to the
+// model output, or zero if the coefficient enters the model nonlinearly
+inline std::vector<int> LinearCoefficientSigns(const Tree& tree)
+{
+    auto const& nodes = tree.Nodes();
+    std::vector<int> signs(nodes.size(), 0);
+    if (nodes.empty()) {
+        return signs;
+    }
+    // parents always come after their children in the postfix order, so a reverse sweep
+    // visits each node only after its ancestors have been processed
+    signs.back() = 1;
+    for (gsl::index i = nodes.size() - 1; i >= 0; --i) {
+        auto const& s = nodes[i];
+        if (s.IsLeaf()) {
+            continue;
+        }
+        auto additive = signs[i] != 0 && s.Is<NodeType::Add, NodeType::Sub>();
+        for (auto it = tree.Children(i); it.HasNext(); ++it) {
+            // the second operand of a subtraction is negated (see Evaluate)
+            auto negate = s.IsSubtraction() && it.Count() > 0;
+            signs[it.Index()] = additive ? (negate ? -signs[i] : signs[i]) : 0;
+        }
+    }
+    std::vector<int> coefficientSigns;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].IsConstant() || nodes[i].IsVariable()) {
+            coefficientSigns.push_back(signs[i]);
+        }
+    }
+    return coefficientSigns;
+}
+
+// residual of the separable least squares problem (variable projection, Golub & Pereyra):
+// the tree is evaluated with the linear coefficients set to zero and the residual is projected
+// onto the orthogonal complement of the span of the linear basis functions. since the basis
+// functions of linear coefficients are the input columns themselves (or ones for constants),
+// the projection does not depend on the nonlinear parameters and can be precomputed. with row weights, the
+// residual is scaled by the square roots of the weights before the projection (the basis is weighted the same way)
+struct ProjectedResidualEvaluator {
+    using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
+
+    ProjectedResidualEvaluator(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, std::vector<gsl::index> nonlinearIndices, size_t coefficientCount, Matrix basis, std::vector<double> sqrtWeights = {})
+        : residualEvaluator(tree, dataset, targetValues, range)
+        , indices(std::move(nonlinearIndices))
+        , count(coefficientCount)
+        , q(std::move(basis))
+        , sw(std::move(sqrtWeights))
+    {
+    }
+
+    template <typename T>
+    bool operator()(T const* const* parameters, T* residuals) const
+    {
+        // scatter the nonlinear parameters into a full coefficient vector (linear coefficients are zero)
+        std::vector<T> coefficients(count, T(0));
+        for (size_t i = 0; i < indices.size(); ++i) {
+            coefficients[indices[i]] = parameters[0][i];
+        }
+        T const* p = coefficients.data();
+        residualEvaluator(&p, residuals);
+        for (size_t i = 0; i < sw.size(); ++i) {
+            residuals[i] *= sw[i];
+        }
+
+        // project out the components in span(Q) (modified Gram-Schmidt, q has orthonormal columns)
+        for (gsl::index j = 0; j < q.cols(); ++j) {
+            T dot(0);
+            for (gsl::index i = 0; i < q.rows(); ++i) {
+                dot += residuals[i] * q(i, j);
+            }
+            for (gsl::index i = 0; i < q.rows(); ++i) {
+                residuals[i] -= dot * q(i, j);
+            }
+        }
+        return true;
+    }
+
+private:
+    ResidualEvaluator residualEvaluator;
+    std::vector<gsl::index> indices;
+    size_t count;
+    Matrix q;
+    std::vector<double> sw; // square roots of the row weights (empty if unweighted)
+};
+
+// separable least squares: linear coefficients are eliminated from the problem and solved in closed form
+// (QR solve), while the Levenberg-Marquardt iterations only operate on the remaining nonlinear coefficients
+template <bool autodiff = true>
+ceres::Solver::Summary OptimizeVariableProjection(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const gsl::span<const Operon::Scalar> weights, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    using ceres::DynamicAutoDiffCostFunction;
+    using ceres::DynamicCostFunction;
+    using ceres::DynamicNumericDiffCostFunction;
+    using ceres::Problem;
+    using ceres::Solve;
+    using ceres::Solver;
+    using Matrix = ProjectedResidualEvaluator::Matrix;
+    using Vector = Eigen::Matrix<double, Eigen::Dynamic, 1>;
+    using ScalarVector = Eigen::Matrix<Operon::Scalar, Eigen::Dynamic, 1>;
+
+    Solver::Summary summary;
+    auto coef = tree.GetCoefficients();
+    if (coef.empty()) {
+        return summary;
+    }
+
+    auto signs = LinearCoefficientSigns(tree);
+    std::vector<gsl::index> linear;
+    std::vector<gsl::index> nonlinear;
+    for (size_t i = 0; i < signs.size(); ++i) {
+        (signs[i] == 0 ? nonlinear : linear).push_back(i);
+    }
+    if (linear.empty()) {
+        return Optimize<autodiff>(tree, dataset, targetValues, weights, range, iterations, writeCoefficients, report);
+    }
+
+    std::vector<double> sw(weights.size());
+    std::transform(weights.begin(), weights.end(), sw.begin(), [](auto w) { return std::sqrt(static_cast<double>(w)); });
+
+    // assemble the linear basis functions over the given range
+    auto const& nodes = tree.Nodes();
+    Matrix phi(range.Size(), linear.size());
+    for (size_t i = 0, j = 0, k = 0; i < nodes.size(); ++i) {
+        auto const& s = nodes[i];
+        if (!(s.IsConstant() || s.IsVariable())) {
+            continue;
+        }
+        if (signs[k++] == 0) {
+            continue;
+        }
+        if (s.IsConstant()) {
+            phi.col(j).setConstant(signs[k - 1]);
+        } else {
+            auto values = dataset.GetValues(s.HashValue).subspan(range.Start(), range.Size());
+            phi.col(j) = signs[k - 1] * Eigen::Map<const ScalarVector>(values.data(), values.size()).cast<double>();
+        }
+        ++j;
+    }
+    if (!sw.empty()) {
+        phi.array().colwise() *= Eigen::Map<const Eigen::Array<double, Eigen::Dynamic, 1>>(sw.data(), sw.size());
+    }
+    // rank-revealing QR, duplicated basis functions (eg. the same variable occurring twice in a sum) are common
+    Eigen::ColPivHouseholderQR<Matrix> qr(phi);
+    Matrix q = qr.householderQ() * Matrix::Identity(phi.rows(), qr.rank());
+
+    if (report) {
+        fmt::print("x_0: ");
+        for (auto c : coef)
+            fmt::print("{} ", c);
+        fmt::print("\n");
+        fmt::print("linear coefficients: {}, nonlinear coefficients: {}\n", linear.size(), nonlinear.size());
+    }
+
+    std::vector<double> theta;
+    for (auto i : nonlinear) {
+        theta.push_back(coef[i]);
+    }
+
+    if (!theta.empty()) {
+        auto eval = new ProjectedResidualEvaluator(tree, dataset, targetValues, range, nonlinear, coef.size(), q, sw);
+        DynamicCostFunction* costFunction;
+        if constexpr (autodiff) {
+            costFunction = new DynamicAutoDiffCostFunction<ProjectedResidualEvaluator>(eval);
+        } else {
+            costFunction = new DynamicNumericDiffCostFunction(eval);
+        }
+        costFunction->AddParameterBlock(theta.size());
+        costFunction->SetNumResiduals(range.Size());
+
+        Problem problem;
+        problem.AddResidualBlock(costFunction, nullptr, theta.data());
+
+        Solver::Options options;
+        options.max_num_iterations = iterations - 1; // workaround since for some reason ceres sometimes does 1 more iteration
+        options.linear_solver_type = ceres::DENSE_QR;
+        options.minimizer_progress_to_stdout = report;
+        options.num_threads = 1;
+        options.logging_type = ceres::LoggingType::SILENT;
+        Solve(options, &problem, &summary);
+    }
+
+    // solve for the linear coefficients given the optimized nonlinear ones
+    std::fill(coef.begin(), coef.end(), 0.0);
+    for (size_t i = 0; i < nonlinear.size(); ++i) {
+        coef[nonlinear[i]] = theta[i];
+    }
+    auto estimated = Evaluate<double>(tree, dataset, range, coef.data());
+    Vector rhs = Eigen::Map<const ScalarVector>(targetValues.data(), targetValues.size()).cast<double>() - Eigen::Map<const Vector>(estimated.data(), estimated.size());
+    if (!sw.empty()) {
+        rhs.array() *= Eigen::Map<const Eigen::Array<double, Eigen::Dynamic, 1>>(sw.data(), sw.size());
+    }
+    Vector beta = qr.solve(rhs);
+    for (size_t i = 0; i < linear.size(); ++i) {
+        coef[linear[i]] = beta(i);
+    }
+
+    if (report) {
+        fmt::print("{}\n", summary.BriefReport());
+        fmt::print("x_final: ");
+        for (auto c : coef)
+            fmt::print("{} ", c);
+        fmt::print("\n");
+    }
+    if (writeCoefficients) {
+        tree.SetCoefficients(coef);
+    }
+    return summary;
+}
+
+template <bool autodiff = true>
+ceres::Solver::Summary OptimizeVariableProjection(Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true, bool report = false)
+{
+    return OptimizeVariableProjection<autodiff>(tree, dataset, targetValues, gsl::span<const Operon::Scalar> {}, range, iterations, writeCoefficients, report);
+}
+
 // set up some convenience methods using perfect forwarding
 template <typename... Args>
 auto OptimizeAutodiff(Args&&... args)
@@ -0,0 +1,310 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC>
+ * Copyright (C) 2019 Bogdan Burlacu
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NNLS_BATCH_HPP
+#define NNLS_BATCH_HPP
+
+#include "core/eval.hpp"
+#include "core/problem.hpp"
+
+namespace Operon {
+struct BatchOptimizationSummary {
+    size_t Iterations = 0; // number of Levenberg-Marquardt steps attempted
+    size_t SuccessfulSteps = 0; // number of steps that decreased the cost
+    double InitialCost = 0; // half the sum of squared residuals
+    double FinalCost = 0;
+    bool Converged = false;
+};
+
+namespace detail {
+    // evaluates K coefficient sets of the same tree structure in lockstep (see EvaluateLanes).
+    // the Jacobian is obtained with a reverse sweep over the tree (see DifferentiateLanes) and accumulated directly into the normal equations so that it is never materialized in full
+    class BatchResidualEvaluator {
+    public:
+        using Array = Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor>;
+
+        BatchResidualEvaluator(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, gsl::index lanes)
+            : tree_ref(tree)
+            , dataset_ref(dataset)
+            , target_ref(targetValues)
+            , range(range)
+            , k(lanes)
+        {
+            auto const& nodes = tree.Nodes();
+            coefficientIndices.resize(nodes.size(), -1);
+            columnIndices.resize(nodes.size(), -1);
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                if (nodes[i].IsConstant() || nodes[i].IsVariable()) {
+                    coefficientIndices[i] = p++;
+                }
+                if (nodes[i].IsVariable()) {
+                    columnIndices[i] = dataset.GetIndex(nodes[i].HashValue);
+                }
+            }
+            values = Array::Zero(BATCHSIZE, nodes.size() * k);
+            adjoints = Array::Zero(BATCHSIZE, nodes.size() * k);
+            jacobian = Array::Zero(BATCHSIZE, p * k);
+        }
+
+        gsl::index NumParameters() const { return p; }
+
+        // computes the cost (half the sum of squared residuals) of each lane and, if requested, the normal equations
+        // for each lane: J^T J is stored column-wise as a P*P x K array and J^T r as a P x K array
+        void operator()(const Array& parameters, Array& cost, Array* jtj = nullptr, Array* jtr = nullptr)
+        {
+            auto const& nodes = tree_ref.get().Nodes();
+            auto n = static_cast<gsl::index>(nodes.size());
+
+            cost = Array::Zero(1, k);
+            bool derivatives = jtj != nullptr && jtr != nullptr;
+            if (derivatives) {
+                *jtj = Array::Zero(p * p, k);
+                *jtr = Array::Zero(p, k);
+            }
+
+            Eigen::Array<double, BATCHSIZE, 1> x;
+            Eigen::Array<double, BATCHSIZE, 1> y;
+            Array residual(BATCHSIZE, k);
+
+            gsl::index numRows = range.Size();
+            for (gsl::index row = 0; row < numRows; row += BATCHSIZE) {
+                auto remainingRows = std::min(BATCHSIZE, numRows - row);
+                if (remainingRows < BATCHSIZE) {
+                    x.setZero();
+                    y.setZero();
+                }
+
+                detail::EvaluateLanes<double>(nodes, dataset_ref.get(), columnIndices, parameters, range.Start() + row, remainingRows, values);
+
+                auto target = target_ref.subspan(row, remainingRows);
+                y.head(remainingRows) = Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>>(target.data(), target.size()).cast<double>();
+                residual = Block(values, n - 1) - y.replicate(1, k);
+                cost += 0.5 * residual.topRows(remainingRows).square().colwise().sum();
+
+                if (!derivatives) {
+                    continue;
+                }
+
+                Block(adjoints, n - 1).setOnes();
+                detail::DifferentiateLanes<double>(nodes, k, values, adjoints);
+                for (gsl::index i = 0; i < n; ++i) {
+                    if (nodes[i].IsConstant()) {
+                        jacobian.middleCols(coefficientIndices[i] * k, k) = Block(adjoints, i);
+                    } else if (nodes[i].IsVariable()) {
+                        dataset_ref.get().Load(columnIndices[i], range.Start() + row, remainingRows, x.data());
+                        jacobian.middleCols(coefficientIndices[i] * k, k) = Block(adjoints, i) * x.replicate(1, k);
+                    }
+                }
+
+                // accumulate the normal equations for every lane
+                for (gsl::index a = 0; a < p; ++a) {
+                    auto ja = jacobian.middleCols(a * k, k).topRows(remainingRows);
+                    jtr->row(a) += (ja * residual.topRows(remainingRows)).colwise().sum();
+                    for (gsl::index b = 0; b <= a; ++b) {
+                        auto jb = jacobian.middleCols(b * k, k).topRows(remainingRows);
+                        jtj->row(a * p + b) += (ja * jb).colwise().sum();
+                    }
+                }
+            }
+
+            if (derivatives) {
+                // mirror the lower triangle
+                for (gsl::index a = 0; a < p; ++a) {
+                    for (gsl::index b = 0; b < a; ++b) {
+                        jtj->row(b * p + a) = jtj->row(a * p + b);
+                    }
+                }
+            }
+        }
+
+    private:
+        Array::ColsBlockXpr Block(Array& buf, gsl::index i) const { return buf.middleCols(i * k, k); }
+
+        std::reference_wrapper<const Tree> tree_ref;
+        std::reference_wrapper<const Dataset> dataset_ref;
+        gsl::span<const Operon::Scalar> target_ref;
+        Range range;
+        gsl::index k; // number of lanes (coefficient sets)
+        gsl::index p = 0; // number of coefficients
+
+        std::vector<gsl::index> coefficientIndices;
+        std::vector<gsl::index> columnIndices;
+
+        Array values;
+        Array adjoints;
+        Array jacobian;
+    };
+}
+
+// optimizes the coefficients of structurally identical trees (same symbols and variables in the same
+// order, differing only in coefficient values) with a Levenberg-Marquardt solver that processes all
+// coefficient sets in a single vectorized pass over the data. per-tree statistics are returned in order.
+inline std::vector<BatchOptimizationSummary> OptimizeBatch(gsl::span<Tree* const> trees, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range, size_t iterations = 50, bool writeCoefficients = true)
+{
+    using Array = detail::BatchResidualEvaluator::Array;
+    using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>;
+    using Vector = Eigen::Matrix<double, Eigen::Dynamic, 1>;
+
+    constexpr double functionTolerance = 1e-6; // same defaults as ceres
+    constexpr double gradientTolerance = 1e-10;
+    constexpr double minDiagonal = 1e-6;
+    constexpr double maxDamping = 1e32;
+
+    gsl::index k = trees.size();
+    std::vector<BatchOptimizationSummary> summaries(k);
+    if (k == 0 || trees.front()->CoefficientsCount() == 0) {
+        return summaries;
+    }
+
+    detail::BatchResidualEvaluator evaluator(*trees.front(), dataset, targetValues, range, k);
+    auto p = evaluator.NumParameters();
+
+    Array x(p, k);
+    for (gsl::index i = 0; i < k; ++i) {
+        Expects(trees[i]->Length() == trees.front()->Length());
+        auto coef = trees[i]->GetCoefficients();
+        x.col(i) = Eigen::Map<const Array>(coef.data(), p, 1);
+    }
+
+    Array cost, jtj, jtr;
+    evaluator(x, cost, &jtj, &jtr);
+
+    std::vector<bool> active(k);
+    Array damping = Array::Constant(1, k, 1e-4); // inverse of the initial trust region radius used by ceres
+    Array factor = Array::Constant(1, k, 2.0);
+    for (gsl::index i = 0; i < k; ++i) {
+        summaries[i].InitialCost = cost(i);
+        active[i] = std::isfinite(cost(i));
+    }
+
+    Array candidate = x;
+    Array candidateCost, candidateJtJ, candidateJtr;
+    Matrix a(p, p);
+    Vector delta(p);
+
+    for (size_t it = 0; it < iterations && std::any_of(active.begin(), active.end(), [](bool v) { return v; }); ++it) {
+        for (gsl::index i = 0; i < k; ++i) {
+            candidate.col(i) = x.col(i);
+            if (!active[i]) {
+                continue;
+            }
+            ++summaries[i].Iterations;
+            a = Eigen::Map<const Matrix>(jtj.col(i).data(), p, p);
+            a.diagonal() += damping(i) * a.diagonal().cwiseMax(minDiagonal);
+            delta = a.ldlt().solve(-jtr.col(i).matrix());
+            if (delta.allFinite()) {
+                candidate.col(i) += delta.array();
+            }
+        }
+
+        evaluator(candidate, candidateCost, &candidateJtJ, &candidateJtr);
+
+        for (gsl::index i = 0; i < k; ++i) {
+            if (!active[i]) {
+                continue;
+            }
+            auto reduction = cost(i) - candidateCost(i);
+            if (std::isfinite(candidateCost(i)) && reduction > 0) {
+                x.col(i) = candidate.col(i);
+                jtj.col(i) = candidateJtJ.col(i);
+                jtr.col(i) = candidateJtr.col(i);
+                damping(i) = std::max(damping(i) / 3.0, 1e-16);
+                factor(i) = 2.0;
+                ++summaries[i].SuccessfulSteps;
+
+                auto converged = reduction <= functionTolerance * cost(i) || jtr.col(i).abs().maxCoeff() <= gradientTolerance;
+                cost(i) = candidateCost(i);
+                if (converged) {
+                    summaries[i].Converged = true;
+                    active[i] = false;
+                }
+            } else {
+                damping(i) *= factor(i);
+                factor(i) *= 2.0;
+                active[i] = damping(i) < maxDamping;
+            }
+        }
+    }
+
+    for (gsl::index i = 0; i < k; ++i) {
+        summaries[i].FinalCost = cost(i);
+        if (writeCoefficients) {
+            std::vector<double> coef(x.col(i).data(), x.col(i).data() + p);
+            trees[i]->SetCoefficients(coef);
+        }
+    }
+    return summaries;
+}
+
+// groups the individuals by structure (equal relaxed hash) and optimizes the coefficients of each group
+// with OptimizeBatch. the genotypes are sorted in place (relaxed mode) to bring them into canonical form,
+// so that the coefficients of structurally identical trees line up. statistics are returned per individual.
+template <typename T, typename ExecutionPolicy = std::execution::parallel_unsequenced_policy>
+std::vector<BatchOptimizationSummary> OptimizeGroups(gsl::span<T> individuals, const Problem& problem, size_t iterations = 50, size_t maxLanes = 32)
+{
+    ExecutionPolicy ep;
+    std::for_each(ep, individuals.begin(), individuals.end(), [](auto& ind) { ind.Genotype.Sort(Operon::HashMode::Relaxed); });
+
+    std::vector<gsl::index> indices(individuals.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::sort(indices.begin(), indices.end(), [&](auto a, auto b) { return individuals[a].Genotype.HashValue() < individuals[b].Genotype.HashValue(); });
+
+    auto sameStructure = [](const Tree& lhs, const Tree& rhs) {
+        return std::equal(lhs.Nodes().begin(), lhs.Nodes().end(), rhs.Nodes().begin(), rhs.Nodes().end(), [](const auto& a, const auto& b) {
+            return a.Type == b.Type && a.HashValue == b.HashValue;
+        });
+    };
+
+    // split runs of equal hash values into groups of identical structure (guards against hash collisions)
+    std::vector<std::vector<gsl::index>> groups;
+    for (auto it = indices.begin(); it != indices.end();) {
+        auto hash = individuals[*it].Genotype.HashValue();
+        auto end = std::find_if(it, indices.end(), [&](auto i) { return individuals[i].Genotype.HashValue() != hash; });
+        auto first = groups.size();
+        for (; it != end; ++it) {
+            auto const& tree = individuals[*it].Genotype;
+            auto g = std::find_if(groups.begin() + first, groups.end(), [&](const auto& group) {
+                return group.size() < maxLanes && sameStructure(individuals[group.front()].Genotype, tree);
+            });
+            if (g == groups.end()) {
+                groups.push_back({ *it });
+            } else {
+                g->push_back(*it);
+            }
+        }
+    }
+
+    auto const& dataset = problem.GetDataset();
+    auto range = problem.TrainingRange();
+    auto targetValues = problem.TargetValues().subspan(range.Start(), range.Size());
+
+    std::vector<BatchOptimizationSummary> summaries(individuals.size());
+    std::for_each(ep, groups.begin(), groups.end(), [&](const auto& group) {
+        std::vector<Tree*> trees(group.size());
+        std::transform(group.begin(), group.end(), trees.begin(), [&](auto i) { return &individuals[i].Genotype; });
+        auto result = OptimizeBatch(trees, dataset, targetValues, range, iterations);
+        for (size_t i = 0; i < group.size(); ++i) {
+            summaries[group[i]] = result[i];
+        }
+    });
+    return summaries;
+}
+}
+
+#endif
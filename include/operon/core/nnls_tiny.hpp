@@ -36,43 +36,20 @@ struct TinyCostFunction {
     EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
     TinyCostFunction(const Tree& tree, const Dataset& dataset, const gsl::span<const Operon::Scalar> targetValues, const Range range) 
-        : costFunction(new ResidualEvaluator(tree, dataset, targetValues, range))
+        : evaluator(tree, dataset, targetValues, range)
     {
-        int nParameters = tree.GetCoefficients().size();
-        int nResiduals = targetValues.size();
-        costFunction.AddParameterBlock(nParameters);
-        costFunction.SetNumResiduals(nResiduals);
-
-        jacobian_.resize(nResiduals, nParameters); 
     }
 
+    // TinySolver takes its Jacobian in column-major layout, which the evaluator writes directly
     bool operator()(const double* parameters, double* residuals, double* jacobian) const {
-        if (!jacobian) {
-            return costFunction.Evaluate(&parameters, residuals, nullptr);
-        }
-
-        double* jacobians[1] = { jacobian_.data() };
-        if (!costFunction.Evaluate(&parameters, residuals, jacobians)) {
-            return false;
-        }
-
-        // The Function object used by TinySolver takes its Jacobian in a
-        // column-major layout, and the CostFunction objects use row-major
-        // Jacobian matrices. So the following bit of code does the
-        // conversion from row-major Jacobians to column-major Jacobians.
-        Eigen::Map<Eigen::Matrix<double, NUM_RESIDUALS, NUM_PARAMETERS>>
-            col_major_jacobian(jacobian, NumResiduals(), NumParameters());
-        col_major_jacobian = jacobian_;
-
-        return true;
+        return evaluator(parameters, residuals, jacobian);
     }
 
-    int NumResiduals() const { return costFunction.num_residuals(); }
-    int NumParameters() const { return costFunction.parameter_block_sizes()[0]; }
+    int NumResiduals() const { return evaluator.NumResiduals(); }
+    int NumParameters() const { return evaluator.NumParameters(); }
 
     private:
-        ceres::DynamicAutoDiffCostFunction<ResidualEvaluator> costFunction;
-        mutable Eigen::Matrix<double, NUM_RESIDUALS, NUM_PARAMETERS, Eigen::RowMajor> jacobian_; // row-major
+        JacobianEvaluator<Eigen::ColMajor> evaluator;
 };
 }
 
@@ -21,10 +21,18 @@
 #define OPERATOR_HPP
 
 #include "gsl/gsl"
+#include <algorithm>
 #include <atomic>
+#include <cmath>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <random>
+#include <vector>
 
+#include "cache.hpp"
 #include "common.hpp"
+#include "compact.hpp"
 #include "dataset.hpp"
 #include "grammar.hpp"
 #include "problem.hpp"
@@ -65,17 +73,59 @@ struct OperatorBase {
     virtual ~OperatorBase() {}
 };
 
+// samples input variables, uniformly or proportionally to the given weights (eg. from variable screening,
+// see ScreenVariables). variables with zero weight are never sampled
+class VariableSampler {
+public:
+    VariableSampler(const gsl::span<const Variable> variables)
+        : variables_(variables)
+    {
+    }
+
+    void Weights(gsl::span<const Operon::Scalar> weights)
+    {
+        Expects(weights.empty() || weights.size() == variables_.size());
+        cumulative_.resize(weights.size());
+        std::partial_sum(weights.begin(), weights.end(), cumulative_.begin(), [](double a, double b) { return a + std::max(b, 0.0); });
+        if (!cumulative_.empty() && !(cumulative_.back() > 0)) {
+            cumulative_.clear(); // no positive weights, fall back to uniform sampling
+        }
+    }
+
+    bool IsWeighted() const { return !cumulative_.empty(); }
+
+    Operon::Hash operator()(Operon::Random& random) const
+    {
+        if (cumulative_.empty()) {
+            std::uniform_int_distribution<size_t> uniformInt(0, variables_.size() - 1);
+            return variables_[uniformInt(random)].Hash;
+        }
+        auto u = std::uniform_real_distribution<double>(0, cumulative_.back())(random);
+        auto i = std::upper_bound(cumulative_.begin(), cumulative_.end(), u) - cumulative_.begin();
+        return variables_[std::min(i, static_cast<gsl::index>(variables_.size()) - 1)].Hash;
+    }
+
+private:
+    gsl::span<const Variable> variables_;
+    std::vector<double> cumulative_;
+};
+
 // the creator builds a new tree using the existing grammar and allowed inputs
 struct CreatorBase : public OperatorBase<Tree, size_t, size_t> {
     public:
         CreatorBase(const Grammar& grammar, const gsl::span<const Variable> variables)
         : grammar_(grammar)
         , variables_(variables)
+        , sampler_(variables)
         { }
 
+        // the variables are sampled proportionally to these weights (one per variable), instead of uniformly
+        void VariableWeights(gsl::span<const Operon::Scalar> weights) { sampler_.Weights(weights); }
+
     protected:
         std::reference_wrapper<const Grammar> grammar_;
         const gsl::span<const Variable> variables_;
+        VariableSampler sampler_;
 };
 
 // crossover takes two parent trees and returns a child
@@ -84,6 +134,37 @@ struct CrossoverBase : public OperatorBase<Tree, const Tree&, const Tree&> {
 
 // the mutator can work in place or return a copy (child)
 struct MutatorBase : public OperatorBase<Tree, Tree> {
+    using OperatorBase<Tree, Tree>::operator();
+
+    // mutates the compact representation (see CompactTree). by default, the tree is expanded and compacted again
+    virtual CompactTree operator()(Operon::Random& random, CompactTree tree) const
+    {
+        return CompactTree((*this)(random, tree.ToTree()));
+    }
+
+    // mutates the nodes in place (eg. a slot of a PopulationArena). by default, a tree is built from the nodes
+    // and copied back, so the mutation must not change the length
+    virtual void operator()(Operon::Random& random, gsl::span<Node> nodes) const
+    {
+        auto tree = (*this)(random, Tree(std::vector<Node>(nodes.begin(), nodes.end())));
+        Expects(tree.Length() == nodes.size());
+        std::copy(tree.Nodes().begin(), tree.Nodes().end(), nodes.begin());
+    }
+
+    // keeps the mutated trees sorted and their hash values valid in the given mode, by updating only the path from
+    // the changed node to the root (see SortPath). the trees must be sorted in the same mode
+    void MaintainHashes(Operon::HashMode mode) { hashMode = mode; }
+
+protected:
+    // called by the mutations after node i changed
+    void UpdateHashes(gsl::span<Node> nodes, gsl::index i) const
+    {
+        if (hashMode) {
+            SortPath(nodes, i, *hashMode);
+        }
+    }
+
+    std::optional<Operon::HashMode> hashMode;
 };
 
 // the selector a vector of individuals and returns the index of a selected individual per each call of operator()
@@ -107,6 +188,34 @@ protected:
 
 template <typename T, gsl::index Idx>
 class ReinserterBase : public OperatorBase<void, std::vector<T>&, std::vector<T>&> {
+public:
+    // an offspring is not reinserted if an identical individual (same strict hash value) is already in the
+    // population, or was inserted before it
+    void RejectDuplicates(bool value) { rejectDuplicates = value; }
+    bool RejectDuplicates() const { return rejectDuplicates; }
+
+protected:
+    // returns the strict hash values of individuals whose genotypes are sorted already: the survivors in the
+    // population were sorted when they were reinserted (see SortedHashValues), and the initial population is
+    // sorted by the algorithm when duplicates are rejected
+    template <typename ExecutionPolicy>
+    static std::vector<Operon::Hash> HashValues(ExecutionPolicy&& ep, gsl::span<const T> individuals)
+    {
+        std::vector<Operon::Hash> hashes(individuals.size());
+        std::transform(ep, individuals.begin(), individuals.end(), hashes.begin(), [](const auto& ind) { return ind.Genotype.HashValue(); });
+        return hashes;
+    }
+
+    // sorts the offspring (which does not change their semantics) and returns their strict hash values
+    template <typename ExecutionPolicy>
+    static std::vector<Operon::Hash> SortedHashValues(ExecutionPolicy&& ep, gsl::span<T> individuals)
+    {
+        std::vector<Operon::Hash> hashes(individuals.size());
+        std::transform(ep, individuals.begin(), individuals.end(), hashes.begin(), [](auto& ind) { return ind.Genotype.Sort(Operon::HashMode::Strict).HashValue(); });
+        return hashes;
+    }
+
+    bool rejectDuplicates = false;
 };
 
 template <typename T>
@@ -122,15 +231,51 @@ public:
     {
     }
 
-    virtual void Prepare(const gsl::span<const T> pop) = 0;
+    virtual void Prepare(const gsl::span<const T> pop)
+    {
+        population = pop;
+        std::lock_guard<std::mutex> lock(unoptimizedMutex);
+        if (quantile >= 1.0 || unoptimized.empty()) {
+            return;
+        }
+        // the local optimization threshold is given by the quantile of the unoptimized fitness values scored since
+        // the last call (the offspring of the previous generation, or the initial population). the fitness of the
+        // population itself cannot be used, because it was obtained after local optimization
+        auto nth = unoptimized.begin() + static_cast<gsl::index>(quantile * (unoptimized.size() - 1));
+        std::nth_element(unoptimized.begin(), nth, unoptimized.end());
+        threshold = *nth;
+        best = *std::min_element(unoptimized.begin(), nth + 1);
+        reference = true;
+        unoptimized.clear();
+    }
+
+    // evaluators that make a single pass over the data for the whole population (eg. when the data is streamed
+    // from disk) only return a placeholder from operator() and assign the actual fitness values here, after
+    // the offspring have been generated
+    virtual bool IsBulk() const { return false; }
+    virtual void EvaluatePopulation(Operon::Random&, gsl::span<T>) const { }
 
     size_t TotalEvaluations() const { return fitnessEvaluations + localEvaluations; }
     size_t FitnessEvaluations() const { return fitnessEvaluations; }
     size_t LocalEvaluations() const { return localEvaluations; }
+    // local optimization iterations not spent due to scheduling (relative to the nominal iteration count)
+    size_t SavedLocalIterations() const { return savedIterations; }
 
     void LocalOptimizationIterations(size_t value) { iterations = value; }
     size_t LocalOptimizationIterations() const { return iterations; }
 
+    // only offspring whose unoptimized fitness falls within this quantile of the unoptimized fitness of the
+    // previous generation receive local optimization (1.0 means every offspring gets the full number of iterations)
+    void LocalOptimizationQuantile(double value) { quantile = std::clamp(value, 0.0, 1.0); }
+    double LocalOptimizationQuantile() const { return quantile; }
+
+    // solve linear coefficients in closed form during local optimization (variable projection)
+    void VariableProjection(bool value) { varpro = value; }
+    bool VariableProjection() const { return varpro; }
+
+    // counts evaluations that were not performed by the evaluator (eg. fitness cache hits) against the budget
+    void ChargeEvaluations(size_t count) const { fitnessEvaluations += count; }
+
     void Budget(size_t value) { budget = value; }
     size_t Budget() const { return budget; }
     bool BudgetExhausted() const { return TotalEvaluations() > Budget(); }
@@ -139,15 +284,55 @@ public:
     {
         fitnessEvaluations = 0;
         localEvaluations = 0;
+        savedIterations = 0;
+        std::lock_guard<std::mutex> lock(unoptimizedMutex);
+        unoptimized.clear();
+        reference = false;
     }
 
 protected:
+    // whether the individuals are scored without local optimization first (see ScheduleLocalIterations)
+    bool ScheduleLocalOptimization() const { return iterations > 0 && quantile < 1.0; }
+
+    // records the unoptimized fitness of an individual and returns the number of local optimization iterations
+    // allocated to it: zero above the threshold, otherwise proportional to the distance from the threshold
+    // relative to the best unoptimized fitness (lower fitness values are better). the individuals evaluated
+    // before the first reference is available (the initial population) receive the full number of iterations
+    size_t ScheduleLocalIterations(Operon::Scalar fitness) const
+    {
+        if (!ScheduleLocalOptimization()) {
+            return iterations;
+        }
+        {
+            std::lock_guard<std::mutex> lock(unoptimizedMutex);
+            unoptimized.push_back(fitness);
+            if (!reference) {
+                return iterations;
+            }
+        }
+        size_t allocated = 0;
+        if (fitness <= threshold) {
+            auto promise = threshold > best ? std::min(1.0, (threshold - fitness) / (threshold - best)) : 1.0;
+            allocated = std::max(size_t { 1 }, static_cast<size_t>(std::ceil(promise * iterations)));
+        }
+        savedIterations += iterations - allocated;
+        return allocated;
+    }
+
     gsl::span<const T> population;
     std::reference_wrapper<const Problem> problem;
     mutable std::atomic_ulong fitnessEvaluations = 0;
     mutable std::atomic_ulong localEvaluations = 0;
+    mutable std::atomic_ulong savedIterations = 0;
     size_t iterations = DefaultLocalOptimizationIterations;
     size_t budget = DefaultEvaluationBudget;
+    double quantile = 1.0;
+    Operon::Scalar threshold = Operon::Numeric::Max<Operon::Scalar>();
+    Operon::Scalar best = Operon::Numeric::Min<Operon::Scalar>();
+    bool reference = false; // whether threshold and best were computed
+    mutable std::vector<Operon::Scalar> unoptimized;
+    mutable std::mutex unoptimizedMutex;
+    bool varpro = false;
 };
 
 // TODO: Maybe remove all the template parameters and go for accepting references to operator bases
@@ -183,15 +368,48 @@ public:
         static_assert(std::is_same_v<T, U>);
         this->FemaleSelector().Prepare(pop);
         this->MaleSelector().Prepare(pop);
+        this->Evaluator().Prepare(pop);
     }
     virtual bool Terminate() const { return evaluator.get().BudgetExhausted(); }
 
+    // offspring identical to an individual evaluated before (same strict hash value) take its fitness and
+    // coefficients from the cache instead of being evaluated again. the cache is not used by bulk evaluators
+    void Cache(FitnessCache* value) { cache = value; }
+    FitnessCache* Cache() const { return cache; }
+
 protected:
+    // evaluates the child (or looks it up in the cache) and returns its fitness, where non-finite values are
+    // replaced by the worst possible fitness. the child is sorted when the cache is used, so that its hash value
+    // does not depend on the order of the arguments of commutative functions
+    Operon::Scalar Evaluate(Operon::Random& random, T& child) const
+    {
+        auto& eval = evaluator.get();
+        if (cache == nullptr || eval.IsBulk()) {
+            auto f = eval(random, child);
+            return std::isfinite(f) ? static_cast<Operon::Scalar>(f) : Operon::Numeric::Max<Operon::Scalar>();
+        }
+        auto& genotype = child.Genotype;
+        auto key = genotype.Sort(Operon::HashMode::Strict).HashValue();
+        // an entry with a different number of coefficients belongs to another tree (hash collision) and is ignored
+        if (auto entry = cache->Lookup(key, genotype.Length()); entry.has_value() && entry->Coefficients.size() == genotype.CoefficientsCount()) {
+            genotype.SetCoefficients(entry->Coefficients);
+            if (cache->ChargeHits()) {
+                eval.ChargeEvaluations(1);
+            }
+            return entry->Fitness;
+        }
+        auto f = eval(random, child);
+        auto fitness = std::isfinite(f) ? static_cast<Operon::Scalar>(f) : Operon::Numeric::Max<Operon::Scalar>();
+        cache->Insert(key, genotype.Length(), fitness, genotype.GetCoefficients());
+        return fitness;
+    }
+
     std::reference_wrapper<TEvaluator> evaluator;
     std::reference_wrapper<TCrossover> crossover;
     std::reference_wrapper<TMutator> mutator;
     std::reference_wrapper<TFemaleSelector> femaleSelector;
     std::reference_wrapper<TFemaleSelector> maleSelector;
+    FitnessCache* cache = nullptr;
 };
 
 template <typename T>
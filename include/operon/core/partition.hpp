@@ -0,0 +1,135 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "core/common.hpp"
+
+namespace Operon {
+// a partition of the rows of a dataset into disjoint parts (eg. cross-validation folds or a random train/test
+// split), given as lists of row indices. the index lists are built once and shared between copies, and they
+// are consumed through row views of the dataset (see Dataset::View and the Problem constructor), so that no
+// values are copied or shuffled
+class Partition {
+public:
+    explicit Partition(std::vector<std::vector<gsl::index>> indices)
+        : parts(std::make_shared<std::vector<std::vector<gsl::index>>>(std::move(indices)))
+    {
+    }
+
+    // k parts of (nearly) equal size, with the rows randomly assigned to parts
+    static Partition KFold(size_t rows, size_t k, Operon::Random& random)
+    {
+        Expects(k > 0 && k <= rows);
+        auto order = Permutation(rows, random);
+        std::vector<std::vector<gsl::index>> indices(k);
+        for (size_t i = 0; i < k; ++i) {
+            indices[i].assign(order.begin() + i * rows / k, order.begin() + (i + 1) * rows / k);
+        }
+        return Partition(Sorted(std::move(indices)));
+    }
+
+    // random split into parts whose sizes are proportional to the given fractions
+    static Partition Split(size_t rows, gsl::span<const double> fractions, Operon::Random& random)
+    {
+        Expects(!fractions.empty());
+        auto order = Permutation(rows, random);
+        auto total = std::reduce(fractions.begin(), fractions.end());
+        std::vector<std::vector<gsl::index>> indices(fractions.size());
+        double cumulative = 0;
+        size_t start = 0;
+        for (size_t i = 0; i < fractions.size(); ++i) {
+            cumulative += fractions[i];
+            size_t end = i + 1 == fractions.size() ? rows : static_cast<size_t>(std::round(cumulative / total * rows));
+            indices[i].assign(order.begin() + start, order.begin() + end);
+            start = end;
+        }
+        return Partition(Sorted(std::move(indices)));
+    }
+
+    size_t Count() const { return parts->size(); }
+    size_t Rows() const
+    {
+        return std::transform_reduce(parts->begin(), parts->end(), size_t { 0 }, std::plus {}, [](auto const& p) { return p.size(); });
+    }
+
+    gsl::span<const gsl::index> operator[](size_t i) const { return (*parts)[i]; }
+
+    // the rows of all the parts except the given one, followed by the rows of the given part. a row view with
+    // this order has the training rows of the fold in front and its test rows at the end
+    std::vector<gsl::index> Fold(size_t part) const
+    {
+        Expects(part < Count());
+        std::vector<gsl::index> order;
+        order.reserve(Rows());
+        for (size_t i = 0; i < Count(); ++i) {
+            if (i != part) {
+                order.insert(order.end(), (*parts)[i].begin(), (*parts)[i].end());
+            }
+        }
+        order.insert(order.end(), (*parts)[part].begin(), (*parts)[part].end());
+        return order;
+    }
+
+private:
+    std::shared_ptr<const std::vector<std::vector<gsl::index>>> parts;
+
+    static std::vector<gsl::index> Permutation(size_t rows, Operon::Random& random)
+    {
+        std::vector<gsl::index> order(rows);
+        std::iota(order.begin(), order.end(), 0);
+        std::shuffle(order.begin(), order.end(), random);
+        return order;
+    }
+
+    // rows within a part are kept in storage order, for locality when they are gathered
+    static std::vector<std::vector<gsl::index>> Sorted(std::vector<std::vector<gsl::index>> indices)
+    {
+        for (auto& p : indices) {
+            std::sort(p.begin(), p.end());
+        }
+        return indices;
+    }
+};
+
+// bootstrap sample of the rows given as multiplicities (the number of times each row was drawn), for use as
+// row weights (see Problem::SetWeights). a count above 255 is practically impossible for a sample of size
+// rows, but it is clamped anyway
+inline std::vector<uint8_t> Bootstrap(size_t rows, Operon::Random& random)
+{
+    std::vector<uint8_t> counts(rows, 0);
+    std::uniform_int_distribution<size_t> dist(0, rows - 1);
+    for (size_t i = 0; i < rows; ++i) {
+        auto& c = counts[dist(random)];
+        c = std::min(c + 1, std::numeric_limits<uint8_t>::max() + 0);
+    }
+    return counts;
+}
+}
+
+#endif
@@ -20,11 +20,13 @@
 #ifndef PROBLEM_HPP
 #define PROBLEM_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "dataset.hpp"
 #include "grammar.hpp"
+#include "partition.hpp"
 
 namespace Operon {
 struct Solution {
@@ -48,10 +50,21 @@ public:
         std::sort(inputVariables.begin(), inputVariables.end(), [](const auto& lhs, const auto& rhs) { return lhs.Hash < rhs.Hash; });
     }
 
+    // trains on all the parts of the partition except the given one, which is used as the test set. the problem
+    // works on a row view of the dataset where the training rows come first (see Partition::Fold), so the
+    // training and test ranges are contiguous and nothing is copied
+    Problem(const Dataset& ds, gsl::span<const Variable> allVariables, std::string targetVariable, const Partition& partition, size_t fold)
+        : Problem(ds.View(partition.Fold(fold)), allVariables, targetVariable, { 0, partition.Rows() - partition[fold].size() }, { partition.Rows() - partition[fold].size(), partition.Rows() })
+    {
+    }
+
     Range TrainingRange() const { return training; }
     Range TestRange() const { return test; }
     Range ValidationRange() const { return validation; }
 
+    // moves the training range, eg. as a sliding window over a dataset that grows (see Dataset::Append)
+    void TrainingRange(Range range) { training = range; }
+
     const std::string& TargetVariable() const { return target; }
     const Grammar& GetGrammar() const { return grammar; }
     Grammar& GetGrammar() { return grammar; }
@@ -63,6 +76,43 @@ public:
 
     Solution CreateSolution(const Tree&) const;
 
+    // optional row weights, one per row of the dataset (eg. for bootstrap replicates or bagging). integer
+    // counts are kept as bytes and converted on demand, so that many weighted problems can share one copy
+    // of the data with little overhead. the weights are shared between copies of the problem
+    void SetWeights(std::vector<Operon::Scalar> values)
+    {
+        Expects(values.size() == dataset.Rows());
+        weights = std::make_shared<const std::vector<Operon::Scalar>>(std::move(values));
+        counts.reset();
+    }
+
+    void SetWeights(std::vector<uint8_t> values)
+    {
+        Expects(values.size() == dataset.Rows());
+        counts = std::make_shared<const std::vector<uint8_t>>(std::move(values));
+        weights.reset();
+    }
+
+    void ResetWeights()
+    {
+        weights.reset();
+        counts.reset();
+    }
+
+    bool IsWeighted() const { return weights || counts; }
+
+    // the weights of the rows in the given range, or an empty vector if the problem is not weighted
+    std::vector<Operon::Scalar> Weights(Range range) const
+    {
+        std::vector<Operon::Scalar> values;
+        if (weights) {
+            values.assign(weights->begin() + range.Start(), weights->begin() + range.End());
+        } else if (counts) {
+            values.assign(counts->begin() + range.Start(), counts->begin() + range.End());
+        }
+        return values;
+    }
+
     void StandardizeData(Range range)
     {
         for (const auto& var : inputVariables) {
@@ -77,13 +127,15 @@ public:
     }
 
 private:
-    Dataset dataset;
+    Dataset dataset; // shares storage with the dataset it was created from (copy-on-write)
     Grammar grammar;
     Range training;
     Range test;
     Range validation;
     std::string target;
     std::vector<Variable> inputVariables;
+    std::shared_ptr<const std::vector<Operon::Scalar>> weights;
+    std::shared_ptr<const std::vector<uint8_t>> counts;
 };
 }
 
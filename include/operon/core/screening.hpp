@@ -0,0 +1,56 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef SCREENING_HPP
+#define SCREENING_HPP
+
+#include <vector>
+
+#include "core/problem.hpp"
+
+namespace Operon {
+struct ScreeningConfig {
+    size_t MaxVariables = 0; // keep at most this many variables (0 keeps all the relevant, non-redundant ones)
+    double Redundancy = 0.95; // drop a variable if its absolute correlation with a kept variable reaches this (1 disables the check)
+    size_t Rows = 100'000; // the statistics are computed on an evenly spaced sample of at most this many training rows
+    size_t Bins = 16; // bins per variable for the mutual information estimate (equal-frequency)
+};
+
+struct VariableScore {
+    Variable Var;
+    Operon::Scalar Correlation; // pearson's r with the target
+    Operon::Scalar MutualInformation; // histogram estimate with the target (nats, bias-corrected)
+    Operon::Scalar Score; // the larger of the mutual information and the one implied by the correlation
+    bool Selected;
+};
+
+// ranks the input variables of the problem by their relevance to the target on the training range and prunes
+// the constant and redundant ones. the variables are screened in parallel, each with one pass over the sampled
+// rows. the redundancy check compares each candidate (by decreasing score) with the variables kept so far on a
+// small subsample, so it is quadratic in the number of kept variables. returns one score per input variable,
+// in the order of Problem::InputVariables
+std::vector<VariableScore> ScreenVariables(const Problem& problem, ScreeningConfig config = {});
+
+// sampling weights for the creators and ChangeVariableMutation (see VariableWeights): proportional to the score
+// for the selected variables (with a small floor, so that each of them is still sampled occasionally) and zero
+// for the pruned ones
+std::vector<Operon::Scalar> ScreeningWeights(gsl::span<const VariableScore> scores);
+} // namespace Operon
+
+#endif
@@ -0,0 +1,36 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "common.hpp"
+#include "dataset.hpp"
+#include "tree.hpp"
+
+namespace Operon {
+// simplifies the tree algebraically (see Tree::Simplify), then removes its semantic introns on the given rows:
+// subtrees whose values do not vary are replaced by a constant, and operations whose values equal the values of
+// one of their operands are replaced by that operand (eg. x + c * y, when c * y is negligible). the values are
+// compared with the given relative tolerance. every subtree is evaluated, so a sample of the training rows is
+// usually enough
+Tree Simplify(Tree tree, const Dataset& dataset, Range range, Operon::Scalar tolerance = 1e-6);
+} // namespace Operon
+
+#endif
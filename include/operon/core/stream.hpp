@@ -0,0 +1,95 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "core/dataset.hpp"
+
+namespace Operon {
+// sequential access to a dataset file that does not fit in memory, in chunks of a fixed number of rows. the file
+// is read one chunk at a time (see Dataset::ReadRows) by a background thread, which reads ahead while the current
+// chunk is processed and continues with the next pass once the end of the file is reached. at most Depth() chunks
+// are in memory at any time (the chunk being processed, the one being read and the ones waiting in between), so
+// memory use is bounded by Depth() * ChunkRows() rows regardless of the size of the file
+class DatasetStream {
+public:
+    DatasetStream(std::string file, size_t chunkRows, size_t depth = 2, bool hasHeader = false);
+    ~DatasetStream();
+
+    DatasetStream(const DatasetStream&) = delete;
+    DatasetStream& operator=(const DatasetStream&) = delete;
+
+    // calls f(chunk, start) for every chunk in file order, where start is the index of the first row of the chunk.
+    // every call reads the whole file once. if reading fails or f throws, the exception is propagated and the
+    // next call starts a new pass from the beginning of the file
+    void ForEach(std::function<void(const Dataset&, size_t)> f);
+
+    // the first chunk of the file, which has the same variables (and hash values) as every other chunk
+    const Dataset& Sample() const { return sample; }
+
+    size_t Rows() const { return rows; }
+    size_t ChunkRows() const { return chunkRows; }
+    size_t Depth() const { return depth; }
+
+    // number of passes over the file completed by ForEach
+    size_t Passes() const { return passes; }
+
+    // the largest amount of memory held by chunks at any time, in bytes
+    size_t PeakBytes() const { return state->Peak; }
+
+private:
+    // shared with the reader thread and with the deleters of the chunks handed out
+    struct State {
+        std::mutex Mutex;
+        std::condition_variable Changed;
+        std::deque<std::shared_ptr<const Dataset>> Queue; // nullptr marks the end of a pass
+        std::exception_ptr Error;
+        size_t Live = 0; // number of chunks in memory
+        size_t Bytes = 0; // memory held by the chunks in memory
+        size_t Peak = 0;
+        bool Stop = false;
+    };
+
+    void Read();
+    void Stop();
+
+    std::string file;
+    size_t chunkRows;
+    size_t depth;
+    bool hasHeader;
+    size_t rows = 0;
+    size_t passes = 0;
+    Dataset sample;
+    std::shared_ptr<State> state;
+    std::thread reader;
+};
+} // namespace Operon
+
+#endif
@@ -21,7 +21,9 @@
 #define TREE_HPP
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <random>
 #include <vector>
@@ -97,6 +99,20 @@ namespace detail {
 }
 
 
+// updates the lengths, depths and parent indices of a sequence of nodes in postfix order (eg. a tree stored in a
+// PopulationArena), from the arities
+void UpdateNodes(gsl::span<Node> nodes);
+
+// sorts the children of commutative nodes and calculates the hash values (see Tree::Sort)
+void Sort(gsl::span<Node> nodes, Operon::HashMode mode);
+
+// sorts and hashes only the nodes on the path from node i to the root, after node i or its subtree
+// changed. the rest of the tree must already be sorted in the same mode (eg. the parents of a crossover or mutation)
+void SortPath(gsl::span<Node> nodes, gsl::index i, Operon::HashMode mode);
+
+// the nodes of a tree are shared between its copies (eg. the elite, selected individuals or offspring returned by
+// value), which makes copying a tree a pointer operation. they are copied when a tree accesses them through a
+// non-const method while they are shared (copy-on-write), so read-only code should use const trees
 class Tree {
 public:
     using ChildIterator = detail::ChildIteratorImpl<false>;
@@ -104,19 +120,19 @@ public:
 
     Tree() {}
     Tree(std::initializer_list<Node> list)
-        : nodes(list)
+        : storage(std::make_shared<std::vector<Node>>(list))
     {
     }
     Tree(std::vector<Node> vec)
-        : nodes(std::move(vec))
+        : storage(std::make_shared<std::vector<Node>>(std::move(vec)))
     {
     }
     Tree(const Tree& rhs)
-        : nodes(rhs.nodes)
+        : storage(rhs.storage)
     {
     }
     Tree(Tree&& rhs) noexcept
-        : nodes(std::move(rhs.nodes))
+        : storage(std::move(rhs.storage))
     {
     }
 
@@ -128,50 +144,75 @@ public:
 
     void swap(Tree& rhs) noexcept
     {
-        std::swap(nodes, rhs.nodes);
+        std::swap(storage, rhs.storage);
     }
 
     Tree& UpdateNodes();
     Tree& UpdateNodeDepth();
     Tree& Sort(Operon::HashMode);
+    Tree& Sort(gsl::index i, Operon::HashMode); // see SortPath
     Tree& Reduce();
     Tree& Simplify();
 
     std::vector<gsl::index> ChildIndices(gsl::index i) const;
     inline void SetEnabled(gsl::index i, bool enabled)
     {
+        auto& nodes = Nodes();
         for (int j = i - nodes[i].Length; j <= i; ++j) {
             nodes[j].IsEnabled = enabled;
         }
     }
 
-    std::vector<Node>& Nodes() { return nodes; }
-    const std::vector<Node>& Nodes() const { return nodes; }
+    std::vector<Node>& Nodes()
+    {
+        if (!storage) {
+            storage = std::make_shared<std::vector<Node>>();
+        } else if (storage.use_count() > 1) {
+            storage = std::make_shared<std::vector<Node>>(*storage);
+        } else {
+            // the other owners may have released the nodes concurrently, after reading them
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *storage;
+    }
+    const std::vector<Node>& Nodes() const { return storage ? *storage : EmptyNodes(); }
+
+    // whether the nodes are shared with other trees
+    bool IsShared() const noexcept { return storage && storage.use_count() > 1; }
+
     inline size_t CoefficientsCount() const
     {
+        const auto& nodes = Nodes();
         return std::count_if(nodes.begin(), nodes.end(), [](const Node& s) { return s.IsConstant() || s.IsVariable(); });
     }
 
     void SetCoefficients(const std::vector<double>& coefficients);
     std::vector<double> GetCoefficients() const;
 
-    inline Node& operator[](gsl::index i) noexcept { return nodes[i]; }
-    inline const Node& operator[](gsl::index i) const noexcept { return nodes[i]; }
+    // not noexcept: the nodes are copied (detached) first when they are shared
+    inline Node& operator[](gsl::index i) { return Nodes()[i]; }
+    inline const Node& operator[](gsl::index i) const noexcept { return Nodes()[i]; }
 
-    size_t Length() const noexcept { return nodes.size(); }
+    size_t Length() const noexcept { return Nodes().size(); }
     size_t VisitationLength() const noexcept;
     size_t Depth() const noexcept;
     size_t Depth(gsl::index) const noexcept;
     size_t Level(gsl::index) const noexcept;
-    bool Empty() const noexcept { return nodes.empty(); }
+    bool Empty() const noexcept { return Nodes().empty(); }
 
-    Operon::Hash HashValue() const { return nodes.empty() ? 0 : nodes.back().CalculatedHashValue; }
+    Operon::Hash HashValue() const { return Empty() ? 0 : Nodes().back().CalculatedHashValue; }
 
     ChildIterator Children(gsl::index i) { return ChildIterator(*this, i); }
     ConstChildIterator Children(gsl::index i) const { return ConstChildIterator(*this, i); }
 
 private:
-    std::vector<Node> nodes;
+    static const std::vector<Node>& EmptyNodes() noexcept
+    {
+        static const std::vector<Node> empty;
+        return empty;
+    }
+
+    std::shared_ptr<std::vector<Node>> storage;
 };
 }
 #endif // TREE_H
@@ -42,7 +42,6 @@ public:
         std::vector<Node> nodes;
         std::stack<std::tuple<Node, size_t, size_t>> stk;
 
-        std::uniform_int_distribution<size_t> uniformInt(0, variables_.size() - 1);
         std::normal_distribution<double> normalReal(0, 1);
 
         assert(targetLen > 0);
@@ -56,7 +55,7 @@ public:
 
         auto init = [&](Node& node) {
             if (node.IsVariable()) {
-                node.HashValue = node.CalculatedHashValue = variables_[uniformInt(random)].Hash;
+                node.HashValue = node.CalculatedHashValue = sampler_(random);
             }
             node.Value = normalReal(random);
         };
@@ -20,8 +20,10 @@
 #ifndef CROSSOVER_HPP
 #define CROSSOVER_HPP
 
+#include <optional>
 #include <vector>
 
+#include "core/arena.hpp"
 #include "core/operator.hpp"
 
 namespace Operon {
@@ -35,26 +37,48 @@ public:
     }
     auto operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs) const -> Tree override;
     std::pair<gsl::index, gsl::index> FindCompatibleSwapLocations(Operon::Random& random, const Tree& lhs, const Tree& rhs) const;
+    std::pair<gsl::index, gsl::index> FindCompatibleSwapLocations(Operon::Random& random, gsl::span<const Node> lhs, gsl::span<const Node> rhs) const;
+
+    // writes the child directly into the given slot of the next generation of the arena (see PopulationArena)
+    gsl::span<Node> operator()(Operon::Random& random, gsl::span<const Node> lhs, gsl::span<const Node> rhs, PopulationArena& arena, gsl::index slot) const;
+
+    // keeps the children sorted and their hash values valid in the given mode, by updating only the path from the
+    // swapped subtree to the root (see SortPath). the parents must be sorted in the same mode
+    void MaintainHashes(Operon::HashMode mode) { hashMode = mode; }
+
+    // same as above, working on the compact representation (see CompactTree::Cross)
+    CompactTree operator()(Operon::Random& random, const CompactTree& lhs, const CompactTree& rhs) const;
 
     static inline Tree Cross(const Tree& lhs, const Tree& rhs, gsl::index i, gsl::index j) 
     {
         auto& left = lhs.Nodes();
         auto& right = rhs.Nodes();
-        std::vector<Node> nodes;
-        nodes.reserve(right[j].Length - left[i].Length + left.size());
-        copy_n(left.begin(), i - left[i].Length, back_inserter(nodes));
-        copy_n(right.begin() + j - right[j].Length, right[j].Length + 1, back_inserter(nodes));
-        copy_n(left.begin() + i + 1, left.size() - (i + 1), back_inserter(nodes));
-
-        auto child = Tree(nodes).UpdateNodes();
-        return child;
+        std::vector<Node> nodes(left.size() - left[i].Length + right[j].Length);
+        Cross(left, right, i, j, nodes);
+        return Tree(std::move(nodes));
+    }
+
+    // writes the child into the given output, which must hold exactly its nodes
+    static inline void Cross(gsl::span<const Node> left, gsl::span<const Node> right, gsl::index i, gsl::index j, gsl::span<Node> child)
+    {
+        Expects(child.size() == left.size() - left[i].Length + right[j].Length);
+        auto it = std::copy_n(left.begin(), i - left[i].Length, child.begin());
+        it = std::copy_n(right.begin() + j - right[j].Length, right[j].Length + 1, it);
+        std::copy_n(left.begin() + i + 1, left.size() - (i + 1), it);
+        UpdateNodes(child);
     }
 
 private:
+    // index of the swapped subtree in the child
+    static gsl::index SwapIndex(gsl::span<const Node> lhs, gsl::span<const Node> rhs, gsl::index i, gsl::index j)
+    {
+        return i - lhs[i].Length + rhs[j].Length;
+    }
 
     double internalProbability;
     size_t maxDepth;
     size_t maxLength;
+    std::optional<Operon::HashMode> hashMode;
 };
 }
 #endif
@@ -20,11 +20,17 @@
 #ifndef EVALUATOR_HPP
 #define EVALUATOR_HPP
 
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "core/eval.hpp"
 #include "core/nnls.hpp"
 #include "core/nnls_tiny.hpp"
 #include "core/metrics.hpp"
 #include "core/operator.hpp"
+#include "core/stream.hpp"
 #include "stat/meanvariance.hpp"
 #include "stat/pearson.hpp"
 
@@ -47,27 +53,42 @@ public:
 
         auto trainingRange = problem.TrainingRange();
         auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(trainingRange.Start(), trainingRange.Size());
+        auto weights = problem.Weights(trainingRange); // empty if the problem is not weighted
+
+        auto iterations = this->iterations;
+        if (this->ScheduleLocalOptimization()) {
+            // score the offspring without local optimization first, then decide how many iterations it deserves
+            auto fit = Fitness(genotype, dataset, targetValues, weights, trainingRange);
+            iterations = this->ScheduleLocalIterations(fit);
+            if (iterations == 0) {
+                return fit;
+            }
+            ++this->fitnessEvaluations;
+        }
 
-        if (this->iterations > 0) {
-            auto summary = OptimizeAutodiff(genotype, dataset, targetValues, trainingRange, this->iterations);
+        if (iterations > 0) {
+            auto summary = this->varpro
+                ? OptimizeVariableProjection(genotype, dataset, targetValues, weights, trainingRange, iterations)
+                : OptimizeAutodiff(genotype, dataset, targetValues, weights, trainingRange, iterations);
             this->localEvaluations += summary.iterations.size();
         }
 
+        return Fitness(genotype, dataset, targetValues, weights, trainingRange);
+    }
+
+private:
+    static Operon::Scalar Fitness(const Tree& genotype, const Dataset& dataset, gsl::span<const Operon::Scalar> targetValues, gsl::span<const Operon::Scalar> weights, Range trainingRange)
+    {
         auto estimatedValues = Evaluate<Operon::Scalar>(genotype, dataset, trainingRange);
         // scale values
-        auto [a, b] = LinearScalingCalculator::Calculate(estimatedValues.begin(), estimatedValues.end(), targetValues.begin());
+        auto [a, b] = LinearScalingCalculator::Calculate(estimatedValues.begin(), estimatedValues.end(), targetValues.begin(), weights);
         std::transform(estimatedValues.begin(), estimatedValues.end(), estimatedValues.begin(), [a = a, b = b](Operon::Scalar v) { return b * v + a; });
-        auto nmse = NormalizedMeanSquaredError(estimatedValues, targetValues);
+        auto nmse = NormalizedMeanSquaredError(estimatedValues, targetValues, weights);
         if (!std::isfinite(nmse)) {
             nmse = Operon::Numeric::Max<Operon::Scalar>();
         }
         return nmse;
     }
-
-    void Prepare(const gsl::span<const T> pop)
-    {
-        this->population = pop;
-    }
 };
 
 template <typename T>
@@ -91,9 +112,23 @@ public:
 
         auto trainingRange = problem.TrainingRange();
         auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(trainingRange.Start(), trainingRange.Size());
+        auto weights = problem.Weights(trainingRange); // empty if the problem is not weighted
 
-        if (this->iterations > 0) {
-            auto summary = OptimizeAutodiff(genotype, dataset, targetValues, trainingRange, this->iterations);
+        auto iterations = this->iterations;
+        if (this->ScheduleLocalOptimization()) {
+            // score the offspring without local optimization first, then decide how many iterations it deserves
+            auto fit = Fitness(genotype, dataset, targetValues, weights, trainingRange);
+            iterations = this->ScheduleLocalIterations(fit);
+            if (iterations == 0) {
+                return fit;
+            }
+            ++this->fitnessEvaluations;
+        }
+
+        if (iterations > 0) {
+            auto summary = this->varpro
+                ? OptimizeVariableProjection(genotype, dataset, targetValues, weights, trainingRange, iterations)
+                : OptimizeAutodiff(genotype, dataset, targetValues, weights, trainingRange, iterations);
             this->localEvaluations += summary.iterations.size();
             //auto coeff = genotype.GetCoefficients();
             //Eigen::Matrix<double, Eigen::Dynamic, 1> param(coeff.size());
@@ -116,27 +151,276 @@ public:
             //this->localEvaluations += summary.iterations;
         }
 
+        return Fitness(genotype, dataset, targetValues, weights, trainingRange);
+    }
+
+private:
+    static Operon::Scalar Fitness(const Tree& genotype, const Dataset& dataset, gsl::span<const Operon::Scalar> targetValues, gsl::span<const Operon::Scalar> weights, Range trainingRange)
+    {
         auto estimatedValues = Evaluate<Operon::Scalar>(genotype, dataset, trainingRange);
 
         MeanVarianceCalculator mv;
-        mv.Add(estimatedValues);
+        if (weights.empty()) {
+            mv.Add(estimatedValues);
+        } else {
+            for (size_t i = 0; i < estimatedValues.size(); ++i) {
+                mv.Add(estimatedValues[i], weights[i]);
+            }
+        }
 
         auto variance = mv.NaiveVariance();
         
         double r2 = 0;
         if (variance > 1e-12) {
-            r2 = RSquared(estimatedValues, targetValues);
+            r2 = RSquared(estimatedValues, targetValues, weights);
             if (!std::isfinite(r2) || r2 > UpperBound || r2 < LowerBound) { 
                 r2 = 0; 
             }
         }
         return UpperBound - r2 + LowerBound;
     }
+};
+
+// evaluates the whole population with a single pass over a dataset streamed from disk (see DatasetStream), so the
+// data never has to fit in memory. every chunk is read once per generation and updates the correlation
+// accumulators of every individual, the fitness is then 1 - R2 as for the RSquaredEvaluator. the problem only
+// needs to hold a sample of the data (for the variables and the tree creators), its training range refers to the
+// rows of the stream. local optimization is not supported, as it would require the data in memory
+template <typename T>
+class StreamingEvaluator : public EvaluatorBase<T> {
+public:
+    static constexpr Operon::Scalar LowerBound = 0.0;
+    static constexpr Operon::Scalar UpperBound = 1.0;
+
+    StreamingEvaluator(Problem& problem, DatasetStream& s)
+        : EvaluatorBase<T>(problem)
+        , stream(s)
+    {
+    }
+
+    // the actual fitness is assigned by EvaluatePopulation
+    typename StreamingEvaluator::ReturnType
+    operator()(Operon::Random&, T&) const override
+    {
+        return Operon::Numeric::Max<Operon::Scalar>();
+    }
+
+    bool IsBulk() const override { return true; }
+
+    void EvaluatePopulation(Operon::Random&, gsl::span<T> individuals) const override
+    {
+        this->fitnessEvaluations += individuals.size();
+        auto calculators = Accumulate(individuals, this->problem.get().TrainingRange());
+        for (size_t i = 0; i < individuals.size(); ++i) {
+            auto r = calculators[i].Correlation();
+            auto r2 = r * r;
+            if (!std::isfinite(r2) || r2 > UpperBound || r2 < LowerBound || calculators[i].NaiveVarianceX() < 1e-12) {
+                r2 = 0;
+            }
+            individuals[i][0] = UpperBound - r2 + LowerBound;
+        }
+    }
 
-    void Prepare(const gsl::span<const T> pop)
+    // returns the accumulated correlation statistics (estimated values x, target values y) of each individual over
+    // the given range of rows, in a single pass over the stream
+    std::vector<PearsonsRCalculator> Accumulate(gsl::span<const T> individuals, Range range) const
     {
-        this->population = pop;
+        auto& problem = this->problem.get();
+        std::vector<PearsonsRCalculator> calculators(individuals.size());
+        std::vector<size_t> indices(individuals.size());
+        std::iota(indices.begin(), indices.end(), 0UL);
+
+        stream.get().ForEach([&](const Dataset& chunk, size_t start) {
+            auto lo = std::max(start, range.Start());
+            auto hi = std::min(start + chunk.Rows(), range.End());
+            if (lo >= hi) {
+                return;
+            }
+            Range rows { lo - start, hi - start };
+            auto targetValues = chunk.GetValues(problem.TargetVariable()).subspan(rows.Start(), rows.Size());
+            std::for_each(std::execution::par_unseq, indices.begin(), indices.end(), [&](size_t i) {
+                auto estimatedValues = Evaluate<Operon::Scalar>(individuals[i].Genotype, chunk, rows);
+                auto& calc = calculators[i];
+                for (size_t j = 0; j < estimatedValues.size(); ++j) {
+                    calc.Add(estimatedValues[j], targetValues[j]);
+                }
+            });
+        });
+        return calculators;
     }
+
+    const DatasetStream& Stream() const { return stream.get(); }
+
+private:
+    std::reference_wrapper<DatasetStream> stream;
+};
+
+// fitness is 1 - R2 over the training range like for the RSquaredEvaluator, for a training range that slides over a
+// growing dataset (online learning, see Dataset::Append and Problem::TrainingRange). the evaluator keeps the
+// correlation accumulators of the individuals of the current population (identified by their strict hash value),
+// so that when the window moves (Update) their fitness is updated from the rows entering and leaving the window,
+// instead of evaluating them on the whole window again. an accumulator is computed again on the whole window when
+// it is no longer finite or a saturated value leaves the window (neither can be removed), and every
+// RecomputeInterval updates, which bounds the accumulation of rounding errors
+template <typename T>
+class OnlineEvaluator : public EvaluatorBase<T> {
+public:
+    static constexpr Operon::Scalar LowerBound = 0.0;
+    static constexpr Operon::Scalar UpperBound = 1.0;
+    static constexpr size_t RecomputeInterval = 32;
+
+    OnlineEvaluator(Problem& problem)
+        : EvaluatorBase<T>(problem)
+    {
+    }
+
+    typename OnlineEvaluator::ReturnType
+    operator()(Operon::Random&, T& ind) const override
+    {
+        ++this->fitnessEvaluations;
+        auto& problem = this->problem.get();
+        auto& dataset = problem.GetDataset();
+        auto& genotype = ind.Genotype;
+
+        auto trainingRange = problem.TrainingRange();
+        auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(trainingRange.Start(), trainingRange.Size());
+
+        // the hash value identifies the individual when the window moves
+        genotype.Sort(Operon::HashMode::Strict);
+
+        auto iterations = this->iterations;
+        if (this->ScheduleLocalOptimization()) {
+            // score the offspring without local optimization first, then decide how many iterations it deserves
+            auto calc = Accumulate(genotype, trainingRange);
+            iterations = this->ScheduleLocalIterations(Fitness(calc));
+            if (iterations == 0) {
+                return Store(genotype.HashValue(), calc);
+            }
+            ++this->fitnessEvaluations;
+        }
+
+        if (iterations > 0) {
+            auto summary = this->varpro
+                ? OptimizeVariableProjection(genotype, dataset, targetValues, trainingRange, iterations)
+                : OptimizeAutodiff(genotype, dataset, targetValues, trainingRange, iterations);
+            this->localEvaluations += summary.iterations.size();
+            genotype.Sort(Operon::HashMode::Strict); // the coefficients changed
+        }
+
+        return Store(genotype.HashValue(), Accumulate(genotype, trainingRange));
+    }
+
+    // forgets the accumulators of the individuals that are no longer in the population
+    void Prepare(const gsl::span<const T> pop) override
+    {
+        EvaluatorBase<T>::Prepare(pop);
+        std::unordered_set<Operon::Hash> alive;
+        std::transform(pop.begin(), pop.end(), std::inserter(alive, alive.end()), [](auto const& ind) { return ind.Genotype.HashValue(); });
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = accumulators.begin(); it != accumulators.end();) {
+            it = alive.count(it->first) ? std::next(it) : accumulators.erase(it);
+        }
+    }
+
+    // updates the fitness of the individuals after the training range moved forward from previous to the current
+    // training range of the problem. individuals without an accumulator are evaluated on the whole range
+    void Update(gsl::span<T> individuals, Range previous) const
+    {
+        auto window = this->problem.get().TrainingRange();
+        Expects(window.Start() >= previous.Start() && window.End() >= previous.End());
+        bool overlap = window.Start() < previous.End();
+        Range entering { std::max(previous.End(), window.Start()), window.End() };
+        Range leaving { previous.Start(), std::min(previous.End(), window.Start()) };
+
+        // individuals with the same hash value share an accumulator, which must move with the window only once
+        std::unordered_map<Operon::Hash, size_t> first;
+        std::vector<size_t> unique;
+        for (size_t i = 0; i < individuals.size(); ++i) {
+            if (first.emplace(individuals[i].Genotype.HashValue(), i).second) {
+                unique.push_back(i);
+            }
+        }
+
+        std::for_each(std::execution::par, unique.begin(), unique.end(), [&](size_t i) {
+            auto& ind = individuals[i];
+            auto const& genotype = ind.Genotype;
+            std::optional<Accumulator> acc;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (auto it = accumulators.find(genotype.HashValue()); it != accumulators.end()) {
+                    acc = it->second;
+                }
+            }
+            if (acc && overlap && acc->Calc.IsFinite() && acc->Updates < RecomputeInterval
+                && Accumulate(genotype, leaving, acc->Calc, /* remove */ true)) {
+                Accumulate(genotype, entering, acc->Calc);
+                ind[0] = Store(genotype.HashValue(), acc->Calc, acc->Updates + 1);
+            } else {
+                ++this->fitnessEvaluations;
+                ind[0] = Store(genotype.HashValue(), Accumulate(genotype, window));
+            }
+        });
+
+        for (auto& ind : individuals) {
+            ind[0] = individuals[first[ind.Genotype.HashValue()]][0];
+        }
+    }
+
+private:
+    struct Accumulator {
+        PearsonsRCalculator Calc;
+        size_t Updates; // incremental updates since the accumulator was computed on the whole window
+    };
+
+    PearsonsRCalculator Accumulate(const Tree& genotype, Range range) const
+    {
+        PearsonsRCalculator calc;
+        Accumulate(genotype, range, calc);
+        return calc;
+    }
+
+    // adds (or removes) the estimated and target values of the given rows. returns false if one of the estimated
+    // values is saturated (non-finite values are evaluated as the largest scalar), which cannot be removed exactly
+    bool Accumulate(const Tree& genotype, Range range, PearsonsRCalculator& calc, bool remove = false) const
+    {
+        if (range.Size() == 0) {
+            return true;
+        }
+        auto& problem = this->problem.get();
+        auto& dataset = problem.GetDataset();
+        auto estimatedValues = Evaluate<Operon::Scalar>(genotype, dataset, range);
+        auto targetValues = dataset.GetValues(problem.TargetVariable()).subspan(range.Start(), range.Size());
+        bool exact = true;
+        for (size_t i = 0; i < estimatedValues.size(); ++i) {
+            exact &= std::abs(estimatedValues[i]) < Operon::Numeric::Max<Operon::Scalar>();
+            if (remove) {
+                calc.Remove(estimatedValues[i], targetValues[i]);
+            } else {
+                calc.Add(estimatedValues[i], targetValues[i]);
+            }
+        }
+        return exact;
+    }
+
+    Operon::Scalar Store(Operon::Hash hash, const PearsonsRCalculator& calc, size_t updates = 0) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        accumulators[hash] = Accumulator { calc, updates };
+        return Fitness(calc);
+    }
+
+    static Operon::Scalar Fitness(const PearsonsRCalculator& calc)
+    {
+        auto r = calc.Correlation();
+        auto r2 = r * r;
+        if (!std::isfinite(r2) || r2 > UpperBound || r2 < LowerBound || !(calc.NaiveVarianceX() > 1e-12)) {
+            r2 = 0;
+        }
+        return UpperBound - r2 + LowerBound;
+    }
+
+    mutable std::mutex mutex;
+    mutable std::unordered_map<Operon::Hash, Accumulator> accumulators;
 };
 }
 #endif
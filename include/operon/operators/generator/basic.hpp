@@ -61,10 +61,8 @@ public:
                 : this->mutator(random, population[first].Genotype);
         }
 
-        auto f = this->evaluator(random, child);
-        if (!std::isfinite(f)) { f = Operon::Numeric::Max<Operon::Scalar>(); }
-        child[Idx] = f;
-        return std::make_optional(child);
+        child[Idx] = this->Evaluate(random, child);
+        return std::make_optional(std::move(child));
     }
 };
 
@@ -63,9 +63,7 @@ public:
                     : this->mutator(random, population[first].Genotype);
             }
 
-            auto f = this->evaluator(random, child);
-            if (!std::isfinite(f)) { f = Operon::Numeric::Max<Operon::Scalar>(); }
-            child[Idx] = f;
+            child[Idx] = this->Evaluate(random, child);
             return child;
         };
 
@@ -78,7 +76,7 @@ public:
             }
         }
 
-        return std::make_optional(best);
+        return std::make_optional(std::move(best));
     }
 
     void BroodSize(size_t value) { broodSize = value; }
@@ -62,11 +62,11 @@ public:
                 : this->mutator(random, population[first].Genotype);
         }
 
-        auto f = this->evaluator(random, child);
+        auto f = this->Evaluate(random, child);
 
-        if (std::isfinite(f) && f < fit) {
-            child[Idx] = this->evaluator(random, child);
-            return std::make_optional(child);
+        if (f < fit) {
+            child[Idx] = f;
+            return std::make_optional(std::move(child));
         }
         return std::nullopt;
     }
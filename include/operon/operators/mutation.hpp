@@ -25,14 +25,20 @@
 namespace Operon {
 struct OnePointMutation : public MutatorBase {
     Tree operator()(Operon::Random&, Tree) const override;
+    CompactTree operator()(Operon::Random&, CompactTree) const override;
+    void operator()(Operon::Random&, gsl::span<Node>) const override;
 };
 
 struct MultiPointMutation : public MutatorBase {
     Tree operator()(Operon::Random&, Tree) const override;
+    CompactTree operator()(Operon::Random&, CompactTree) const override;
+    void operator()(Operon::Random&, gsl::span<Node>) const override;
 };
 
 struct MultiMutation : public MutatorBase {
     Tree operator()(Operon::Random&, Tree) const override;
+    CompactTree operator()(Operon::Random&, CompactTree) const override;
+    void operator()(Operon::Random&, gsl::span<Node>) const override;
 
     void Add(const MutatorBase& op, double prob)
     {
@@ -41,6 +47,8 @@ struct MultiMutation : public MutatorBase {
     }
 
 private:
+    const MutatorBase& Select(Operon::Random&) const;
+
     std::vector<std::reference_wrapper<const MutatorBase>> operators;
     std::vector<double> probabilities;
 };
@@ -48,13 +56,20 @@ private:
 struct ChangeVariableMutation : public MutatorBase {
     ChangeVariableMutation(const gsl::span<const Variable> vars)
         : variables(vars)
+        , sampler(vars)
     {
     }
 
     Tree operator()(Operon::Random&, Tree) const override;
+    CompactTree operator()(Operon::Random&, CompactTree) const override;
+    void operator()(Operon::Random&, gsl::span<Node>) const override;
+
+    // the new variable is sampled proportionally to these weights (one per variable), instead of uniformly
+    void VariableWeights(gsl::span<const Operon::Scalar> weights) { sampler.Weights(weights); }
 
 private:
     const gsl::span<const Variable> variables;
+    VariableSampler sampler;
 };
 
 struct ChangeFunctionMutation : public MutatorBase {
@@ -64,6 +79,8 @@ struct ChangeFunctionMutation : public MutatorBase {
     }
 
     Tree operator()(Operon::Random&, Tree) const override;
+    CompactTree operator()(Operon::Random&, CompactTree) const override;
+    void operator()(Operon::Random&, gsl::span<Node>) const override;
 
 private:
     Grammar grammar;
@@ -20,6 +20,8 @@
 #ifndef OPERON_REINSERTER_KEEP_BEST
 #define OPERON_REINSERTER_KEEP_BEST
 
+#include <unordered_set>
+
 #include "core/operator.hpp"
 
 namespace Operon {
@@ -34,11 +36,26 @@ class KeepBestReinserter : public ReinserterBase<T, Idx> {
             std::sort(ep, pop.begin(), pop.end(), comp);
             std::sort(ep, pool.begin(), pool.end(), comp);
 
-            for (size_t i = 0, j = 0; i < pool.size() && j < pop.size();) {
-                if (pop[j][Idx] > pool[i][Idx]) {
+            if (!this->RejectDuplicates()) {
+                for (size_t i = 0, j = 0; i < pool.size() && j < pop.size();) {
+                    if (pop[j][Idx] > pool[i][Idx]) {
+                        pop[j++] = std::move(pool[i]);
+                    }
+                    ++i;
+                }
+                return;
+            }
+
+            // the hash values of the individuals currently in the population
+            auto popHashes = this->HashValues(ep, gsl::span<const T>(pop));
+            auto poolHashes = this->SortedHashValues(ep, gsl::span<T>(pool));
+            std::unordered_multiset<Operon::Hash> present(popHashes.begin(), popHashes.end());
+            for (size_t i = 0, j = 0; i < pool.size() && j < pop.size(); ++i) {
+                if (pop[j][Idx] > pool[i][Idx] && present.count(poolHashes[i]) == 0) {
+                    present.erase(present.find(popHashes[j]));
+                    present.insert(poolHashes[i]);
                     pop[j++] = std::move(pool[i]);
                 }
-                ++i;
             }
         }
 };
@@ -20,6 +20,8 @@
 #ifndef OPERON_REINSERTER_REPLACE_WORST
 #define OPERON_REINSERTER_REPLACE_WORST
 
+#include <unordered_set>
+
 #include "core/operator.hpp"
 
 namespace Operon {
@@ -36,7 +38,22 @@ class ReplaceWorstReinserter : public ReinserterBase<T, Idx> {
                 std::sort(ep, pool.begin(), pool.end(), comp);
             }
             auto offset = std::min(pop.size(), pool.size());
-            std::copy_if(ep, std::make_move_iterator(pool.begin()), std::make_move_iterator(pool.begin() + offset), pop.begin() + pop.size() - offset, [](const auto& ind) { return !ind.Genotype.Empty(); });
+            if (!this->RejectDuplicates()) {
+                std::copy_if(ep, std::make_move_iterator(pool.begin()), std::make_move_iterator(pool.begin() + offset), pop.begin() + pop.size() - offset, [](const auto& ind) { return !ind.Genotype.Empty(); });
+                return;
+            }
+
+            // the worst individuals are replaced by the best offspring which are not already among the survivors
+            // (or the offspring inserted before them). the slots left over keep their individuals
+            auto survivors = pop.size() - offset;
+            auto popHashes = this->HashValues(ep, gsl::span<const T>(pop).first(survivors));
+            auto poolHashes = this->SortedHashValues(ep, gsl::span<T>(pool).first(offset));
+            std::unordered_set<Operon::Hash> present(popHashes.begin(), popHashes.end());
+            for (size_t i = 0, j = survivors; i < offset; ++i) {
+                if (!pool[i].Genotype.Empty() && present.insert(poolHashes[i]).second) {
+                    pop[j++] = std::move(pool[i]);
+                }
+            }
         }
 };
 } // namespace operon
@@ -49,6 +49,16 @@ namespace Operon {
                 //else beta = otCalculator.Covariance() / ovCalculator.Variance();
                 alpha = tCalculator.Mean() - beta * ovCalculator.Mean();
             }
+            void Add(Operon::Scalar original, Operon::Scalar target, Operon::Scalar weight)
+            {
+                tCalculator.Add(target, weight);
+                ovCalculator.Add(original, weight);
+                otCalculator.Add(original, target, weight);
+
+                auto variance = ovCalculator.Count() > 1 ? ovCalculator.SampleVariance() : 0;
+                beta = variance < std::numeric_limits<Operon::Scalar>::epsilon() ? 1 : (otCalculator.SampleCovariance() / variance);
+                alpha = tCalculator.Mean() - beta * ovCalculator.Mean();
+            }
             Operon::Scalar Beta() const { return beta; }
             Operon::Scalar Alpha() const { return alpha; }
 
@@ -63,6 +73,21 @@ namespace Operon {
                 return { calc.Alpha(), calc.Beta() };
             }
 
+            // weighted scaling (empty weights are the same as unit weights)
+            template <typename InputIt1, typename InputIt2, typename U = typename InputIt1::value_type>
+            static std::pair<double, double> Calculate(InputIt1 xBegin, InputIt1 xEnd, InputIt2 yBegin, gsl::span<const Operon::Scalar> weights)
+            {
+                static_assert(std::is_floating_point_v<U>);
+                if (weights.empty()) {
+                    return Calculate(xBegin, xEnd, yBegin);
+                }
+                LinearScalingCalculator calc;
+                for (auto w = weights.begin(); xBegin != xEnd; ++xBegin, ++yBegin, ++w) {
+                    calc.Add(*xBegin, *yBegin, *w);
+                }
+                return { calc.Alpha(), calc.Beta() };
+            }
+
         private:
             double alpha; // additive constant
             double beta; // multiplicative factor
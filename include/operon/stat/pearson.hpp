@@ -46,6 +46,23 @@ public:
 
     void Add(Operon::Scalar x, Operon::Scalar y, Operon::Scalar w);
 
+    // adds a block of values: the statistics of the block are computed in two vectorized passes (means, then
+    // centered sums) and merged into the running statistics
+    void Add(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y);
+
+    // merges the statistics of another calculator (eg. computed over a different block of rows)
+    void Add(const PearsonsRCalculator& other);
+
+    // removes a pair of values previously added with unit weight (eg. when a sliding window moves past it)
+    void Remove(Operon::Scalar x, Operon::Scalar y)
+    {
+        if (sumWe <= 1.) {
+            Reset();
+            return;
+        }
+        Add(x, y, -1);
+    }
+
     double Correlation() const
     {
         if (!(sumXX > 0. && sumYY > 0.)) {
@@ -54,6 +71,12 @@ public:
         return sumXY / std::sqrt(sumXX * sumYY);
     }
 
+    // false once a non-finite value was added (it cannot be removed again)
+    bool IsFinite() const
+    {
+        return std::isfinite(sumXX) && std::isfinite(sumXY) && std::isfinite(sumYY) && std::isfinite(sumX) && std::isfinite(sumY) && std::isfinite(sumWe);
+    }
+
     double Count() const { return sumWe; }
     double MeanX() const { return sumX / sumWe; }
     double MeanY() const { return sumY / sumWe; }
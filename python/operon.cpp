@@ -110,8 +110,17 @@ PYBIND11_MODULE(example, m) {
         .def("SampleRandomSymbol", &Operon::Grammar::SampleRandomSymbol)
         ;
 
+    py::enum_<Operon::Dataset::StorageType>(m, "StorageType")
+        .value("Float64", Operon::Dataset::StorageType::Float64)
+        .value("Float32", Operon::Dataset::StorageType::Float32)
+        .value("Float16", Operon::Dataset::StorageType::Float16)
+        .value("BFloat16", Operon::Dataset::StorageType::BFloat16)
+        .value("Int8", Operon::Dataset::StorageType::Int8)
+        .value("Int16", Operon::Dataset::StorageType::Int16);
+
     py::class_<Operon::Dataset>(m, "Dataset")
         .def(py::init<const std::string&, bool>())
+        .def(py::init<const std::string&>())
         .def(py::init<const Operon::Dataset&>())
         .def(py::init<const std::vector<Operon::Variable>&, const std::vector<std::vector<Operon::Scalar>>&>()) 
         .def("Rows", &Operon::Dataset::Rows)
@@ -128,5 +137,19 @@ PYBIND11_MODULE(example, m) {
         .def("Shuffle", &Operon::Dataset::Shuffle)
         .def("Normalize", &Operon::Dataset::Normalize)
         .def("Standardize", &Operon::Dataset::Standardize)
+        .def("Encode", py::overload_cast<gsl::index, Operon::Dataset::StorageType>(&Operon::Dataset::Encode))
+        .def("Encode", py::overload_cast<gsl::index, Operon::Dataset::StorageType, Operon::Scalar, Operon::Scalar>(&Operon::Dataset::Encode))
+        .def("GetStorageType", &Operon::Dataset::GetStorageType)
+        .def("StorageBytes", &Operon::Dataset::StorageBytes)
+        .def("Save", &Operon::Dataset::Save)
+        .def("Tile", &Operon::Dataset::Tile)
+        .def("IsTiled", &Operon::Dataset::IsTiled)
+        .def("AddLag", &Operon::Dataset::AddLag)
+        .def("AddLags", &Operon::Dataset::AddLags)
+        .def("MaxLag", &Operon::Dataset::MaxLag)
+        .def("IsLagged", &Operon::Dataset::IsLagged)
+        .def("Append", &Operon::Dataset::Append)
+        .def("Reserve", &Operon::Dataset::Reserve)
+        .def("Capacity", &Operon::Dataset::Capacity)
         ;
 }
@@ -0,0 +1,89 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <unordered_map>
+
+#include <cxxopts.hpp>
+#include <fmt/core.h>
+
+#include "core/dataset.hpp"
+
+using namespace Operon;
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options opts("operon_convert", "Convert csv or arrow files to the binary columnar dataset format");
+
+    opts.add_options()
+        ("input", "Input file name (csv or arrow/feather v2) (required)", cxxopts::value<std::string>())
+        ("output", "Output file name (required)", cxxopts::value<std::string>())
+        ("no-header", "The input file does not have a header row (columns are named X1, X2, ..., Y)")
+        ("type", "Storage type of the columns: float64, float32, float16, bfloat16, int16, int8 (integer types are quantized)", cxxopts::value<std::string>())
+        ("keep", "Comma-separated list of columns that keep full precision (eg. the target)", cxxopts::value<std::vector<std::string>>())
+        ("help", "Print help");
+
+    auto result = opts.parse(argc, argv);
+    if (result.arguments().empty() || result.count("help") > 0) {
+        fmt::print("{}\n", opts.help());
+        exit(EXIT_SUCCESS);
+    }
+    if (result.count("input") == 0 || result.count("output") == 0) {
+        fmt::print(stderr, "{}\n{}\n", "Error: both input and output must be specified.", opts.help());
+        exit(EXIT_FAILURE);
+    }
+
+    try {
+        auto input = result["input"].as<std::string>();
+        auto output = result["output"].as<std::string>();
+
+        auto t0 = std::chrono::steady_clock::now();
+        Dataset dataset(input, result.count("no-header") == 0);
+        if (result.count("type") > 0) {
+            using Type = Dataset::StorageType;
+            std::unordered_map<std::string, Type> types {
+                { "float64", Type::Float64 }, { "float32", Type::Float32 }, { "float16", Type::Float16 },
+                { "bfloat16", Type::BFloat16 }, { "int16", Type::Int16 }, { "int8", Type::Int8 }
+            };
+            auto it = types.find(result["type"].as<std::string>());
+            if (it == types.end()) {
+                throw std::runtime_error(fmt::format("Unknown storage type {}", result["type"].as<std::string>()));
+            }
+            auto keep = result.count("keep") > 0 ? result["keep"].as<std::vector<std::string>>() : std::vector<std::string> {};
+            for (const auto& v : dataset.Variables()) {
+                if (std::find(keep.begin(), keep.end(), v.Name) == keep.end()) {
+                    dataset.Encode(v.Index, it->second);
+                }
+            }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        dataset.Save(output);
+        auto t2 = std::chrono::steady_clock::now();
+
+        auto seconds = [](auto d) { return std::chrono::duration<double>(d).count(); };
+        auto megabytes = std::filesystem::file_size(input) / 1e6;
+        fmt::print("{} rows x {} columns, read in {:.3f}s ({:.1f} MB/s), written in {:.3f}s ({:.1f} MB of values)\n", dataset.Rows(), dataset.Cols(), seconds(t1 - t0), megabytes / seconds(t1 - t0), seconds(t2 - t1), dataset.StorageBytes() / 1e6);
+    } catch (std::exception& e) {
+        fmt::print(stderr, "{}\n", e.what());
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -18,6 +18,9 @@
  */
 
 #include <cstdlib>
+#include <execution>
+#include <limits>
+#include <numeric>
 
 #include <cxxopts.hpp>
 #include <fmt/core.h>
@@ -30,6 +33,10 @@
 #include "core/common.hpp"
 #include "core/format.hpp"
 #include "core/metrics.hpp"
+#include "core/partition.hpp"
+#include "core/screening.hpp"
+#include "core/simplify.hpp"
+#include "core/stream.hpp"
 #include "operators/initializer.hpp"
 #include "operators/creator.hpp"
 #include "operators/crossover.hpp"
@@ -40,6 +47,7 @@
 #include "operators/reinserter/keepbest.hpp"
 #include "operators/reinserter/replaceworst.hpp"
 #include "stat/linearscaler.hpp"
+#include "stat/meanvariance.hpp"
 
 #include "util.hpp"
 
@@ -50,11 +58,20 @@ int main(int argc, char* argv[])
     cxxopts::Options opts("operon_cli", "C++ large-scale genetic programming");
 
     opts.add_options()
-        ("dataset", "Dataset file name (csv) (required)", cxxopts::value<std::string>())
+        ("dataset", "Dataset file name (csv, binary (see operon-convert) or arrow/feather v2) (required)", cxxopts::value<std::string>())
         ("shuffle", "Shuffle the input data", cxxopts::value<bool>()->default_value("false"))
+        ("lags", "Add lags 1 to k of every column as input variables (time series), without copying any values. The first k rows, which have no lagged values, are excluded", cxxopts::value<size_t>()->default_value("0"))
         ("standardize", "Standardize the training partition (zero mean, unit variance)", cxxopts::value<bool>()->default_value("false"))
         ("train", "Training range specified as start:end (required)", cxxopts::value<std::string>())
         ("test", "Test range specified as start:end", cxxopts::value<std::string>())
+        ("folds", "Run k-fold cross-validation with the given number of folds, concurrently on the same dataset (the train and test ranges are ignored)", cxxopts::value<size_t>()->default_value("0"))
+        ("bootstrap", "Run the given number of bootstrap replicates of the training range concurrently on the same dataset (as row weights, ignored with --folds) and report the test R2 of the bagged ensemble", cxxopts::value<size_t>()->default_value("0"))
+        ("stream", "Stream the dataset from disk in chunks of the given number of rows instead of loading it into memory. The whole population is evaluated with one pass over the data per generation (no local optimization)", cxxopts::value<size_t>()->default_value("0"))
+        ("prefetch", "Number of chunks in memory when streaming (the chunk being evaluated and the ones read ahead)", cxxopts::value<size_t>()->default_value("2"))
+        ("online", "Online mode: after the run, keep reading new rows from the end of the dataset file in blocks of the given size (eg. as they are appended to it). The training range slides over the new rows, the population is updated incrementally and evolved for the given number of generations after each block", cxxopts::value<size_t>()->default_value("0"))
+        ("screen", "Screen the input variables before the run (correlation and mutual information with the target on the training range) and keep at most the given number of relevant, non-redundant ones. The tree creators and mutation sample the kept variables proportionally to their relevance", cxxopts::value<size_t>()->default_value("0"))
+        ("redundancy", "Variable screening drops a variable whose absolute correlation with a kept variable reaches this value", cxxopts::value<double>()->default_value("0.95"))
+        ("simplify", "Simplify the best model after the run (algebraic simplification and removal of the subtrees that do not change its values on the training data) and print it")
         ("target", "Name of the target variable (required)", cxxopts::value<std::string>())
         ("population-size", "Population size", cxxopts::value<size_t>()->default_value("1000"))
         ("pool-size", "Recombination pool size (how many generated offspring per generation)", cxxopts::value<size_t>()->default_value("1000"))
@@ -62,6 +79,11 @@ int main(int argc, char* argv[])
         ("generations", "Number of generations", cxxopts::value<size_t>()->default_value("1000"))
         ("evaluations", "Evaluation budget", cxxopts::value<size_t>()->default_value("1000000"))
         ("iterations", "Local optimization iterations", cxxopts::value<size_t>()->default_value("50"))
+        ("local-search-quantile", "Only offspring within this quantile of the unoptimized fitness of the previous generation receive local optimization", cxxopts::value<double>()->default_value("1.0"))
+        ("varpro", "Solve linear coefficients in closed form during local optimization (variable projection)")
+        ("cache", "Fitness cache capacity (number of entries). Offspring identical to an individual evaluated before take its fitness and coefficients instead of being evaluated again (0 disables the cache)", cxxopts::value<size_t>()->default_value("0"))
+        ("cache-free-hits", "Fitness cache hits do not count against the evaluation budget")
+        ("reject-duplicates", "Do not reinsert offspring identical to an individual already in the population")
         ("selection-pressure", "Selection pressure", cxxopts::value<size_t>()->default_value("100"))
         ("maxlength", "Maximum length", cxxopts::value<size_t>()->default_value("50"))
         ("maxdepth", "Maximum depth", cxxopts::value<size_t>()->default_value("10"))
@@ -114,7 +136,6 @@ int main(int argc, char* argv[])
             auto& value = kv.value();
             if (key == "dataset") {
                 fileName = value;
-                dataset.reset(new Dataset(fileName, true));
             }
             if (key == "seed") {
                 config.Seed = kv.as<size_t>();
@@ -163,7 +184,7 @@ int main(int argc, char* argv[])
             return 0;
         }
 
-        if (!dataset) {
+        if (fileName.empty()) {
             fmt::print(stderr, "{}\n{}\n", "Error: no dataset given.", opts.help());
             exit(EXIT_FAILURE);
         }
@@ -171,22 +192,86 @@ int main(int argc, char* argv[])
             fmt::print(stderr, "{}\n{}\n", "Error: no target variable given.", opts.help());
             exit(EXIT_FAILURE);
         }
+        ScreeningConfig screening;
+        screening.MaxVariables = result["screen"].as<size_t>();
+        screening.Redundancy = result["redundancy"].as<double>();
+        Dataset::Cursor cursor; // position of the rows that have not been read yet in online mode
+        auto online = result["online"].as<size_t>();
+        // when streaming, only one chunk of the data is kept by the problem (for the variables and the tree
+        // creators), the ranges refer to the rows of the file
+        std::unique_ptr<DatasetStream> stream;
+        if (auto chunkRows = result["stream"].as<size_t>(); chunkRows > 0) {
+            // these options need the whole data in memory
+            for (auto name : { "shuffle", "lags", "standardize", "folds", "bootstrap", "online", "screen" }) {
+                if (result.count(name) > 0) {
+                    fmt::print(stderr, "Error: --{} is not supported with --stream\n", name);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            // the other generators compare the offspring fitness to the parents before it is known
+            if (result.count("offspring-generator") > 0 && result["offspring-generator"].as<std::string>() != "basic") {
+                fmt::print(stderr, "Error: only the basic offspring generator is supported with --stream\n");
+                exit(EXIT_FAILURE);
+            }
+            stream.reset(new DatasetStream(fileName, chunkRows, result["prefetch"].as<size_t>(), true));
+            dataset.reset(new Dataset(stream->Sample()));
+        } else if (online > 0) {
+            // the rows after the training and test ranges are read later, as they arrive
+            for (auto name : { "shuffle", "standardize", "folds", "bootstrap" }) {
+                if (result.count(name) > 0) {
+                    fmt::print(stderr, "Error: --{} is not supported with --online\n", name);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if (result.count("train") == 0) {
+                fmt::print(stderr, "Error: --online requires a training range\n");
+                exit(EXIT_FAILURE);
+            }
+            dataset.reset(new Dataset(Dataset::ReadRows(fileName, cursor, std::max(trainingRange.End(), testRange.End()), true)));
+        } else {
+            dataset.reset(new Dataset(fileName, true));
+        }
+        // lagged variables are named <name>_lag<k> and are only offsets into the original columns
+        auto lags = static_cast<gsl::index>(result["lags"].as<size_t>());
+        if (lags > 0) {
+            if (lags >= static_cast<gsl::index>(dataset->Rows())) {
+                fmt::print(stderr, "The number of lags ({}) exceeds the available data range ({} rows)\n", lags, dataset->Rows());
+                exit(EXIT_FAILURE);
+            }
+            dataset->AddLags(lags);
+            if (result["shuffle"].as<bool>() || result["folds"].as<size_t>() > 0) {
+                // the rows are not kept in order, so the rows without lagged values are dropped through a row
+                // view (the ranges refer to the remaining rows)
+                std::vector<gsl::index> rows(dataset->Rows() - lags);
+                std::iota(rows.begin(), rows.end(), lags);
+                *dataset = dataset->View(rows);
+                lags = 0;
+            }
+        }
+        auto rows = stream ? stream->Rows() : dataset->Rows();
         if (result.count("train") == 0) {
-            trainingRange = { 0, 2 * dataset->Rows() / 3 }; // by default use 66% of the data as training
+            trainingRange = { 0, 2 * rows / 3 }; // by default use 66% of the data as training
         }
         if (result.count("test") == 0) {
             // if no test range is specified, we try to infer a reasonable range based on the trainingRange
             if (trainingRange.Start() > 0) {
                 testRange = { 0, trainingRange.Start() };
-            } else if (trainingRange.End() < dataset->Rows()) {
-                testRange = { trainingRange.End(), dataset->Rows() };
+            } else if (trainingRange.End() < rows) {
+                testRange = { trainingRange.End(), rows };
             } else {
                 testRange = { 0, 0 };
             }
         }
+        // the first rows have no lagged values
+        if (trainingRange.Start() < static_cast<size_t>(lags)) {
+            trainingRange = { static_cast<size_t>(lags), std::max(trainingRange.End(), static_cast<size_t>(lags)) };
+        }
+        if (testRange.Size() > 0 && testRange.Start() < static_cast<size_t>(lags)) {
+            testRange = { static_cast<size_t>(lags), std::max(testRange.End(), static_cast<size_t>(lags)) };
+        }
         // validate training range
-        if (trainingRange.Start() >= dataset->Rows() || trainingRange.End() > dataset->Rows()) {
-            fmt::print(stderr, "The training range {}:{} exceeds the available data range ({} rows)\n", trainingRange.Start(), trainingRange.End(), dataset->Rows());
+        if (trainingRange.Start() >= rows || trainingRange.End() > rows) {
+            fmt::print(stderr, "The training range {}:{} exceeds the available data range ({} rows)\n", trainingRange.Start(), trainingRange.End(), rows);
             exit(EXIT_FAILURE);
         }
 
@@ -195,219 +280,393 @@ int main(int argc, char* argv[])
             exit(EXIT_FAILURE);
         }
 
-        auto variables = dataset->Variables();
-        auto problem = Problem(*dataset, variables, target, trainingRange, testRange);
-        problem.GetGrammar().SetConfig(grammarConfig);
-
         const gsl::index idx { 0 };
         using Ind                = Individual<1>;
-        using Evaluator          = RSquaredEvaluator<Ind>;
+        using Evaluator          = EvaluatorBase<Ind>;
         using Selector           = SelectorBase<Ind, idx>;
         using Reinserter         = ReinserterBase<Ind, idx>;
         using OffspringGenerator = OffspringGeneratorBase<Evaluator, SubtreeCrossover, MultiMutation, Selector, Selector>;
 
-        std::unique_ptr<CreatorBase> creator;
+        tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
 
-        if (result.count("tree-creator") == 0) {
-            creator.reset(new BalancedTreeCreator(problem.GetGrammar(), problem.InputVariables(), 0.0));
-        } else {
-            auto value = result["tree-creator"].as<std::string>();
+        // runs the algorithm on the given problem and returns the (scaled) test predictions of the final best
+        // individual. every report line starts with the given prefix
+        auto run = [&](Problem& problem, Operon::Random& random, const std::string& prefix) {
+            problem.GetGrammar().SetConfig(grammarConfig);
 
-            if (value == "ptc2") {
-                creator.reset(new ProbabilisticTreeCreator(problem.GetGrammar(), problem.InputVariables()));
+            std::unique_ptr<CreatorBase> creator;
+
+            if (result.count("tree-creator") == 0) {
+                creator.reset(new BalancedTreeCreator(problem.GetGrammar(), problem.InputVariables(), 0.0));
             } else {
-                auto tokens = Split(value, ':');
-                double irregularityBias = 0.0;
-                if (tokens.size() > 1) {
-                    if (auto [val, ok] = ParseDouble(tokens[1]); ok) {
-                        irregularityBias = val;
-                    } else {
-                        fmt::print(stderr, "{}\n{}\n", "Error: could not parse BTC bias argument.", opts.help());
-                        exit(EXIT_FAILURE);
+                auto value = result["tree-creator"].as<std::string>();
+
+                if (value == "ptc2") {
+                    creator.reset(new ProbabilisticTreeCreator(problem.GetGrammar(), problem.InputVariables()));
+                } else {
+                    auto tokens = Split(value, ':');
+                    double irregularityBias = 0.0;
+                    if (tokens.size() > 1) {
+                        if (auto [val, ok] = ParseDouble(tokens[1]); ok) {
+                            irregularityBias = val;
+                        } else {
+                            fmt::print(stderr, "{}\n{}\n", "Error: could not parse BTC bias argument.", opts.help());
+                            exit(EXIT_FAILURE);
+                        }
                     }
+                    creator.reset(new BalancedTreeCreator(problem.GetGrammar(), problem.InputVariables(), irregularityBias));
                 }
-                creator.reset(new BalancedTreeCreator(problem.GetGrammar(), problem.InputVariables(), irregularityBias));
             }
-        }
 
-        std::uniform_int_distribution<size_t> sizeDistribution(1, maxLength);
-        //auto creator             = BalancedTreeCreator { problem.GetGrammar(), problem.InputVariables() };
-        auto initializer         = Initializer { *creator, sizeDistribution };
-        initializer.MaxDepth(maxDepth);
-        auto crossover           = SubtreeCrossover { 0.9, maxDepth, maxLength };
-        auto mutator             = MultiMutation {};
-        auto onePoint            = OnePointMutation {};
-        auto changeVar           = ChangeVariableMutation { problem.InputVariables() };
-        auto changeFunc          = ChangeFunctionMutation { problem.GetGrammar() };
-        mutator.Add(onePoint, 1.0);
-        mutator.Add(changeVar, 1.0);
-        mutator.Add(changeFunc, 1.0);
-
-        Evaluator evaluator(problem);
-        evaluator.LocalOptimizationIterations(config.Iterations);
-        evaluator.Budget(config.Evaluations);
-
-        Expects(problem.TrainingRange().Size() > 0);
-
-        auto parseSelector = [&](const std::string& name) -> Selector* {
-            if (result.count(name) == 0) {
+            std::uniform_int_distribution<size_t> sizeDistribution(1, maxLength);
+            //auto creator             = BalancedTreeCreator { problem.GetGrammar(), problem.InputVariables() };
+            auto initializer         = Initializer { *creator, sizeDistribution };
+            initializer.MaxDepth(maxDepth);
+            auto crossover           = SubtreeCrossover { 0.9, maxDepth, maxLength };
+            auto mutator             = MultiMutation {};
+            auto onePoint            = OnePointMutation {};
+            auto changeVar           = ChangeVariableMutation { problem.InputVariables() };
+            auto changeFunc          = ChangeFunctionMutation { problem.GetGrammar() };
+            mutator.Add(onePoint, 1.0);
+            mutator.Add(changeVar, 1.0);
+            mutator.Add(changeFunc, 1.0);
+
+            if (screening.MaxVariables > 0) {
+                auto start = std::chrono::high_resolution_clock::now();
+                auto scores = ScreenVariables(problem, screening);
+                auto weights = ScreeningWeights(scores);
+                creator->VariableWeights(weights);
+                changeVar.VariableWeights(weights);
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count() / 1000.0;
+                auto kept = std::count_if(scores.begin(), scores.end(), [](const auto& s) { return s.Selected; });
+                fmt::print("{}screening kept {} of {} variables in {:.2f}s\n", prefix, kept, scores.size(), elapsed);
+            }
+
+            std::unique_ptr<Evaluator> evaluator;
+            StreamingEvaluator<Ind>* streaming = nullptr;
+            OnlineEvaluator<Ind>* incremental = nullptr;
+            if (stream) {
+                streaming = new StreamingEvaluator<Ind>(problem, *stream);
+                evaluator.reset(streaming);
+            } else if (online > 0) {
+                incremental = new OnlineEvaluator<Ind>(problem);
+                evaluator.reset(incremental);
+            } else {
+                evaluator.reset(new RSquaredEvaluator<Ind>(problem));
+            }
+            evaluator->LocalOptimizationIterations(config.Iterations);
+            evaluator->LocalOptimizationQuantile(result["local-search-quantile"].as<double>());
+            evaluator->VariableProjection(result.count("varpro") > 0);
+            evaluator->Budget(config.Evaluations);
+
+            Expects(problem.TrainingRange().Size() > 0);
+
+            auto parseSelector = [&](const std::string& name) -> Selector* {
+                if (result.count(name) == 0) {
+                    return new TournamentSelector<Individual<1>, idx> { 5u };
+                } else {
+                    auto value = result[name].as<std::string>();
+                    auto tokens = Split(value, ':');
+                    if (tokens[0] == "tournament") {
+                        size_t tSize = 5;
+                        if (tokens.size() > 1) {
+                            if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), tSize); ec != std::errc()) {
+                                fmt::print(stderr, "{}\n{}\n", "Error: could not parse tournament size argument.", opts.help());
+                                exit(EXIT_FAILURE);
+                            }
+                        }
+                        return new TournamentSelector<Ind, 0> { tSize };
+                    } else if (tokens[0] == "proportional") {
+                        return new ProportionalSelector<Ind, 0> {};
+                    } else if (tokens[0] == "rank") {
+                        size_t tSize = 5;
+                        if (tokens.size() > 1) {
+                            if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), tSize); ec != std::errc()) {
+                                fmt::print(stderr, "{}\n{}\n", "Error: could not parse tournament size argument.", opts.help());
+                                exit(EXIT_FAILURE);
+                            }
+                        }
+                        return new RankTournamentSelector<Ind, 0> { tSize };
+                    } else if (tokens[0] == "random") {
+                        return new RandomSelector<Ind, 0> {};
+                    }
+                }
                 return new TournamentSelector<Individual<1>, idx> { 5u };
+            };
+
+            std::unique_ptr<Selector> femaleSelector;
+            std::unique_ptr<Selector> maleSelector;
+
+            femaleSelector.reset(parseSelector("female-selector"));
+            maleSelector.reset(parseSelector("male-selector"));
+
+            std::unique_ptr<OffspringGenerator> generator;
+            if (result.count("offspring-generator") == 0) {
+                generator.reset(new BasicOffspringGenerator(*evaluator, crossover, mutator, *femaleSelector, *maleSelector));
             } else {
-                auto value = result[name].as<std::string>();
+                auto value = result["offspring-generator"].as<std::string>();
                 auto tokens = Split(value, ':');
-                if (tokens[0] == "tournament") {
-                    size_t tSize = 5;
+                if (tokens[0] == "basic") {
+                    generator.reset(new BasicOffspringGenerator(*evaluator, crossover, mutator, *femaleSelector, *maleSelector));
+                } else if (tokens[0] == "brood") {
+                    size_t broodSize = 10;
                     if (tokens.size() > 1) {
-                        if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), tSize); ec != std::errc()) {
-                            fmt::print(stderr, "{}\n{}\n", "Error: could not parse tournament size argument.", opts.help());
+                        if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), broodSize); ec != std::errc()) {
+                            fmt::print(stderr, "{}\n{}\n", "Error: could not parse brood size argument.", opts.help());
                             exit(EXIT_FAILURE);
                         }
                     }
-                    return new TournamentSelector<Ind, 0> { tSize };
-                } else if (tokens[0] == "proportional") {
-                    return new ProportionalSelector<Ind, 0> {};
-                } else if (tokens[0] == "rank") {
-                    size_t tSize = 5;
+                    auto ptr = new BroodOffspringGenerator(*evaluator, crossover, mutator, *femaleSelector, *maleSelector);
+                    ptr->BroodSize(broodSize);
+                    generator.reset(ptr);
+                } else if (tokens[0] == "os") {
+                    size_t selectionPressure = 100;
                     if (tokens.size() > 1) {
-                        if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), tSize); ec != std::errc()) {
-                            fmt::print(stderr, "{}\n{}\n", "Error: could not parse tournament size argument.", opts.help());
+                        if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), selectionPressure); ec != std::errc()) {
+                            fmt::print(stderr, "{}\n{}\n", "Error: could not parse brood size argument.", opts.help());
                             exit(EXIT_FAILURE);
                         }
                     }
-                    return new RankTournamentSelector<Ind, 0> { tSize };
-                } else if (tokens[0] == "random") {
-                    return new RandomSelector<Ind, 0> {};
+                    auto ptr = new OffspringSelectionGenerator(*evaluator, crossover, mutator, *femaleSelector, *maleSelector);
+                    ptr->MaxSelectionPressure(selectionPressure);
+                    generator.reset(ptr);
                 }
             }
-            return new TournamentSelector<Individual<1>, idx> { 5u };
-        };
-
-        std::unique_ptr<Selector> femaleSelector;
-        std::unique_ptr<Selector> maleSelector;
-
-        femaleSelector.reset(parseSelector("female-selector"));
-        maleSelector.reset(parseSelector("male-selector"));
-
-        std::unique_ptr<OffspringGenerator> generator;
-        if (result.count("offspring-generator") == 0) {
-            generator.reset(new BasicOffspringGenerator(evaluator, crossover, mutator, *femaleSelector, *maleSelector));
-        } else {
-            auto value = result["offspring-generator"].as<std::string>();
-            auto tokens = Split(value, ':');
-            if (tokens[0] == "basic") {
-                generator.reset(new BasicOffspringGenerator(evaluator, crossover, mutator, *femaleSelector, *maleSelector));
-            } else if (tokens[0] == "brood") {
-                size_t broodSize = 10;
-                if (tokens.size() > 1) {
-                    if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), broodSize); ec != std::errc()) {
-                        fmt::print(stderr, "{}\n{}\n", "Error: could not parse brood size argument.", opts.help());
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                auto ptr = new BroodOffspringGenerator(evaluator, crossover, mutator, *femaleSelector, *maleSelector);
-                ptr->BroodSize(broodSize);
-                generator.reset(ptr);
-            } else if (tokens[0] == "os") {
-                size_t selectionPressure = 100;
-                if (tokens.size() > 1) {
-                    if (auto [p, ec] = std::from_chars(tokens[1].data(), tokens[1].data() + tokens[1].size(), selectionPressure); ec != std::errc()) {
-                        fmt::print(stderr, "{}\n{}\n", "Error: could not parse brood size argument.", opts.help());
-                        exit(EXIT_FAILURE);
-                    }
-                }
-                auto ptr = new OffspringSelectionGenerator(evaluator, crossover, mutator, *femaleSelector, *maleSelector);
-                ptr->MaxSelectionPressure(selectionPressure);
-                generator.reset(ptr);
+            std::unique_ptr<FitnessCache> cache;
+            if (auto capacity = result["cache"].as<size_t>(); capacity > 0) {
+                cache.reset(new FitnessCache(capacity));
+                cache->ChargeHits(result.count("cache-free-hits") == 0);
+                generator->Cache(cache.get());
             }
-        }
-        std::unique_ptr<Reinserter> reinserter;
-        if (result.count("reinserter") == 0) {
-            reinserter.reset(new ReplaceWorstReinserter<Ind, idx>());
-        } else {
-            auto value = result["reinserter"].as<std::string>();
-            if (value == "keep-best") {
-                reinserter.reset(new KeepBestReinserter<Ind, idx>());
-            } else if (value == "replace-worst") {
+
+            std::unique_ptr<Reinserter> reinserter;
+            if (result.count("reinserter") == 0) {
                 reinserter.reset(new ReplaceWorstReinserter<Ind, idx>());
+            } else {
+                auto value = result["reinserter"].as<std::string>();
+                if (value == "keep-best") {
+                    reinserter.reset(new KeepBestReinserter<Ind, idx>());
+                } else if (value == "replace-worst") {
+                    reinserter.reset(new ReplaceWorstReinserter<Ind, idx>());
+                }
             }
-        }
-
-        Operon::Random random(config.Seed);
-        if (result["shuffle"].as<bool>()) 
-        {
-            problem.GetDataset().Shuffle(random);
-        }
-        if (result["standardize"].as<bool>())
-        {
-            problem.StandardizeData(problem.TrainingRange());
-        }
-
-        tbb::global_control c(tbb::global_control::max_allowed_parallelism, threads);
-
-        auto t0 = std::chrono::high_resolution_clock::now();
-
-        GeneticProgrammingAlgorithm gp { problem, config, initializer, *generator, *reinserter };
-
-        auto targetValues = problem.TargetValues();
-        auto trainingRange = problem.TrainingRange();
-        auto testRange = problem.TestRange();
-        auto targetTrain = targetValues.subspan(trainingRange.Start(), trainingRange.Size());
-        auto targetTest = targetValues.subspan(testRange.Start(), testRange.Size());
-
-        // some boilerplate for reporting results
-        auto getBest = [&](const gsl::span<const Ind> pop) -> Ind {
-            auto [minElem, maxElem] = std::minmax_element(pop.begin(), pop.end(), [&](const auto& lhs, const auto& rhs) { return lhs.Fitness[idx] < rhs.Fitness[idx]; });
-            return *minElem;
-        };
 
-        Ind best;
+            reinserter->RejectDuplicates(result.count("reject-duplicates") > 0);
 
-        auto report = [&]() {
-            auto pop = gp.Parents();
-            best = getBest(pop);
-
-            //fmt::print("best: {}\n", InfixFormatter::Format(best.Genotype, *dataset));
-
-            auto estimatedTrain = Evaluate<Operon::Scalar>(best.Genotype, problem.GetDataset(), trainingRange);
-            auto estimatedTest = Evaluate<Operon::Scalar>(best.Genotype, problem.GetDataset(), testRange);
-
-            // scale values
-            auto [a, b] = LinearScalingCalculator::Calculate(estimatedTrain.begin(), estimatedTrain.end(), targetTrain.begin());
-            std::transform(estimatedTrain.begin(), estimatedTrain.end(), estimatedTrain.begin(), [a = a, b = b](Operon::Scalar v) { return b * v + a; });
-            std::transform(estimatedTest.begin(), estimatedTest.end(), estimatedTest.begin(), [a = a, b = b](Operon::Scalar v) { return b * v + a; });
-
-            auto r2Train = RSquared(estimatedTrain, targetTrain);
-            auto r2Test = RSquared(estimatedTest, targetTest);
+            if (result["standardize"].as<bool>())
+            {
+                problem.StandardizeData(problem.TrainingRange());
+            }
 
-            auto nmseTrain = NormalizedMeanSquaredError(estimatedTrain, targetTrain);
-            auto nmseTest = NormalizedMeanSquaredError(estimatedTest, targetTest);
+            auto t0 = std::chrono::high_resolution_clock::now();
+
+            GeneticProgrammingAlgorithm gp { problem, config, initializer, *generator, *reinserter };
+
+            // some boilerplate for reporting results
+            auto getBest = [&](const gsl::span<const Ind> pop) -> Ind {
+                auto [minElem, maxElem] = std::minmax_element(pop.begin(), pop.end(), [&](const auto& lhs, const auto& rhs) { return lhs.Fitness[idx] < rhs.Fitness[idx]; });
+                return *minElem;
+            };
+
+            Ind best;
+            Operon::Vector<Operon::Scalar> estimatedTestLast;
+
+            auto report = [&]() {
+                auto pop = gp.Parents();
+                best = getBest(pop);
+
+                // the data and the training range change in online mode
+                auto targetValues = problem.TargetValues();
+                auto trainingRange = problem.TrainingRange();
+                auto testRange = problem.TestRange();
+                // when streaming, the problem only holds a sample of the data
+                auto targetTrain = stream ? targetValues.first(0) : targetValues.subspan(trainingRange.Start(), trainingRange.Size());
+                auto targetTest = stream ? targetValues.first(0) : targetValues.subspan(testRange.Start(), testRange.Size());
+                auto weightsTrain = problem.Weights(trainingRange); // training metrics are weighted like the fitness
+
+                //fmt::print("best: {}\n", InfixFormatter::Format(best.Genotype, *dataset));
+
+                auto nan = std::numeric_limits<Operon::Scalar>::quiet_NaN();
+                Operon::Scalar r2Train, r2Test, nmseTrain, nmseTest, rmseTrain, rmseTest;
+                if (streaming) {
+                    // the training R2 is given by the fitness (R2 is invariant to the linear scaling, so is the
+                    // NMSE of the scaled values which equals 1 - R2). the test metrics are computed after the run,
+                    // as they need another pass over the data
+                    r2Train = 1 - best[idx];
+                    nmseTrain = best[idx];
+                    r2Test = nmseTest = rmseTrain = rmseTest = nan;
+                } else {
+                    auto estimatedTrain = Evaluate<Operon::Scalar>(best.Genotype, problem.GetDataset(), trainingRange);
+                    auto estimatedTest = Evaluate<Operon::Scalar>(best.Genotype, problem.GetDataset(), testRange);
+
+                    // scale values
+                    auto [a, b] = LinearScalingCalculator::Calculate(estimatedTrain.begin(), estimatedTrain.end(), targetTrain.begin(), weightsTrain);
+                    std::transform(estimatedTrain.begin(), estimatedTrain.end(), estimatedTrain.begin(), [a = a, b = b](Operon::Scalar v) { return b * v + a; });
+                    std::transform(estimatedTest.begin(), estimatedTest.end(), estimatedTest.begin(), [a = a, b = b](Operon::Scalar v) { return b * v + a; });
+
+                    r2Train = RSquared(estimatedTrain, targetTrain, weightsTrain);
+                    r2Test = RSquared(estimatedTest, targetTest);
+
+                    nmseTrain = NormalizedMeanSquaredError(estimatedTrain, targetTrain, weightsTrain);
+                    nmseTest = NormalizedMeanSquaredError(estimatedTest, targetTest);
+
+                    rmseTrain = RootMeanSquaredError(estimatedTrain, targetTrain, weightsTrain);
+                    rmseTest = RootMeanSquaredError(estimatedTest, targetTest);
+                    estimatedTestLast = std::move(estimatedTest);
+                }
 
-            auto rmseTrain = RootMeanSquaredError(estimatedTrain, targetTrain);
-            auto rmseTest = RootMeanSquaredError(estimatedTest, targetTest);
+                auto avgLength = std::transform_reduce(std::execution::par_unseq, pop.begin(), pop.end(), 0.0, std::plus<> {}, [](const auto& ind) { return ind.Genotype.Length(); }) / pop.size();
+                auto avgQuality = std::transform_reduce(std::execution::par_unseq, pop.begin(), pop.end(), 0.0, std::plus<> {}, [=](const auto& ind) { return ind[idx]; }) / pop.size();
 
-            auto avgLength = std::transform_reduce(std::execution::par_unseq, pop.begin(), pop.end(), 0.0, std::plus<> {}, [](const auto& ind) { return ind.Genotype.Length(); }) / pop.size();
-            auto avgQuality = std::transform_reduce(std::execution::par_unseq, pop.begin(), pop.end(), 0.0, std::plus<> {}, [=](const auto& ind) { return ind[idx]; }) / pop.size();
+                auto t1 = std::chrono::high_resolution_clock::now();
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() / 1000.0;
 
-            auto t1 = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count() / 1000.0;
+                // calculate memory consumption. the nodes shared between individuals (see Tree) are counted once
+                auto off = gp.Offspring();
+                std::vector<std::pair<const Node*, size_t>> storage;
+                storage.reserve(pop.size() + off.size());
+                for (auto individuals : { gsl::span<const Ind>(pop), off }) {
+                    for (const auto& ind : individuals) {
+                        const auto& nodes = ind.Genotype.Nodes();
+                        storage.emplace_back(nodes.data(), sizeof(Node) * nodes.capacity());
+                    }
+                }
+                std::sort(storage.begin(), storage.end());
+                storage.erase(std::unique(storage.begin(), storage.end(), [](const auto& a, const auto& b) { return a.first == b.first; }), storage.end());
+                size_t totalMemory = (pop.size() + off.size()) * sizeof(Ind);
+                totalMemory += std::transform_reduce(storage.begin(), storage.end(), size_t { 0 }, std::plus<> {}, [](const auto& p) { return p.second; });
+
+                // a single print per line, so that lines from concurrent folds do not interleave
+                auto line = fmt::format("{}{:.4f}\t{}\t", prefix, elapsed, gp.Generation() + 1);
+                line += fmt::format("{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t", best[idx], r2Train, r2Test, rmseTrain, rmseTest, nmseTrain, nmseTest);
+                line += fmt::format("{:.4f}\t{:.1f}\t{}\t{}\t{}\t{}\t", avgQuality, avgLength, evaluator->FitnessEvaluations(), evaluator->LocalEvaluations(), evaluator->TotalEvaluations(), evaluator->SavedLocalIterations());
+                line += fmt::format("{:.4f}\t{}\t{}\n", cache ? cache->HitRate() : 0.0, totalMemory, config.Seed);
+                fmt::print("{}", line);
+
+                //fmt::print("best: {}\n", InfixFormatter::Format(best.Genotype, *dataset, 6));
+            };
+
+            gp.Run(random, report);
+
+            if (incremental) {
+                // the new rows are read from the end of the dataset file, which may be growing. the training range
+                // slides over them keeping its size, the fitness of the population is updated from the rows
+                // entering and leaving the window before the evolution continues
+                auto& data = problem.GetDataset();
+                while (!evaluator->BudgetExhausted()) {
+                    auto block = Dataset::ReadRows(fileName, cursor, online, true);
+                    if (block.Rows() == 0) {
+                        break;
+                    }
+                    auto previous = problem.TrainingRange();
+                    Range arrived { data.Rows(), data.Rows() + block.Rows() };
+                    data.Append(block);
+                    // the best model predicts the new rows before it is trained on them
+                    auto estimated = Evaluate<Operon::Scalar>(best.Genotype, data, arrived);
+                    auto r2 = RSquared(estimated, problem.TargetValues().subspan(arrived.Start(), arrived.Size()));
+                    problem.TrainingRange({ previous.Start() + arrived.Size(), arrived.End() });
+                    incremental->Update(gp.Parents(), previous);
+                    if (cache) {
+                        cache->Clear(); // the fitness values refer to the previous training range
+                    }
+                    fmt::print("{}{} new rows, R2 of the best model on the new rows {:.4f}, training range {}:{}\n", prefix, arrived.Size(), r2, problem.TrainingRange().Start(), problem.TrainingRange().End());
+                    gp.Evolve(random, config.Generations, report);
+                }
+            }
 
-            auto getSize = [](const Ind& ind) { return sizeof(ind) + sizeof(Node) * ind.Genotype.Nodes().capacity(); };
+            if (result.count("simplify") > 0 && !streaming) {
+                // every subtree is evaluated, so a sample of the training rows is used
+                auto trainingRange = problem.TrainingRange();
+                Range sample { trainingRange.Start(), trainingRange.Start() + std::min(trainingRange.Size(), size_t { 10'000 }) };
+                auto simplified = Simplify(best.Genotype, problem.GetDataset(), sample);
+                fmt::print("{}best model simplified from {} to {} nodes: {}\n", prefix, best.Genotype.Length(), simplified.Length(), InfixFormatter::Format(simplified, problem.GetDataset(), 6));
+            }
 
-            // calculate memory consumption
-            size_t totalMemory = std::transform_reduce(std::execution::par_unseq, pop.begin(), pop.end(), 0U, std::plus<Operon::Scalar>{}, getSize);
-            auto off = gp.Offspring();
-            totalMemory += std::transform_reduce(std::execution::par_unseq, off.begin(), off.end(), 0U, std::plus<Operon::Scalar>{}, getSize);
+            if (streaming) {
+                // one pass over the stream for each range
+                auto summary = [&](Range range) -> std::tuple<Operon::Scalar, Operon::Scalar, Operon::Scalar> {
+                    if (range.Size() == 0) {
+                        auto nan = std::numeric_limits<Operon::Scalar>::quiet_NaN();
+                        return { nan, nan, nan };
+                    }
+                    auto calc = streaming->Accumulate(gsl::span<const Ind>(&best, 1), range).front();
+                    auto r = calc.Correlation();
+                    // the residual variance of the optimally scaled values is var(y) * (1 - r^2)
+                    auto nmse = 1 - r * r;
+                    return { r * r, std::sqrt(calc.NaiveVarianceY() * nmse), nmse };
+                };
+                auto [r2Train, rmseTrain, nmseTrain] = summary(problem.TrainingRange());
+                auto [r2Test, rmseTest, nmseTest] = summary(problem.TestRange());
+                fmt::print("{}train R2 {:.4f}, RMSE {:.4f}, NMSE {:.4f}; test R2 {:.4f}, RMSE {:.4f}, NMSE {:.4f}\n", prefix, r2Train, rmseTrain, nmseTrain, r2Test, rmseTest, nmseTest);
+                fmt::print("{}{} rows streamed in chunks of {} rows, peak chunk memory {} bytes (bound {} bytes)\n", prefix, stream->Rows(), stream->ChunkRows(), stream->PeakBytes(),
+                    stream->Depth() * stream->ChunkRows() * stream->Sample().Cols() * sizeof(Operon::Scalar));
+            }
+            return estimatedTestLast;
+        };
 
-            fmt::print("{:.4f}\t{}\t", elapsed, gp.Generation() + 1);
-            fmt::print("{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t{:.4f}\t", best[idx], r2Train, r2Test, rmseTrain, rmseTest, nmseTrain, nmseTest);
-            fmt::print("{:.4f}\t{:.1f}\t{}\t{}\t{}\t", avgQuality, avgLength, evaluator.FitnessEvaluations(), evaluator.LocalEvaluations(), evaluator.TotalEvaluations());
-            fmt::print("{}\t{}\n", totalMemory, config.Seed); 
+        auto variables = dataset->Variables();
+        auto folds = result["folds"].as<size_t>();
+        auto replicates = result["bootstrap"].as<size_t>();
 
-            //fmt::print("best: {}\n", InfixFormatter::Format(best.Genotype, *dataset, 6));
-        };
+        Operon::Random random(config.Seed);
+        if (result["shuffle"].as<bool>()) {
+            dataset->Shuffle(random);
+        }
 
-        gp.Run(random, report);
-        //report();
+        if (folds == 0 && replicates == 0) {
+            auto problem = Problem(*dataset, variables, target, trainingRange, testRange);
+            run(problem, random, "");
+        } else if (folds == 0) {
+            // every replicate shares the dataset and only owns one byte per row for its bootstrap counts
+            std::vector<Problem> problems;
+            std::vector<Operon::Random> generators;
+            problems.reserve(replicates);
+            for (size_t b = 0; b < replicates; ++b) {
+                auto counts = Bootstrap(trainingRange.Size(), random);
+                std::vector<uint8_t> weights(dataset->Rows(), 0);
+                std::copy(counts.begin(), counts.end(), weights.begin() + trainingRange.Start());
+                problems.emplace_back(*dataset, variables, target, trainingRange, testRange);
+                problems.back().SetWeights(std::move(weights));
+                generators.emplace_back(random());
+            }
+            std::vector<Operon::Vector<Operon::Scalar>> estimated(replicates);
+            std::vector<size_t> indices(replicates);
+            std::iota(indices.begin(), indices.end(), 0);
+            std::for_each(std::execution::par, indices.begin(), indices.end(), [&](auto b) {
+                estimated[b] = run(problems[b], generators[b], fmt::format("{}\t", b));
+            });
+            // the bagged prediction is the average of the replicate predictions
+            std::vector<Operon::Scalar> bagged(testRange.Size(), 0);
+            for (auto const& e : estimated) {
+                std::transform(e.begin(), e.end(), bagged.begin(), bagged.begin(), std::plus {});
+            }
+            std::transform(bagged.begin(), bagged.end(), bagged.begin(), [&](auto v) { return v / replicates; });
+            if (testRange.Size() > 0) {
+                auto targetTest = dataset->GetValues(target).subspan(testRange.Start(), testRange.Size());
+                fmt::print("bagged ensemble test R2: {:.4f}\n", RSquared(bagged, targetTest));
+            }
+        } else {
+            // every fold works on a row view of the same dataset, the values are neither copied nor shuffled
+            auto partition = Partition::KFold(dataset->Rows(), folds, random);
+            std::vector<Problem> problems;
+            std::vector<Operon::Random> generators;
+            problems.reserve(folds);
+            for (size_t k = 0; k < folds; ++k) {
+                problems.emplace_back(*dataset, variables, target, partition, k);
+                generators.emplace_back(random());
+            }
+            std::vector<Operon::Scalar> r2Test(folds);
+            std::vector<size_t> indices(folds);
+            std::iota(indices.begin(), indices.end(), 0);
+            std::for_each(std::execution::par, indices.begin(), indices.end(), [&](auto k) {
+                auto estimated = run(problems[k], generators[k], fmt::format("{}\t", k));
+                auto testRange = problems[k].TestRange();
+                r2Test[k] = RSquared(estimated, problems[k].TargetValues().subspan(testRange.Start(), testRange.Size()));
+            });
+            MeanVarianceCalculator calc;
+            calc.Add(gsl::span<Operon::Scalar>(r2Test));
+            fmt::print("cross-validation test R2: {:.4f} ± {:.4f}\n", calc.Mean(), calc.StandardDeviation());
+        }
     } catch (std::exception& e) {
         fmt::print("{}\n", e.what());
         std::exit(EXIT_FAILURE);
@@ -0,0 +1,162 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/compact.hpp"
+
+namespace Operon {
+CompactTree::CompactTree(const Tree& tree)
+{
+    const auto& nodes = tree.Nodes();
+    code.reserve(nodes.size());
+    for (const auto& node : nodes) {
+        Expects(node.Arity <= std::numeric_limits<uint8_t>::max());
+        code.push_back({ static_cast<uint8_t>(NodeTypes::GetIndex(node.Type)), static_cast<uint8_t>(node.Arity), node.Length });
+        if (node.IsLeaf()) {
+            coefficients.push_back(node.Value);
+        }
+        if (node.IsVariable()) {
+            variables.push_back(node.HashValue);
+        }
+    }
+}
+
+Tree CompactTree::ToTree() const
+{
+    std::vector<Node> nodes;
+    nodes.reserve(code.size());
+    size_t leaf = 0;
+    size_t variable = 0;
+    for (const auto& c : code) {
+        auto node = c.IsVariable() ? Node(NodeType::Variable, variables[variable++]) : Node(c.GetType());
+        node.Arity = c.Arity;
+        if (c.IsLeaf()) {
+            node.Value = coefficients[leaf++];
+        }
+        nodes.push_back(node);
+    }
+    return Tree(std::move(nodes)).UpdateNodes();
+}
+
+size_t CompactTree::LeafIndex(gsl::index i) const noexcept
+{
+    return std::count_if(code.begin(), code.begin() + i, [](const auto& c) { return c.IsLeaf(); });
+}
+
+size_t CompactTree::VariableIndex(gsl::index i) const noexcept
+{
+    return std::count_if(code.begin(), code.begin() + i, [](const auto& c) { return c.IsVariable(); });
+}
+
+std::vector<uint16_t> CompactTree::Depths() const
+{
+    std::vector<uint16_t> depths(code.size());
+    for (size_t i = 0; i < code.size(); ++i) {
+        uint16_t depth = 0;
+        // the children of node i are found by skipping over the subtrees of the previous children
+        gsl::index j = static_cast<gsl::index>(i) - 1;
+        for (size_t k = 0; k < code[i].Arity; ++k) {
+            depth = std::max(depth, depths[j]);
+            j -= code[j].Length + 1;
+        }
+        depths[i] = depth + 1;
+    }
+    return depths;
+}
+
+size_t CompactTree::Depth() const noexcept
+{
+    return code.empty() ? 0 : Depths().back();
+}
+
+size_t CompactTree::Level(gsl::index i) const noexcept
+{
+    // the ancestors of node i are the nodes after it whose subtree contains it
+    size_t level = 0;
+    for (gsl::index j = i + 1; j < static_cast<gsl::index>(code.size()); ++j) {
+        level += j - code[j].Length <= i;
+    }
+    return level;
+}
+
+Operon::Hash CompactTree::HashValue(Operon::HashMode mode) const
+{
+    if (code.empty()) {
+        return 0;
+    }
+    std::vector<Operon::Hash> hashes(code.size());
+    std::vector<Operon::Hash> buffer;
+    size_t leaf = 0;
+    size_t variable = 0;
+    for (size_t i = 0; i < code.size(); ++i) {
+        const auto& c = code[i];
+        if (c.IsLeaf()) {
+            auto hash = c.IsVariable() ? variables[variable++] : static_cast<Operon::Hash>(c.GetType());
+            auto value = coefficients[leaf++];
+            if (mode == Operon::HashMode::Strict) {
+                auto valueHash = xxh::xxhash3<Operon::HashBits>({ value });
+                hash = xxh::xxhash3<Operon::HashBits>({ hash, valueHash });
+            }
+            hashes[i] = hash;
+            continue;
+        }
+        // the hash values of the children from left to right, then the node type
+        buffer.clear();
+        for (gsl::index j = i - 1, k = 0; k < c.Arity; ++k, j -= code[j].Length + 1) {
+            buffer.push_back(hashes[j]);
+        }
+        std::reverse(buffer.begin(), buffer.end());
+        buffer.push_back(static_cast<Operon::Hash>(c.GetType()));
+        hashes[i] = xxh::xxhash3<Operon::HashBits>(buffer.data(), buffer.size() * sizeof(Operon::Hash));
+    }
+    return hashes.back();
+}
+
+CompactTree CompactTree::Cross(const CompactTree& lhs, const CompactTree& rhs, gsl::index i, gsl::index j)
+{
+    const auto& left = lhs.code;
+    const auto& right = rhs.code;
+    auto ls = i - left[i].Length; // first node of the replaced subtree
+    auto rs = j - right[j].Length; // first node of the inserted subtree
+    auto delta = static_cast<int>(right[j].Length) - static_cast<int>(left[i].Length);
+
+    CompactTree child;
+    child.code.reserve(left.size() + delta);
+    child.code.insert(child.code.end(), left.begin(), left.begin() + ls);
+    child.code.insert(child.code.end(), right.begin() + rs, right.begin() + j + 1);
+    // the ancestors of the replaced subtree change their length
+    for (auto k = i + 1; k < static_cast<gsl::index>(left.size()); ++k) {
+        auto c = left[k];
+        if (k - c.Length <= i) {
+            Expects(c.Length + delta <= std::numeric_limits<uint16_t>::max());
+            c.Length = static_cast<uint16_t>(c.Length + delta);
+        }
+        child.code.push_back(c);
+    }
+
+    auto splice = [](const auto& a, const auto& b, size_t as, size_t ae, size_t bs, size_t be, auto& out) {
+        out.reserve(a.size() - (ae - as) + (be - bs));
+        out.insert(out.end(), a.begin(), a.begin() + as);
+        out.insert(out.end(), b.begin() + bs, b.begin() + be);
+        out.insert(out.end(), a.begin() + ae, a.end());
+    };
+    splice(lhs.coefficients, rhs.coefficients, lhs.LeafIndex(ls), lhs.LeafIndex(i + 1), rhs.LeafIndex(rs), rhs.LeafIndex(j + 1), child.coefficients);
+    splice(lhs.variables, rhs.variables, lhs.VariableIndex(ls), lhs.VariableIndex(i + 1), rhs.VariableIndex(rs), rhs.VariableIndex(j + 1), child.variables);
+    return child;
+}
+} // namespace Operon
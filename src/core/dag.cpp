@@ -0,0 +1,121 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include <limits>
+
+#include "core/dag.hpp"
+
+namespace Operon {
+SubtreeStore::Id SubtreeStore::Intern(const Tree& tree)
+{
+    Expects(!tree.Empty());
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Intern(tree.Nodes(), tree.Length() - 1);
+}
+
+SubtreeStore::Id SubtreeStore::Intern(gsl::span<const Node> nodes, gsl::index i)
+{
+    const auto& node = nodes[i];
+    bool collision = false;
+    if (auto it = index_.find(node.CalculatedHashValue); it != index_.end()) {
+        const auto& root = entries_[it->second].Root;
+        if (root.Type == node.Type && root.Arity == node.Arity && root.Length == node.Length) {
+            return it->second;
+        }
+        // another subtree with the same hash value gets its own entry, which is not indexed
+        collision = true;
+    }
+    // the children are found from right to left
+    std::vector<Id> ids(node.Arity);
+    for (gsl::index j = i - 1, k = node.Arity - 1; k >= 0; --k, j -= nodes[j].Length + 1) {
+        ids[k] = Intern(nodes, j);
+    }
+    Expects(entries_.size() < std::numeric_limits<Id>::max());
+    auto id = static_cast<Id>(entries_.size());
+    entries_.push_back({ node, static_cast<uint32_t>(children_.size()) });
+    children_.insert(children_.end(), ids.begin(), ids.end());
+    if (!collision) {
+        index_.insert({ node.CalculatedHashValue, id });
+    }
+    return id;
+}
+
+Tree SubtreeStore::ToTree(Id id) const
+{
+    std::vector<Node> nodes;
+    nodes.reserve(entries_[id].Root.Length + 1);
+    auto emit = [&](Id i, auto&& emit) -> void {
+        for (auto c : Children(i)) {
+            emit(c, emit);
+        }
+        nodes.push_back(entries_[i].Root);
+    };
+    emit(id, emit);
+    return Tree(std::move(nodes)).UpdateNodes();
+}
+
+void SubtreeStore::Collect(gsl::span<Id> roots)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the children have smaller ids than their parents, so a single pass from the end marks every reachable subtree
+    std::vector<Id> ids(entries_.size(), 0);
+    for (auto r : roots) {
+        ids[r] = 1;
+    }
+    for (auto i = static_cast<gsl::index>(entries_.size()) - 1; i >= 0; --i) {
+        if (ids[i]) {
+            for (auto c : Children(static_cast<Id>(i))) {
+                ids[c] = 1;
+            }
+        }
+    }
+
+    // move the reachable subtrees to the front, in the same order, and renumber their children
+    Id n = 0;
+    uint32_t offset = 0;
+    index_.clear();
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        if (!ids[i]) {
+            continue;
+        }
+        auto entry = entries_[i];
+        for (size_t k = 0; k < entry.Root.Arity; ++k) {
+            children_[offset + k] = ids[children_[entry.Children + k]];
+        }
+        entry.Children = offset;
+        offset += entry.Root.Arity;
+        entries_[n] = entry;
+        index_.insert({ entry.Root.CalculatedHashValue, n });
+        ids[i] = n++;
+    }
+    entries_.resize(n);
+    children_.resize(offset);
+    for (auto& r : roots) {
+        r = ids[r];
+    }
+}
+
+void SubtreeStore::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    children_.clear();
+    index_.clear();
+}
+} // namespace Operon
@@ -20,61 +20,985 @@
 #include <fmt/core.h>
 #include "core/dataset.hpp"
 
-#pragma GCC diagnostic ignored "-Wreorder"
-#pragma GCC diagnostic ignored "-Wignored-qualifiers"
-#pragma GCC diagnostic ignored "-Wunknown-pragmas"
-#include "csv.hpp"
-#pragma GCC diagnostic warning "-Wreorder"
-#pragma GCC diagnostic warning "-Wignored-qualifiers"
-#pragma GCC diagnostic warning "-Wunknown-pragmas"
+#include <charconv>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <string_view>
+
+#if defined(USE_ARROW)
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/reader.h>
+#endif
+
+#if defined(_WIN32)
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Operon {
-Dataset::Dataset(const std::string& file, bool hasHeader)
-{
-    auto info = csv::get_file_info(file);
-    auto nrows = info.n_rows;
-    auto ncols = info.n_cols;
-    variables.resize(ncols);
+namespace {
+    // binary dataset format:
+    // - header
+    // - one record per column, in column order:
+    //   version 1: hash value (uint64), column type (uint32), name length (uint32), name
+    //   version 2: hash value (uint64), column type (uint32), name length (uint32), scale (double), offset (double),
+    //              column block offset (uint64), name
+    // - zero padding up to DataOffset
+    // - column blocks, each aligned to BinaryAlignment (values followed by zero padding). in version 1 all
+    //   blocks are ColumnStride bytes long, in version 2 the offset of each block is given in its record
+    constexpr char BinaryMagic[8] = { 'O', 'P', 'E', 'R', 'O', 'N', 'D', 'S' };
+    constexpr uint32_t BinaryVersion = 2;
+
+    struct BinaryHeader {
+        char Magic[8];
+        uint32_t Version;
+        uint32_t Reserved;
+        uint64_t Rows;
+        uint64_t Cols;
+        uint64_t DataOffset; // offset of the first column block
+        uint64_t ColumnStride; // distance in bytes between consecutive column blocks (version 1 only)
+    };
+
+    inline size_t AlignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+    bool HasMagic(const std::string& file, const char* magic, size_t size)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::vector<char> buffer(size);
+        in.read(buffer.data(), size);
+        return in.good() && std::memcmp(buffer.data(), magic, size) == 0;
+    }
+
+    bool IsBinary(const std::string& file) { return HasMagic(file, BinaryMagic, sizeof(BinaryMagic)); }
+
+    // arrow ipc files (feather v2) start with ARROW1 followed by two bytes of padding
+    bool IsArrow(const std::string& file) { return HasMagic(file, "ARROW1", 6); }
+
+    // variables are sorted by name and get hash values generated with a fixed seed, so that the same names are
+    // always hashed the same way and hash values are sorted in the same order as the names
+    void AssignHashValues(std::vector<Variable>& variables)
+    {
+        std::sort(variables.begin(), variables.end(), [&](const Variable& a, const Variable& b) { return CompareWithSize(a.Name, b.Name); });
+        Operon::RandomGenerator::JsfRand<Operon::HashBits> random(1234);
+        std::vector<Operon::Hash> hashes(variables.size());
+        std::generate(hashes.begin(), hashes.end(), [&]() { return random(); });
+        std::sort(hashes.begin(), hashes.end());
+        for (size_t i = 0; i < variables.size(); ++i) {
+            variables[i].Hash = hashes[i];
+        }
+    }
+
+    // maps the file read-only into memory, the mapping is released together with the last reference
+    std::pair<std::shared_ptr<const void>, size_t> MapFile(const std::string& file)
+    {
+#if defined(_WIN32)
+        std::ifstream in(file, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error(fmt::format("Could not open {}", file));
+        }
+        auto buffer = std::make_shared<std::vector<char>>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        auto size = buffer->size();
+        return { std::shared_ptr<const void>(buffer, buffer->data()), size };
+#else
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error(fmt::format("Could not open {}: {}", file, std::strerror(errno)));
+        }
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            throw std::runtime_error(fmt::format("Could not stat {}: {}", file, std::strerror(errno)));
+        }
+        size_t size = st.st_size;
+        // private mapping: pages are shared with the page cache and only copied if written to
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("Could not map {}: {}", file, std::strerror(errno)));
+        }
+        return { std::shared_ptr<const void>(addr, [size](const void* p) { munmap(const_cast<void*>(p), size); }), size };
+#endif
+    }
 
-    if (hasHeader) {
-        nrows += 1;
-        for (auto i = 0; i < ncols; ++i) {
-            variables[i].Name = info.col_names[i];
+    // number of bytes parsed by a single task
+    constexpr size_t CsvChunkSize = 1 << 20;
+
+    inline std::string_view Trim(std::string_view s)
+    {
+        auto isSpace = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+        while (!s.empty() && isSpace(s.front())) {
+            s.remove_prefix(1);
+        }
+        while (!s.empty() && isSpace(s.back())) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+
+    inline std::string_view Unquote(std::string_view s)
+    {
+        s = Trim(s);
+        if (s.size() >= 2 && s.front() == '"' && s.back() == '"') {
+            s = s.substr(1, s.size() - 2);
+        }
+        return s;
+    }
+
+    // the most frequent candidate in the first line
+    inline char DetectDelimiter(std::string_view line)
+    {
+        constexpr char candidates[] = { ',', ';', '\t', '|' };
+        return *std::max_element(std::begin(candidates), std::end(candidates), [&](char a, char b) {
+            return std::count(line.begin(), line.end(), a) < std::count(line.begin(), line.end(), b);
+        });
+    }
+
+    inline std::vector<std::string_view> Split(std::string_view line, char delimiter)
+    {
+        std::vector<std::string_view> fields;
+        for (size_t pos = 0; pos <= line.size();) {
+            auto end = std::min(line.find(delimiter, pos), line.size());
+            fields.push_back(line.substr(pos, end - pos));
+            pos = end + 1;
+        }
+        return fields;
+    }
+
+    // calls f for every non-blank line of the chunk, with the index of the line in the chunk (counting the blank
+    // lines, for error messages)
+    template <typename F>
+    inline void ForEachLine(std::string_view chunk, F&& f)
+    {
+        gsl::index index = 0;
+        for (size_t pos = 0; pos < chunk.size(); ++index) {
+            auto end = std::min(chunk.find('\n', pos), chunk.size());
+            auto line = Trim(chunk.substr(pos, end - pos));
+            if (!line.empty()) {
+                f(line, index);
+            }
+            pos = end + 1;
+        }
+    }
+
+    inline bool ParseDouble(std::string_view field, double& value)
+    {
+        if (!field.empty() && field.front() == '+') {
+            field.remove_prefix(1); // not accepted by from_chars
+        }
+        auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+        return ec == std::errc() && ptr == field.data() + field.size();
+    }
+
+    // variables (without hash values) described by the first line of a csv file
+    std::vector<Variable> CsvVariables(std::string_view first, char delimiter, bool hasHeader)
+    {
+        auto fields = Split(first, delimiter);
+        std::vector<Variable> variables(fields.size());
+        for (size_t i = 0; i < fields.size(); ++i) {
+            variables[i].Name = hasHeader ? std::string(Unquote(fields[i])) : fmt::format("X{}", i + 1);
             variables[i].Index = i;
         }
+        if (!hasHeader) {
+            variables.back().Name = "Y";
+        }
+        return variables;
+    }
+
+    // parses the fields of a csv line into row, which has ncols elements. returns an error message, empty on success
+    template <typename Row>
+    std::string ParseCsvLine(std::string_view line, char delimiter, gsl::index ncols, gsl::index lineNumber, Row&& row)
+    {
+        gsl::index col = 0;
+        for (size_t pos = 0; pos <= line.size(); ++col) {
+            auto end = std::min(line.find(delimiter, pos), line.size());
+            auto field = Trim(line.substr(pos, end - pos));
+            pos = end + 1;
+            if (col >= ncols) {
+                continue; // the extra fields are only counted
+            }
+            double value;
+            if (!ParseDouble(field, value)) {
+                return fmt::format("cannot parse '{}' as a floating-point value (line {}, column {})", field, lineNumber, col + 1);
+            }
+            row(col) = static_cast<Operon::Scalar>(value);
+        }
+        if (col != ncols) {
+            return fmt::format("line {} has {} fields, expected {}", lineNumber, col, ncols);
+        }
+        return {};
+    }
+}
+
+void Dataset::Detach()
+{
+    if (IsPrivate()) {
+        return;
+    }
+    Reallocate(Rows());
+}
+
+void Dataset::Reallocate(gsl::index capacity)
+{
+    gsl::index size = Rows();
+    Expects(capacity >= size);
+    // lags refer to the storage order, which a row selection does not preserve: in that case the lagged
+    // variables are materialized as regular columns (their indices stay the same)
+    bool materializeLags = lags && rowIndices;
+    gsl::index n = materializeLags ? cols + static_cast<gsl::index>(lags->size()) : cols;
+    auto copy = std::make_shared<MatrixType>(capacity, n);
+    for (gsl::index i = 0; i < n; ++i) {
+        Load(i, 0, size, copy->col(i).data());
+    }
+    owned = std::move(copy);
+    mapping.reset();
+    rowIndices.reset();
+    encoding.reset();
+    tiles.reset();
+    if (materializeLags) {
+        auto materialized = materializedLags ? std::make_shared<std::vector<Lag>>(*materializedLags) : std::make_shared<std::vector<Lag>>();
+        materialized->insert(materialized->end(), lags->begin(), lags->end());
+        materializedLags = std::move(materialized);
+        lags.reset();
+    }
+    cache = lags ? std::make_shared<GatherCache>() : nullptr;
+    Bind();
+    rows = size;
+}
+
+void Dataset::Reserve(size_t capacity)
+{
+    if (!IsPrivate() || capacity > static_cast<size_t>(owned->rows())) {
+        Reallocate(static_cast<gsl::index>(std::max(capacity, Rows())));
+    }
+}
+
+void Dataset::Append(const Dataset& block)
+{
+    // the materialized lagged variables of a row view could not be extended
+    Expects(!(lags && rowIndices));
+    // match the variables before modifying anything
+    std::vector<gsl::index> source(cols);
+    for (auto const& v : variables) {
+        if (IsLagged(v.Index)) {
+            continue;
+        }
+        auto it = std::find_if(block.variables.begin(), block.variables.end(), [&](auto const& w) { return w.Name == v.Name && !block.IsLagged(w.Index); });
+        if (it == block.variables.end()) {
+            throw std::runtime_error(fmt::format("Cannot append rows: variable {} is missing", v.Name));
+        }
+        source[v.Index] = it->Index;
+    }
+    gsl::index n = Rows();
+    gsl::index m = block.Rows();
+    if (!IsPrivate() || n + m > owned->rows()) {
+        Reallocate(std::max(n + m, 2 * n));
+    }
+    for (gsl::index i = 0; i < cols; ++i) {
+        block.Load(source[i], 0, m, owned->col(i).data() + n);
+    }
+    rows = n + m;
+    cache = lags ? std::make_shared<GatherCache>() : nullptr; // gathered lagged columns are stale
+}
+
+gsl::index Dataset::AppendLag(gsl::index index, gsl::index lag)
+{
+    Expects(index >= 0 && index < cols + static_cast<gsl::index>(lags ? lags->size() : 0));
+    Expects(lag > 0);
+    // lags of lagged variables are lags of the base column
+    auto lagged = index < cols ? Lag { index, lag } : Lag { (*lags)[index - cols].Base, (*lags)[index - cols].Offset + lag };
+    auto all = lags ? std::make_shared<std::vector<Lag>>(*lags) : std::make_shared<std::vector<Lag>>();
+    auto it = std::find_if(all->begin(), all->end(), [&](auto const& l) { return l.Base == lagged.Base && l.Offset == lagged.Offset; });
+    if (it != all->end()) {
+        return cols + std::distance(all->begin(), it);
+    }
+    all->push_back(lagged);
+
+    auto base = std::find_if(variables.begin(), variables.end(), [&](auto const& v) { return v.Index == lagged.Base; });
+    Variable variable;
+    variable.Name = fmt::format("{}_lag{}", base->Name, lagged.Offset);
+    variable.Index = cols + static_cast<gsl::index>(all->size()) - 1;
+    variables.push_back(variable);
+
+    lags = std::move(all);
+    if (!cache) {
+        cache = std::make_shared<GatherCache>();
+    }
+    return variable.Index;
+}
+
+gsl::index Dataset::AddLag(gsl::index index, gsl::index lag)
+{
+    auto i = AppendLag(index, lag);
+    AssignHashValues(variables);
+    return i;
+}
+
+void Dataset::AddLags(gsl::index maxLag)
+{
+    for (gsl::index i = 0; i < cols; ++i) {
+        for (gsl::index lag = 1; lag <= maxLag; ++lag) {
+            AppendLag(i, lag);
+        }
+    }
+    AssignHashValues(variables);
+}
+
+Dataset Dataset::View(const std::vector<std::string>& names) const
+{
+    Dataset view(*this);
+    view.variables.clear();
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(view.variables), [&](const auto& v) {
+        return std::find(names.begin(), names.end(), v.Name) != names.end();
+    });
+    return view;
+}
+
+Dataset Dataset::View(gsl::span<const gsl::index> indices) const
+{
+    // the indices refer to the rows of this dataset (which may be a view itself), so they are checked before
+    // they are composed with the existing selection
+    auto n = static_cast<gsl::index>(Rows());
+    Expects(std::all_of(indices.begin(), indices.end(), [&](auto i) { return i >= 0 && i < n; }));
+    auto selection = std::make_shared<std::vector<gsl::index>>(indices.begin(), indices.end());
+    if (rowIndices) {
+        // compose with the existing selection, so that views of views still index the storage directly
+        std::transform(selection->begin(), selection->end(), selection->begin(), [&](auto i) { return (*rowIndices)[i]; });
+    }
+
+    Dataset view(*this);
+    view.rowIndices = std::move(selection);
+    view.cache = std::make_shared<GatherCache>();
+    return view;
+}
+
+Dataset Dataset::Slice(Range range) const
+{
+    Expects(range.End() <= Rows());
+    Dataset slice;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(slice.variables), [&](auto const& v) { return !IsLagged(v.Index); });
+    slice.owned = std::make_shared<MatrixType>(range.Size(), cols);
+    for (gsl::index i = 0; i < cols; ++i) {
+        Load(i, range.Start(), range.Size(), slice.owned->col(i).data());
+    }
+    slice.materializedLags = materializedLags;
+    slice.Bind();
+    return slice;
+}
+
+Dataset Dataset::ReadRows(const std::string& file, Cursor& cursor, size_t count, bool hasHeader)
+{
+    if (IsBinary(file) || IsArrow(file)) {
+        // the values are decoded from the mapping, which is released when source goes out of scope
+        Dataset source(file);
+        auto start = std::min(cursor.Row, source.Rows());
+        auto end = std::min(start + count, source.Rows());
+        cursor.Row = end;
+        return source.Slice({ start, end });
+    }
+
+    auto [map, size] = MapFile(file);
+    std::string_view text(static_cast<const char*>(map.get()), size);
+    auto eol = text.find('\n');
+    auto first = Trim(text.substr(0, eol));
+    if (first.empty()) {
+        throw std::runtime_error(fmt::format("Could not read {}: the first line is empty", file));
+    }
+    auto delimiter = DetectDelimiter(first);
+
+    Dataset ds;
+    ds.variables = CsvVariables(first, delimiter, hasHeader);
+    gsl::index ncols = ds.variables.size();
+    AssignHashValues(ds.variables);
+
+    if (cursor.Offset == 0 && hasHeader) {
+        cursor.Offset = eol == std::string_view::npos ? text.size() : eol + 1;
+    }
+    auto matrix = std::make_shared<MatrixType>(count, ncols);
+    size_t row = 0;
+    size_t pos = std::min(cursor.Offset, text.size());
+    while (row < count && pos < text.size()) {
+        auto end = std::min(text.find('\n', pos), text.size());
+        auto line = Trim(text.substr(pos, end - pos));
+        pos = std::min(end + 1, text.size());
+        if (line.empty()) {
+            continue;
+        }
+        auto lineNumber = cursor.Row + row + (hasHeader ? 2 : 1);
+        if (auto error = ParseCsvLine(line, delimiter, ncols, lineNumber, matrix->row(row)); !error.empty()) {
+            throw std::runtime_error(fmt::format("Could not read {}: {}", file, error));
+        }
+        ++row;
+    }
+    cursor.Offset = pos;
+    cursor.Row += row;
+    ds.owned = row == count ? std::move(matrix) : std::make_shared<MatrixType>(matrix->topRows(row));
+    ds.Bind();
+    return ds;
+}
+
+const Dataset::MapType Dataset::Values() const
+{
+    if (!rowIndices && !encoding && !tiles) {
+        return MapType(data, rows, cols, Eigen::OuterStride<>(stride));
+    }
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (!cache->matrix) {
+        auto matrix = std::make_unique<MatrixType>(Rows(), cols);
+        for (gsl::index i = 0; i < cols; ++i) {
+            Load(i, 0, Rows(), matrix->col(i).data());
+        }
+        cache->matrix = std::move(matrix);
+    }
+    auto const& m = *cache->matrix;
+    return MapType(m.data(), m.rows(), m.cols(), Eigen::OuterStride<>(m.rows()));
+}
+
+void Dataset::Encode(gsl::index index, StorageType type)
+{
+    Expects(index >= 0 && index < cols);
+    if (type != StorageType::Int8 && type != StorageType::Int16) {
+        Encode(index, type, 1, 0);
+        return;
+    }
+
+    // quantize over all the rows of the storage, not just the ones selected by this view
+    Dataset storage(*this);
+    storage.rowIndices.reset();
+    Operon::Vector<Operon::Scalar> values(rows);
+    storage.Load(index, 0, rows, values.data());
+
+    auto [lo, hi] = type == StorageType::Int8
+        ? std::pair<Operon::Scalar, Operon::Scalar> { std::numeric_limits<int8_t>::min(), std::numeric_limits<int8_t>::max() }
+        : std::pair<Operon::Scalar, Operon::Scalar> { std::numeric_limits<int16_t>::min(), std::numeric_limits<int16_t>::max() };
+    auto [min, max] = std::minmax_element(values.begin(), values.end());
+    bool isIntegral = std::all_of(values.begin(), values.end(), [](auto v) { return v == std::round(v); });
+
+    if (isIntegral && *max - *min <= hi - lo) {
+        // low-cardinality integer columns are stored exactly
+        auto offset = *min >= lo && *max <= hi ? Operon::Scalar { 0 } : *min - lo;
+        Encode(index, type, 1, offset);
+    } else if (*max > *min) {
+        auto scale = (*max - *min) / (hi - lo);
+        Encode(index, type, scale, *min - lo * scale);
     } else {
-        for (auto i = 0; i < ncols; ++i) {
-            variables[i].Name = fmt::format("X{}", i + 1);
-            variables[i].Index = i;
+        Encode(index, type, 1, *min);
+    }
+}
+
+void Dataset::Encode(gsl::index index, StorageType type, Operon::Scalar scale, Operon::Scalar offset)
+{
+    Expects(index >= 0 && index < cols);
+    Expects(scale > 0);
+    if (tiles) {
+        Detach(); // back to the column layout
+    }
+
+    auto enc = encoding ? std::make_shared<std::vector<Column>>(*encoding) : std::make_shared<std::vector<Column>>(cols);
+    if (!encoding) {
+        // describe the existing columns, which remain in the (shared) storage
+        auto storage = owned ? std::shared_ptr<const void>(owned) : mapping;
+        for (gsl::index i = 0; i < cols; ++i) {
+            (*enc)[i].Data = data + i * stride;
+            (*enc)[i].Storage = storage;
+        }
+    }
+
+    Dataset storage(*this);
+    storage.rowIndices.reset();
+    Operon::Vector<Operon::Scalar> values(rows);
+    storage.Load(index, 0, rows, values.data());
+
+    auto encode = [&](auto tag) {
+        using U = decltype(tag);
+        auto buffer = std::make_shared<Operon::Vector<U>>(rows);
+        if constexpr (std::is_integral_v<U>) {
+            Operon::Scalar lo = std::numeric_limits<U>::min();
+            Operon::Scalar hi = std::numeric_limits<U>::max();
+            std::transform(values.begin(), values.end(), buffer->begin(), [&](auto v) {
+                return static_cast<U>(std::clamp(std::round((v - offset) / scale), lo, hi));
+            });
+        } else {
+            std::transform(values.begin(), values.end(), buffer->begin(), [](auto v) { return static_cast<U>(v); });
+        }
+        return std::shared_ptr<const void>(buffer, buffer->data());
+    };
+
+    std::shared_ptr<const void> buffer;
+    switch (type) {
+    case StorageType::Float64:
+        buffer = encode(double {});
+        break;
+    case StorageType::Float32:
+        buffer = encode(float {});
+        break;
+    case StorageType::Float16:
+        buffer = encode(Eigen::half {});
+        break;
+    case StorageType::BFloat16:
+        buffer = encode(Eigen::bfloat16 {});
+        break;
+    case StorageType::Int8:
+        buffer = encode(int8_t {});
+        break;
+    case StorageType::Int16:
+        buffer = encode(int16_t {});
+        break;
+    }
+
+    bool isFloat = type != StorageType::Int8 && type != StorageType::Int16;
+    (*enc)[index] = Column { type, buffer.get(), isFloat ? Operon::Scalar { 1 } : scale, isFloat ? Operon::Scalar { 0 } : offset, buffer };
+
+    // the original storage is released once every column was encoded (no column refers to it any more)
+    if (std::none_of(enc->begin(), enc->end(), [&](auto const& c) { return RefersToStorage(c); })) {
+        owned.reset();
+        mapping.reset();
+        data = nullptr;
+        stride = 0;
+    }
+    encoding = std::move(enc);
+    cache = std::make_shared<GatherCache>(); // the decoded values changed
+}
+
+void Dataset::Tile()
+{
+    if (tiles) {
+        return;
+    }
+    if (lags && rowIndices) {
+        Detach(); // materializes the lagged variables, which depend on the storage order
+    }
+    gsl::index n = Rows();
+    gsl::index blocks = (n + TileRows - 1) / TileRows;
+    auto matrix = std::make_shared<MatrixType>(TileRows, blocks * cols);
+    matrix->setZero();
+    Operon::Vector<Operon::Scalar> column(n);
+    for (gsl::index j = 0; j < cols; ++j) {
+        Load(j, 0, n, column.data());
+        for (gsl::index b = 0; b < blocks; ++b) {
+            auto start = b * TileRows;
+            auto count = std::min(TileRows, n - start);
+            matrix->col(b * cols + j).head(count) = Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>>(column.data() + start, count);
         }
-        variables.back().Name = "Y";
     }
+    owned.reset();
+    mapping.reset();
+    encoding.reset();
+    rowIndices.reset();
+    tiles = std::move(matrix);
+    cache = std::make_shared<GatherCache>();
+    data = nullptr;
+    rows = n;
+    stride = 0;
+}
 
-    csv::CSVReader reader(file);
+size_t Dataset::StorageBytes() const
+{
+    if (tiles) {
+        return tiles->size() * sizeof(Operon::Scalar);
+    }
+    if (!encoding) {
+        return rows * cols * sizeof(Operon::Scalar);
+    }
+    // the columns that still refer to the owned storage are counted with it, as a whole
+    auto bytes = owned ? owned->size() * sizeof(Operon::Scalar) : size_t { 0 };
+    return std::transform_reduce(encoding->begin(), encoding->end(), bytes, std::plus {}, [&](auto const& c) {
+        return owned && RefersToStorage(c) ? size_t { 0 } : rows * StorageSize(c.Type);
+    });
+}
 
-    values = MatrixType(nrows, ncols);
-    gsl::index i = 0;
-    for (auto& row : reader) {
-        gsl::index j = 0;
-        for (auto& field : row) {
-            if (field.is_num()) {
-                values(i, j) = field.get<double>();
-                ++j;
-            } else {
-                throw new std::runtime_error(fmt::format("Could not cast {} as a floating-point type.", field.get()));
+bool Dataset::RefersToStorage(Column const& column) const
+{
+    auto storage = owned ? std::shared_ptr<const void>(owned) : mapping;
+    return storage && !column.Storage.owner_before(storage) && !storage.owner_before(column.Storage);
+}
+
+gsl::span<const Operon::Scalar> Dataset::GatherColumn(gsl::index index) const
+{
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    if (cache->matrix && index < cols) {
+        return gsl::span<const Operon::Scalar>(cache->matrix->col(index).data(), Rows());
+    }
+    auto& column = cache->columns[index];
+    if (!column) {
+        column = std::make_unique<Operon::Vector<Operon::Scalar>>(Rows());
+        Load(index, 0, Rows(), column->data());
+    }
+    return gsl::span<const Operon::Scalar>(column->data(), column->size());
+}
+
+void Dataset::ReadBinary(const std::string& file)
+{
+    auto [map, size] = MapFile(file);
+    auto base = static_cast<const char*>(map.get());
+
+    auto invalid = [&](const std::string& reason) {
+        return std::runtime_error(fmt::format("Invalid binary dataset {}: {}", file, reason));
+    };
+
+    BinaryHeader header;
+    if (size < sizeof(header)) {
+        throw invalid("file too small");
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (header.Version != 1 && header.Version != BinaryVersion) {
+        throw invalid(fmt::format("unsupported version {}", header.Version));
+    }
+
+    // every variable record holds at least a hash, a type and a name length
+    if (header.Cols > (size - sizeof(header)) / (sizeof(uint64_t) + 2 * sizeof(uint32_t))) {
+        throw invalid("truncated variable records");
+    }
+
+    size_t offset = sizeof(header);
+    auto read = [&](auto& value) {
+        if (offset + sizeof(value) > size) {
+            throw invalid("truncated variable records");
+        }
+        std::memcpy(&value, base + offset, sizeof(value));
+        offset += sizeof(value);
+    };
+
+    std::vector<Column> columns(header.Cols);
+    std::vector<uint64_t> blocks(header.Cols);
+    variables.resize(header.Cols);
+    for (size_t i = 0; i < header.Cols; ++i) {
+        uint64_t hash;
+        uint32_t type, length;
+        double scale = 1, shift = 0;
+        read(hash);
+        read(type);
+        read(length);
+        if (header.Version > 1) {
+            read(scale);
+            read(shift);
+            read(blocks[i]);
+        } else {
+            // the column blocks must lie within the file (checked without overflow)
+            if (header.DataOffset > size || (i > 0 && header.ColumnStride > (size - header.DataOffset) / i)) {
+                throw invalid(fmt::format("truncated data for column {}", i));
             }
+            blocks[i] = header.DataOffset + i * header.ColumnStride;
+        }
+        if (offset + length > size) {
+            throw invalid("truncated variable records");
+        }
+        variables[i].Name = std::string(base + offset, length);
+        variables[i].Hash = hash;
+        variables[i].Index = i;
+        offset += length;
+
+        if (type > static_cast<uint32_t>(StorageType::Int16)) {
+            throw invalid(fmt::format("unsupported type {} for column {}", type, variables[i].Name));
+        }
+        auto& c = columns[i];
+        c.Type = static_cast<StorageType>(type);
+        c.Scale = static_cast<Operon::Scalar>(scale);
+        c.Offset = static_cast<Operon::Scalar>(shift);
+        if (blocks[i] < offset || blocks[i] > size || header.Rows > (size - blocks[i]) / StorageSize(c.Type)) {
+            throw invalid(fmt::format("truncated data for column {}", variables[i].Name));
+        }
+        if (header.Version == 1 && header.Cols > 1 && header.ColumnStride / StorageSize(c.Type) < header.Rows) {
+            throw invalid(fmt::format("column stride {} is smaller than column {}", header.ColumnStride, variables[i].Name));
         }
-        ++i;
+        if (blocks[i] % StorageSize(c.Type) != 0) {
+            throw invalid(fmt::format("misaligned data for column {}", variables[i].Name));
+        }
+        c.Data = base + blocks[i];
+        c.Storage = map;
     }
 
+    mapping = std::move(map);
+    rows = header.Rows;
+    cols = header.Cols;
+
+    // the values are read in place if they are all stored as Operon::Scalar with a constant stride, otherwise
+    // the columns are described individually and decoded when they are loaded (still without copying)
+    bool isNative = std::all_of(columns.begin(), columns.end(), [](auto const& c) { return c.Type == NativeStorageType; });
+    bool isStrided = cols < 2 || ((blocks[1] - blocks[0]) % sizeof(Operon::Scalar) == 0 && std::adjacent_find(blocks.begin(), blocks.end(), [&](auto a, auto b) { return b - a != blocks[1] - blocks[0]; }) == blocks.end());
+    if (isNative && isStrided) {
+        data = cols > 0 ? static_cast<Operon::Scalar const*>(columns[0].Data) : nullptr;
+        stride = cols > 1 ? (blocks[1] - blocks[0]) / sizeof(Operon::Scalar) : rows;
+    } else {
+        encoding = std::make_shared<std::vector<Column>>(std::move(columns));
+        cache = std::make_shared<GatherCache>();
+    }
     std::sort(variables.begin(), variables.end(), [&](const Variable& a, const Variable& b) { return CompareWithSize(a.Name, b.Name); });
-    // fill in variable hash values using a fixed seed
-    Operon::RandomGenerator::JsfRand<Operon::HashBits> random(1234);
-    std::vector<Operon::Hash> hashes(ncols);
-    std::generate(hashes.begin(), hashes.end(), [&]() { return random(); });
-    std::sort(hashes.begin(), hashes.end());
-    for (auto i = 0; i < ncols; ++i) {
-        variables[i].Hash = hashes[i];
+}
+
+void Dataset::Save(const std::string& file) const
+{
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error(fmt::format("Could not open {} for writing", file));
+    }
+
+    // variable records are stored in column order, lagged variables have no column
+    std::vector<Variable> columns;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(columns), [&](auto const& v) { return !IsLagged(v.Index); });
+    std::sort(columns.begin(), columns.end(), [](const auto& a, const auto& b) { return a.Index < b.Index; });
+
+    auto columnOf = [&](auto const& v) {
+        if (tiles) {
+            // written in the column layout, the values are gathered (for all the rows of this dataset)
+            return Column { NativeStorageType, GetValues(v.Index).data(), 1, 0, nullptr };
+        }
+        return encoding ? (*encoding)[v.Index] : Column { NativeStorageType, data + v.Index * stride, 1, 0, nullptr };
+    };
+
+    BinaryHeader header;
+    std::memcpy(header.Magic, BinaryMagic, sizeof(BinaryMagic));
+    header.Version = BinaryVersion;
+    header.Reserved = 0;
+    header.Rows = Rows();
+    header.Cols = columns.size();
+    header.ColumnStride = 0;
+
+    size_t offset = sizeof(header);
+    for (const auto& v : columns) {
+        offset += sizeof(uint64_t) + 2 * sizeof(uint32_t) + 2 * sizeof(double) + sizeof(uint64_t) + v.Name.size();
+    }
+    header.DataOffset = AlignUp(offset, BinaryAlignment);
+
+    std::vector<uint64_t> blocks;
+    size_t end = header.DataOffset;
+    for (const auto& v : columns) {
+        blocks.push_back(end);
+        end += AlignUp(Rows() * StorageSize(columnOf(v).Type), BinaryAlignment);
+    }
+
+    auto write = [&](const auto& value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); };
+    std::vector<char> padding(BinaryAlignment, 0);
+
+    write(header);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        auto const& v = columns[i];
+        auto c = columnOf(v);
+        write(static_cast<uint64_t>(v.Hash));
+        write(static_cast<uint32_t>(c.Type));
+        write(static_cast<uint32_t>(v.Name.size()));
+        write(static_cast<double>(c.Scale));
+        write(static_cast<double>(c.Offset));
+        write(blocks[i]);
+        out.write(v.Name.data(), v.Name.size());
+    }
+    out.write(padding.data(), header.DataOffset - offset);
+
+    std::vector<char> buffer;
+    for (const auto& v : columns) {
+        auto c = columnOf(v);
+        auto elementSize = StorageSize(c.Type);
+        auto columnBytes = Rows() * elementSize;
+        auto bytes = static_cast<const char*>(c.Data);
+        if (rowIndices && !tiles) {
+            // gather the selected rows, keeping their encoding
+            buffer.resize(columnBytes);
+            for (size_t i = 0; i < Rows(); ++i) {
+                std::memcpy(buffer.data() + i * elementSize, bytes + (*rowIndices)[i] * elementSize, elementSize);
+            }
+            bytes = buffer.data();
+        }
+        out.write(bytes, columnBytes);
+        out.write(padding.data(), AlignUp(columnBytes, BinaryAlignment) - columnBytes);
+    }
+    if (!out) {
+        throw std::runtime_error(fmt::format("Error writing {}", file));
+    }
+}
+
+void Dataset::ReadCsv(const std::string& file, bool hasHeader)
+{
+    auto [map, size] = MapFile(file);
+    std::string_view text(static_cast<const char*>(map.get()), size);
+
+    // the first line determines the delimiter, the number of columns and (optionally) the column names
+    auto eol = text.find('\n');
+    auto first = Trim(text.substr(0, eol));
+    if (first.empty()) {
+        throw std::runtime_error(fmt::format("Could not read {}: the first line is empty", file));
+    }
+    auto delimiter = DetectDelimiter(first);
+    variables = CsvVariables(first, delimiter, hasHeader);
+    gsl::index ncols = variables.size();
+
+    auto body = hasHeader ? text.substr(eol == std::string_view::npos ? text.size() : eol + 1) : text;
+    gsl::index firstLine = hasHeader ? 2 : 1; // line number of the first line of the body, for error messages
+
+    // split the body into newline-aligned chunks
+    std::vector<std::string_view> chunks;
+    for (size_t pos = 0; pos < body.size();) {
+        auto end = pos + CsvChunkSize < body.size() ? body.find('\n', pos + CsvChunkSize) : std::string_view::npos;
+        end = end == std::string_view::npos ? body.size() : end + 1;
+        chunks.push_back(body.substr(pos, end - pos));
+        pos = end;
+    }
+
+    // count the rows in each chunk, so that every task knows where to write its values, and the lines (including
+    // the blank ones), so that every task knows the line numbers for its error messages
+    std::vector<gsl::index> offsets(chunks.size() + 1, 0);
+    std::vector<gsl::index> lines(chunks.size() + 1, 0);
+    std::vector<size_t> indices(chunks.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](auto c) {
+        ForEachLine(chunks[c], [&](auto, auto) { ++offsets[c + 1]; });
+        lines[c + 1] = std::count(chunks[c].begin(), chunks[c].end(), '\n');
+    });
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::partial_sum(lines.begin(), lines.end(), lines.begin());
+
+    owned = std::make_shared<MatrixType>(offsets.back(), ncols);
+    auto& values = *owned;
+
+    // exceptions cannot escape the parallel algorithm, so each task records its first error. a task parses its
+    // chunk into a row-major buffer (in the order of the fields), which is then copied into the columns
+    std::vector<std::string> errors(chunks.size());
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](auto c) {
+        gsl::index rows = offsets[c + 1] - offsets[c];
+        std::vector<Operon::Scalar> buffer(rows * ncols);
+        gsl::index row = 0;
+        ForEachLine(chunks[c], [&](auto line, auto index) {
+            if (!errors[c].empty()) {
+                return;
+            }
+            auto fields = buffer.data() + row * ncols;
+            if (auto error = ParseCsvLine(line, delimiter, ncols, firstLine + lines[c] + index, [&](auto i) -> Operon::Scalar& { return fields[i]; }); !error.empty()) {
+                errors[c] = fmt::format("Could not read {}: {}", file, error);
+                return;
+            }
+            ++row;
+        });
+        if (!errors[c].empty()) {
+            return;
+        }
+        for (gsl::index j = 0; j < ncols; ++j) {
+            auto column = values.col(j).data() + offsets[c];
+            for (gsl::index i = 0; i < rows; ++i) {
+                column[i] = buffer[i * ncols + j];
+            }
+        }
+    });
+    if (auto it = std::find_if(errors.begin(), errors.end(), [](const auto& e) { return !e.empty(); }); it != errors.end()) {
+        throw std::runtime_error(*it);
+    }
+
+    AssignHashValues(variables);
+    Bind();
+}
+
+void Dataset::ReadArrow(const std::string& file)
+{
+#if defined(USE_ARROW)
+    auto check = [&](auto&& result) {
+        if (!result.ok()) {
+            throw std::runtime_error(fmt::format("Could not read {}: {}", file, result.status().ToString()));
+        }
+        return std::move(result).ValueOrDie();
+    };
+
+    auto input = check(arrow::io::MemoryMappedFile::Open(file, arrow::io::FileMode::READ));
+    auto reader = check(arrow::ipc::RecordBatchFileReader::Open(input));
+    auto schema = reader->schema();
+
+    cols = schema->num_fields();
+    variables.resize(cols);
+    std::vector<StorageType> types(cols);
+    for (gsl::index i = 0; i < cols; ++i) {
+        auto const& field = schema->field(i);
+        variables[i].Name = field->name();
+        variables[i].Index = i;
+        switch (field->type()->id()) {
+        case arrow::Type::DOUBLE:
+            types[i] = StorageType::Float64;
+            break;
+        case arrow::Type::FLOAT:
+            types[i] = StorageType::Float32;
+            break;
+        case arrow::Type::HALF_FLOAT:
+            types[i] = StorageType::Float16;
+            break;
+        case arrow::Type::INT8:
+            types[i] = StorageType::Int8;
+            break;
+        case arrow::Type::INT16:
+            types[i] = StorageType::Int16;
+            break;
+        default:
+            throw std::runtime_error(fmt::format("Could not read {}: column {} has unsupported type {}", file, field->name(), field->type()->ToString()));
+        }
+    }
+
+    std::vector<std::shared_ptr<arrow::RecordBatch>> batches(reader->num_record_batches());
+    for (size_t b = 0; b < batches.size(); ++b) {
+        batches[b] = check(reader->ReadRecordBatch(b));
+        for (gsl::index i = 0; i < cols; ++i) {
+            if (batches[b]->column(i)->null_count() > 0) {
+                throw std::runtime_error(fmt::format("Could not read {}: column {} contains missing values", file, variables[i].Name));
+            }
+        }
+    }
+
+    // raw values of column i in batch b, the buffers point into the mapped file unless the file is compressed
+    auto values = [&](size_t b, gsl::index i) -> void const* {
+        auto const& array = batches[b]->column(i);
+        switch (types[i]) {
+        case StorageType::Float64:
+            return std::static_pointer_cast<arrow::DoubleArray>(array)->raw_values();
+        case StorageType::Float32:
+            return std::static_pointer_cast<arrow::FloatArray>(array)->raw_values();
+        case StorageType::Float16:
+            return std::static_pointer_cast<arrow::HalfFloatArray>(array)->raw_values();
+        case StorageType::Int8:
+            return std::static_pointer_cast<arrow::Int8Array>(array)->raw_values();
+        case StorageType::Int16:
+            return std::static_pointer_cast<arrow::Int16Array>(array)->raw_values();
+        default:
+            return nullptr;
+        }
+    };
+
+    rows = std::transform_reduce(batches.begin(), batches.end(), gsl::index { 0 }, std::plus {}, [](auto const& batch) { return batch->num_rows(); });
+    auto columns = std::make_shared<std::vector<Column>>(cols);
+    for (gsl::index i = 0; i < cols; ++i) {
+        if (batches.size() == 1) {
+            // the values are used in place, the batch keeps its buffers (and the mapping) alive
+            (*columns)[i] = Column { types[i], values(0, i), 1, 0, batches[0] };
+            continue;
+        }
+        // the column is split across record batches, the pieces are concatenated (keeping their type)
+        auto size = StorageSize(types[i]);
+        auto buffer = std::make_shared<std::vector<char>>(rows * size);
+        size_t offset = 0;
+        for (size_t b = 0; b < batches.size(); ++b) {
+            auto bytes = batches[b]->num_rows() * size;
+            std::memcpy(buffer->data() + offset, values(b, i), bytes);
+            offset += bytes;
+        }
+        (*columns)[i] = Column { types[i], buffer->data(), 1, 0, std::shared_ptr<const void>(buffer, buffer->data()) };
+    }
+    encoding = std::move(columns);
+    cache = std::make_shared<GatherCache>();
+    if (batches.size() == 1) {
+        mapping = std::move(input);
+    }
+    AssignHashValues(variables);
+#else
+    throw std::runtime_error(fmt::format("Could not read {}: operon was built without Arrow support (USE_ARROW)", file));
+#endif
+}
+
+Dataset::Dataset(const std::string& file, bool hasHeader)
+{
+    if (IsBinary(file)) {
+        ReadBinary(file);
+    } else if (IsArrow(file)) {
+        ReadArrow(file);
+    } else {
+        ReadCsv(file, hasHeader);
     }
 }
 }
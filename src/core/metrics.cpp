@@ -61,4 +61,55 @@ Operon::Scalar RSquared(gsl::span<const Operon::Scalar> x, gsl::span<const Opero
     auto r = PearsonsRCalculator::Coefficient(x, y);
     return r * r;
 }
+
+Operon::Scalar NormalizedMeanSquaredError(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y, gsl::span<const Operon::Scalar> weights)
+{
+    if (weights.empty()) {
+        return NormalizedMeanSquaredError(x, y);
+    }
+    Expects(x.size() == y.size());
+    Expects(x.size() == weights.size());
+    MeanVarianceCalculator ycalc;
+    MeanVarianceCalculator errcalc;
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (!std::isnan(y[i])) {
+            ycalc.Add(y[i], weights[i]);
+        }
+        auto e = x[i] - y[i];
+        errcalc.Add(e * e, weights[i]);
+    }
+    auto yvar = ycalc.NaiveVariance();
+    auto errmean = errcalc.Mean();
+    return yvar > 0 ? errmean / yvar : yvar;
+}
+
+Operon::Scalar MeanSquaredError(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y, gsl::span<const Operon::Scalar> weights)
+{
+    if (weights.empty()) {
+        return MeanSquaredError(x, y);
+    }
+    Expects(x.size() == y.size());
+    Expects(x.size() == weights.size());
+    MeanVarianceCalculator mcalc;
+    for (size_t i = 0; i < x.size(); ++i) {
+        mcalc.Add((x[i] - y[i]) * (x[i] - y[i]), weights[i]);
+    }
+    return mcalc.Mean();
+}
+
+Operon::Scalar RootMeanSquaredError(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y, gsl::span<const Operon::Scalar> weights)
+{
+    return std::sqrt(MeanSquaredError(x, y, weights));
+}
+
+Operon::Scalar RSquared(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y, gsl::span<const Operon::Scalar> weights)
+{
+    if (weights.empty()) {
+        return RSquared(x, y);
+    }
+    Expects(x.size() == y.size());
+    Expects(x.size() == weights.size());
+    auto r = PearsonsRCalculator::WeightedCoefficient(x, y, weights);
+    return r * r;
+}
 } // namespace Operon
@@ -0,0 +1,226 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/screening.hpp"
+#include "stat/pearson.hpp"
+
+#include <execution>
+#include <numeric>
+
+namespace Operon {
+namespace {
+    constexpr size_t BatchRows = 16384;
+    constexpr size_t BlockRows = 4096; // rows per vectorized block of the correlation
+    constexpr size_t EdgeRows = 1024; // values used to place the bin edges
+    constexpr size_t RedundancyRows = 1024; // enough to resolve correlations close to the redundancy threshold
+
+    // loads every step-th row of the range (the batches are a multiple of the step, so the sampled rows are
+    // at the same offsets in every batch)
+    void LoadSample(const Dataset& ds, gsl::index index, Range range, size_t step, std::vector<Operon::Scalar>& buffer, Operon::Scalar* out)
+    {
+        auto batch = std::max(size_t { 1 }, BatchRows / step) * step;
+        buffer.resize(batch);
+        for (size_t start = range.Start(); start < range.End(); start += batch) {
+            auto count = std::min(batch, range.End() - start);
+            ds.Load(index, start, count, buffer.data());
+            for (size_t i = 0; i < count; i += step) {
+                *out++ = buffer[i];
+            }
+        }
+    }
+
+    // bin edges at the quantiles of an evenly spaced subsample of the values. repeated values collapse the
+    // edges, so discrete variables get fewer bins and constant ones a single bin
+    std::vector<Operon::Scalar> BinEdges(gsl::span<const Operon::Scalar> values, size_t bins)
+    {
+        std::vector<Operon::Scalar> sample;
+        auto step = std::max(size_t { 1 }, values.size() / EdgeRows);
+        for (size_t i = 0; i < values.size(); i += step) {
+            sample.push_back(values[i]);
+        }
+        std::sort(sample.begin(), sample.end());
+        std::vector<Operon::Scalar> edges;
+        for (size_t b = 1; b < bins; ++b) {
+            edges.push_back(sample[b * sample.size() / bins]);
+        }
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        return edges;
+    }
+
+    uint16_t Bin(gsl::span<const Operon::Scalar> edges, Operon::Scalar value)
+    {
+        // branchless count of the edges not above the value (same as upper_bound, faster for a few edges)
+        uint16_t bin = 0;
+        for (auto e : edges) {
+            bin += static_cast<uint16_t>(e <= value);
+        }
+        return bin;
+    }
+
+    // plug-in estimate from the joint histogram, with the miller-madow bias correction (so that independent
+    // variables score close to zero regardless of the number of bins)
+    double MutualInformation(gsl::span<const uint16_t> x, size_t nx, gsl::span<const uint16_t> y, size_t ny)
+    {
+        std::vector<size_t> joint(nx * ny, 0), px(nx, 0), py(ny, 0);
+        for (size_t i = 0; i < x.size(); ++i) {
+            ++joint[x[i] * ny + y[i]];
+            ++px[x[i]];
+            ++py[y[i]];
+        }
+        double n = x.size();
+        double mi = 0;
+        for (size_t i = 0; i < nx; ++i) {
+            for (size_t j = 0; j < ny; ++j) {
+                if (auto c = joint[i * ny + j]; c > 0) {
+                    mi += c / n * std::log(c * n / (static_cast<double>(px[i]) * py[j]));
+                }
+            }
+        }
+        auto kx = std::count_if(px.begin(), px.end(), [](auto c) { return c > 0; });
+        auto ky = std::count_if(py.begin(), py.end(), [](auto c) { return c > 0; });
+        return std::max(0.0, mi - (kx - 1) * (ky - 1) / (2 * n));
+    }
+} // namespace
+
+std::vector<VariableScore> ScreenVariables(const Problem& problem, ScreeningConfig config)
+{
+    const auto& ds = problem.GetDataset();
+    auto inputs = problem.InputVariables();
+    auto range = problem.TrainingRange();
+    Expects(range.Size() > 0);
+    Expects(config.Bins > 1 && config.Bins <= std::numeric_limits<uint16_t>::max());
+
+    auto rows = std::max(config.Rows, size_t { 1 });
+    auto step = (range.Size() + rows - 1) / rows;
+    auto n = (range.Size() + step - 1) / step;
+
+    std::vector<Operon::Scalar> buffer;
+    std::vector<Operon::Scalar> y(n);
+    LoadSample(ds, ds.GetIndex(ds.GetHashValue(problem.TargetVariable())), range, step, buffer, y.data());
+    auto yFinite = std::all_of(y.begin(), y.end(), [](auto v) { return std::isfinite(v); });
+    std::vector<Operon::Scalar> finite;
+    std::copy_if(y.begin(), y.end(), std::back_inserter(finite), [](auto v) { return std::isfinite(v); });
+    auto yEdges = finite.empty() ? std::vector<Operon::Scalar> {} : BinEdges(finite, config.Bins);
+    std::vector<uint16_t> yBins(n);
+    std::transform(y.begin(), y.end(), yBins.begin(), [&](auto v) { return Bin(yEdges, v); });
+
+    // standardized subsample of each variable, scaled such that the dot product of two columns is their correlation
+    auto rstep = (n + RedundancyRows - 1) / RedundancyRows;
+    auto m = (n + rstep - 1) / rstep;
+    Eigen::Matrix<Operon::Scalar, Eigen::Dynamic, Eigen::Dynamic> z(m, inputs.size());
+
+    std::vector<VariableScore> scores(inputs.size());
+    std::vector<gsl::index> indices(inputs.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    std::for_each(std::execution::par, indices.begin(), indices.end(), [&](gsl::index i) {
+        std::vector<Operon::Scalar> buf;
+        std::vector<Operon::Scalar> x(n);
+        LoadSample(ds, inputs[i].Index, range, step, buf, x.data());
+
+        // only the rows where both values are finite take part (eg. the first rows of lagged variables)
+        gsl::span<const Operon::Scalar> xs(x), ys(y);
+        gsl::span<const uint16_t> yb(yBins);
+        std::vector<Operon::Scalar> xf, yf;
+        std::vector<uint16_t> ybf;
+        if (!yFinite || !std::all_of(x.begin(), x.end(), [](auto v) { return std::isfinite(v); })) {
+            for (size_t j = 0; j < n; ++j) {
+                if (std::isfinite(x[j]) && std::isfinite(y[j])) {
+                    xf.push_back(x[j]);
+                    yf.push_back(y[j]);
+                    ybf.push_back(yBins[j]);
+                }
+            }
+            xs = xf;
+            ys = yf;
+            yb = ybf;
+        }
+
+        auto& score = scores[i];
+        score = { inputs[i], 0, 0, 0, false };
+        PearsonsRCalculator calc;
+        for (size_t j = 0; j < xs.size(); j += BlockRows) {
+            auto count = std::min(BlockRows, xs.size() - j);
+            calc.Add(xs.subspan(j, count), ys.subspan(j, count));
+        }
+        if (!(calc.Count() > 1 && calc.NaiveVarianceX() > 0)) {
+            z.col(i).setZero();
+            score.Score = -1; // constant (or missing) variables are never selected
+            return;
+        }
+        auto r = calc.Correlation();
+        auto xEdges = BinEdges(xs, config.Bins);
+        std::vector<uint16_t> xb(xs.size());
+        std::transform(xs.begin(), xs.end(), xb.begin(), [&](auto v) { return Bin(xEdges, v); });
+        auto mi = MutualInformation(xb, xEdges.size() + 1, yb, yEdges.size() + 1);
+        // for jointly gaussian variables the mutual information is -log(1 - r^2) / 2, the histogram estimate
+        // is lower for linear relationships but also captures non-linear ones
+        auto linear = -0.5 * std::log(std::max(1 - r * r, 1e-12));
+        score.Correlation = static_cast<Operon::Scalar>(r);
+        score.MutualInformation = static_cast<Operon::Scalar>(mi);
+        score.Score = static_cast<Operon::Scalar>(std::max(mi, linear));
+
+        auto mean = calc.MeanX();
+        auto scale = 1 / (calc.NaiveStddevX() * std::sqrt(static_cast<double>(m)));
+        for (size_t j = 0; j < m; ++j) {
+            auto v = x[j * rstep];
+            z(j, i) = std::isfinite(v) ? static_cast<Operon::Scalar>((v - mean) * scale) : 0;
+        }
+    });
+
+    // greedy selection by decreasing score, skipping the variables redundant with one that was already kept
+    std::stable_sort(indices.begin(), indices.end(), [&](auto a, auto b) { return scores[a].Score > scores[b].Score; });
+    std::vector<gsl::index> kept;
+    for (auto i : indices) {
+        if (scores[i].Score < 0 || (config.MaxVariables > 0 && kept.size() == config.MaxVariables)) {
+            break;
+        }
+        if (config.Redundancy < 1 && std::any_of(kept.begin(), kept.end(), [&](auto k) { return std::abs(z.col(k).dot(z.col(i))) >= config.Redundancy; })) {
+            continue;
+        }
+        kept.push_back(i);
+        scores[i].Selected = true;
+    }
+    for (auto& s : scores) {
+        s.Score = std::max(s.Score, Operon::Scalar { 0 });
+    }
+    return scores;
+}
+
+std::vector<Operon::Scalar> ScreeningWeights(gsl::span<const VariableScore> scores)
+{
+    Operon::Scalar max = 0;
+    size_t selected = 0;
+    for (const auto& s : scores) {
+        if (s.Selected) {
+            max = std::max(max, s.Score);
+            ++selected;
+        }
+    }
+    if (selected == 0) {
+        return {}; // sample uniformly
+    }
+    std::vector<Operon::Scalar> weights(scores.size(), 0);
+    for (size_t i = 0; i < scores.size(); ++i) {
+        if (scores[i].Selected) {
+            weights[i] = max > 0 ? std::max(scores[i].Score, static_cast<Operon::Scalar>(0.01) * max) : 1;
+        }
+    }
+    return weights;
+}
+} // namespace Operon
@@ -0,0 +1,462 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "core/eval.hpp"
+#include "core/simplify.hpp"
+
+namespace Operon {
+namespace {
+    // a simplified subexpression. the operands are in evaluation order, so a binary node computes
+    // Children[0] op Children[1] (in postfix order, the first operand comes right before the node)
+    struct Expr {
+        NodeType Type;
+        Operon::Scalar Value;
+        Operon::Hash HashValue;
+        std::vector<int> Children;
+        Operon::Hash Key; // structural hash, including the coefficients
+        size_t Length;    // number of nodes
+    };
+
+    // a product c * f1^e1 * ... * fn^en of integer powers of subexpressions, with the factors ordered by their key
+    struct Factor {
+        int Expr;
+        int Exponent;
+    };
+
+    struct Monomial {
+        Operon::Scalar Coefficient;
+        std::vector<Factor> Factors;
+        Operon::Hash Key; // of the factors, equal for like terms
+    };
+
+    Operon::Scalar Apply(NodeType type, Operon::Scalar a, Operon::Scalar b)
+    {
+        switch (type) {
+        case NodeType::Add:
+            return a + b;
+        case NodeType::Sub:
+            return a - b;
+        case NodeType::Mul:
+            return a * b;
+        case NodeType::Div:
+            return a / b;
+        case NodeType::Log:
+            return std::log(a);
+        case NodeType::Exp:
+            return std::exp(a);
+        case NodeType::Sin:
+            return std::sin(a);
+        case NodeType::Cos:
+            return std::cos(a);
+        case NodeType::Tan:
+            return std::tan(a);
+        case NodeType::Sqrt:
+            return std::sqrt(a);
+        case NodeType::Cbrt:
+            return std::cbrt(a);
+        case NodeType::Square:
+            return a * a;
+        default:
+            return a;
+        }
+    }
+
+    class Simplifier {
+    public:
+        explicit Simplifier(const std::vector<Node>& nodes)
+            : nodes(nodes)
+        {
+            pool.reserve(4 * nodes.size());
+        }
+
+        // simplifies the subtree at index i, bottom-up. each node is rewritten only if that makes its subtree
+        // shorter, so the result is never longer than the original
+        int Simplify(gsl::index i)
+        {
+            const auto& s = nodes[i];
+            if (s.IsConstant()) {
+                return Constant(s.Value);
+            }
+            if (s.IsVariable()) {
+                return Variable(s.HashValue, s.Value);
+            }
+
+            std::vector<int> args;
+            args.reserve(s.Arity);
+            for (gsl::index j = i - 1, k = 0; k < s.Arity; ++k, j -= nodes[j].Length + 1) {
+                args.push_back(Simplify(j));
+            }
+            auto plain = Make(s.Type, args);
+
+            int candidate;
+            switch (s.Type) {
+            case NodeType::Add:
+            case NodeType::Sub: {
+                std::vector<Monomial> terms;
+                CollectSum(plain, 1, terms);
+                candidate = BuildSum(std::move(terms));
+                break;
+            }
+            case NodeType::Mul:
+            case NodeType::Div: {
+                Monomial m { 1, {}, 0 };
+                CollectProduct(plain, 1, m);
+                candidate = BuildProduct(Merge(std::move(m)));
+                break;
+            }
+            default: {
+                candidate = SimplifyUnary(s.Type, args.front());
+                break;
+            }
+            }
+            return pool[candidate].Length <= pool[plain].Length ? candidate : plain;
+        }
+
+        // appends the nodes of the expression in postfix order
+        void Emit(int e, std::vector<Node>& out) const
+        {
+            const auto& x = pool[e];
+            for (auto it = x.Children.rbegin(); it != x.Children.rend(); ++it) {
+                Emit(*it, out);
+            }
+            auto node = x.Type == NodeType::Variable ? Node(NodeType::Variable, x.HashValue) : Node(x.Type);
+            node.Arity = x.Children.size();
+            node.Value = x.Value;
+            out.push_back(node);
+        }
+
+    private:
+        int Make(NodeType type, std::vector<int> children, Operon::Scalar value = 0, Operon::Hash hash = 0)
+        {
+            Expr x { type, value, hash, std::move(children), 0, 1 };
+            if (x.Children.empty()) {
+                auto valueHash = xxh::xxhash3<Operon::HashBits>({ value });
+                x.Key = xxh::xxhash3<Operon::HashBits>({ hash, valueHash });
+            } else {
+                std::vector<Operon::Hash> keys;
+                keys.reserve(x.Children.size() + 1);
+                for (auto c : x.Children) {
+                    keys.push_back(pool[c].Key);
+                    x.Length += pool[c].Length;
+                }
+                if (type == NodeType::Add || type == NodeType::Mul) {
+                    std::sort(keys.begin(), keys.end());
+                }
+                keys.push_back(static_cast<Operon::Hash>(type));
+                x.Key = xxh::xxhash3<Operon::HashBits>(keys);
+            }
+            pool.push_back(std::move(x));
+            return static_cast<int>(pool.size() - 1);
+        }
+
+        int Constant(Operon::Scalar value) { return Make(NodeType::Constant, {}, value, static_cast<Operon::Hash>(NodeType::Constant)); }
+        int Variable(Operon::Hash hash, Operon::Scalar weight) { return Make(NodeType::Variable, {}, weight, hash); }
+
+        int SimplifyUnary(NodeType type, int a)
+        {
+            const auto& x = pool[a];
+            if (x.Type == NodeType::Constant) {
+                return Constant(Apply(type, x.Value, 0));
+            }
+            // the inverse functions cancel out
+            if ((type == NodeType::Exp && x.Type == NodeType::Log) || (type == NodeType::Log && x.Type == NodeType::Exp) || (type == NodeType::Square && x.Type == NodeType::Sqrt)) {
+                return x.Children.front();
+            }
+            auto plain = Make(type, { a });
+            if (type == NodeType::Square) {
+                Monomial m { 1, {}, 0 };
+                CollectProduct(plain, 1, m);
+                return BuildProduct(Merge(std::move(m)));
+            }
+            return plain;
+        }
+
+        // flattens a sum into terms (monomials), subtracted terms get a negated coefficient
+        void CollectSum(int e, Operon::Scalar scale, std::vector<Monomial>& terms)
+        {
+            // copied, since the pool grows while collecting
+            auto type = pool[e].Type;
+            auto children = pool[e].Children;
+            if (type == NodeType::Add) {
+                for (auto c : children) {
+                    CollectSum(c, scale, terms);
+                }
+            } else if (type == NodeType::Sub && children.size() == 2) {
+                CollectSum(children[0], scale, terms);
+                CollectSum(children[1], -scale, terms);
+            } else {
+                Monomial m { scale, {}, 0 };
+                CollectProduct(e, 1, m);
+                terms.push_back(Merge(std::move(m)));
+            }
+        }
+
+        // flattens a product into a coefficient and the powers of its factors
+        void CollectProduct(int e, int exponent, Monomial& m)
+        {
+            // copied, since the pool grows while collecting
+            auto x = pool[e];
+            switch (x.Type) {
+            case NodeType::Mul: {
+                for (auto c : x.Children) {
+                    CollectProduct(c, exponent, m);
+                }
+                return;
+            }
+            case NodeType::Div: {
+                if (x.Children.size() == 2) {
+                    CollectProduct(x.Children[0], exponent, m);
+                    CollectProduct(x.Children[1], -exponent, m);
+                    return;
+                }
+                break;
+            }
+            case NodeType::Square: {
+                CollectProduct(x.Children.front(), 2 * exponent, m);
+                return;
+            }
+            case NodeType::Constant: {
+                // a division by zero is kept as it is
+                if (x.Value != 0 || exponent > 0) {
+                    m.Coefficient *= std::pow(x.Value, exponent);
+                    return;
+                }
+                break;
+            }
+            case NodeType::Variable: {
+                // the weight goes to the coefficient, the factor is the variable itself
+                if (x.Value != 0 || exponent > 0) {
+                    m.Coefficient *= std::pow(x.Value, exponent);
+                    m.Factors.push_back({ Variable(x.HashValue, 1), exponent });
+                    return;
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            m.Factors.push_back({ e, exponent });
+        }
+
+        // combines the powers of equal factors (eg. x * x = x^2, x / x = 1)
+        Monomial Merge(Monomial m) const
+        {
+            auto& factors = m.Factors;
+            std::stable_sort(factors.begin(), factors.end(), [&](const auto& a, const auto& b) { return pool[a.Expr].Key < pool[b.Expr].Key; });
+            size_t n = 0;
+            for (size_t i = 0; i < factors.size(); ++i) {
+                if (n > 0 && pool[factors[n - 1].Expr].Key == pool[factors[i].Expr].Key) {
+                    factors[n - 1].Exponent += factors[i].Exponent;
+                } else {
+                    factors[n++] = factors[i];
+                }
+            }
+            factors.resize(n);
+            factors.erase(std::remove_if(factors.begin(), factors.end(), [](const auto& f) { return f.Exponent == 0; }), factors.end());
+
+            std::vector<Operon::Hash> keys;
+            keys.reserve(2 * factors.size());
+            for (const auto& f : factors) {
+                keys.push_back(pool[f.Expr].Key);
+                keys.push_back(static_cast<Operon::Hash>(f.Exponent));
+            }
+            m.Key = xxh::xxhash3<Operon::HashBits>(keys);
+            return m;
+        }
+
+        int Power(int e, int exponent)
+        {
+            if (exponent == 1) {
+                return e;
+            }
+            if (exponent % 2 == 0) {
+                return Make(NodeType::Square, { Power(e, exponent / 2) });
+            }
+            return Make(NodeType::Mul, { e, Power(e, exponent - 1) });
+        }
+
+        int BuildProduct(const Monomial& m)
+        {
+            auto coefficient = m.Coefficient;
+            if (m.Factors.empty() || coefficient == 0) {
+                return Constant(coefficient);
+            }
+
+            // the coefficient becomes the weight of a variable, preferably one that is not raised to a power
+            // (eg. 4 * x^2 = (2x)^2)
+            auto absorbs = [&](const Factor& f) {
+                return pool[f.Expr].Type == NodeType::Variable && f.Exponent > 0 && (coefficient > 0 || f.Exponent % 2 == 1);
+            };
+            auto weighted = m.Factors.end();
+            if (coefficient != 1) {
+                weighted = std::find_if(m.Factors.begin(), m.Factors.end(), [&](const auto& f) { return absorbs(f) && f.Exponent == 1; });
+                if (weighted == m.Factors.end()) {
+                    weighted = std::find_if(m.Factors.begin(), m.Factors.end(), absorbs);
+                }
+            }
+
+            std::vector<int> numerator;
+            std::vector<int> denominator;
+            for (auto it = m.Factors.begin(); it != m.Factors.end(); ++it) {
+                if (it->Exponent < 0) {
+                    denominator.push_back(Power(it->Expr, -it->Exponent));
+                    continue;
+                }
+                if (it == weighted) {
+                    auto weight = std::copysign(std::pow(std::abs(coefficient), 1.0 / it->Exponent), coefficient);
+                    numerator.push_back(Power(Variable(pool[it->Expr].HashValue, weight), it->Exponent));
+                    coefficient = 1;
+                    continue;
+                }
+                numerator.push_back(Power(it->Expr, it->Exponent));
+            }
+            if (coefficient != 1 || numerator.empty()) {
+                numerator.insert(numerator.begin(), Constant(coefficient));
+            }
+
+            auto product = [&](const std::vector<int>& factors) {
+                auto e = factors.front();
+                for (size_t i = 1; i < factors.size(); ++i) {
+                    e = Make(NodeType::Mul, { e, factors[i] });
+                }
+                return e;
+            };
+            auto e = product(numerator);
+            return denominator.empty() ? e : Make(NodeType::Div, { e, product(denominator) });
+        }
+
+        int BuildSum(std::vector<Monomial> terms)
+        {
+            // combines like terms (eg. 2x + 3x = 5x, x - x = 0)
+            std::vector<Monomial> merged;
+            merged.reserve(terms.size());
+            for (auto& t : terms) {
+                auto it = std::find_if(merged.begin(), merged.end(), [&](const auto& m) { return m.Key == t.Key; });
+                if (it == merged.end()) {
+                    merged.push_back(std::move(t));
+                } else {
+                    it->Coefficient += t.Coefficient;
+                }
+            }
+            merged.erase(std::remove_if(merged.begin(), merged.end(), [](const auto& m) { return m.Coefficient == 0; }), merged.end());
+            if (merged.empty()) {
+                return Constant(0);
+            }
+
+            // the negative terms are subtracted at the end
+            std::stable_partition(merged.begin(), merged.end(), [](const auto& m) { return !(m.Coefficient < 0); });
+            auto e = BuildProduct(merged.front());
+            for (size_t i = 1; i < merged.size(); ++i) {
+                auto t = merged[i];
+                if (t.Coefficient < 0) {
+                    t.Coefficient = -t.Coefficient;
+                    e = Make(NodeType::Sub, { e, BuildProduct(t) });
+                } else {
+                    e = Make(NodeType::Add, { e, BuildProduct(t) });
+                }
+            }
+            return e;
+        }
+
+        const std::vector<Node>& nodes;
+        std::vector<Expr> pool;
+    };
+} // namespace
+
+Tree& Tree::Simplify()
+{
+    if (Empty()) {
+        return *this;
+    }
+    // the nodes are only read, so they are not copied if they are shared
+    Simplifier simplifier(std::as_const(*this).Nodes());
+    auto root = simplifier.Simplify(Length() - 1);
+
+    std::vector<Node> simplified;
+    simplified.reserve(Length());
+    simplifier.Emit(root, simplified);
+    *this = Tree(std::move(simplified));
+    return this->UpdateNodes();
+}
+
+Tree Simplify(Tree tree, const Dataset& dataset, Range range, Operon::Scalar tolerance)
+{
+    tree.Simplify();
+    const auto& nodes = tree.Nodes();
+    if (nodes.empty() || range.Size() == 0) {
+        return tree;
+    }
+
+    // the values of every subtree
+    Eigen::Array<Operon::Scalar, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor> values(range.Size(), nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        auto subtree = gsl::span<const Node>(nodes).subspan(i - nodes[i].Length, nodes[i].Length + 1);
+        Evaluate<Operon::Scalar>(subtree, dataset, range, nullptr, gsl::span<Operon::Scalar>(values.col(i).data(), range.Size()));
+    }
+
+    auto close = [&](Operon::Scalar a, Operon::Scalar b) {
+        return std::isfinite(a) && std::isfinite(b) && std::abs(a - b) <= tolerance * std::max({ Operon::Scalar { 1 }, std::abs(a), std::abs(b) });
+    };
+
+    std::vector<Node> pruned;
+    pruned.reserve(nodes.size());
+    auto prune = [&](gsl::index i, auto&& prune) -> void {
+        const auto& s = nodes[i];
+        if (s.IsLeaf()) {
+            pruned.push_back(s);
+            return;
+        }
+        auto col = values.col(i);
+        auto mean = col.mean();
+        if (std::all_of(col.data(), col.data() + col.size(), [&](auto v) { return close(v, mean); })) {
+            auto constant = Node(NodeType::Constant);
+            constant.Value = mean;
+            pruned.push_back(constant);
+            return;
+        }
+        std::vector<gsl::index> children;
+        for (gsl::index j = i - 1, k = 0; k < s.Arity; ++k, j -= nodes[j].Length + 1) {
+            auto child = values.col(j);
+            bool same = true;
+            for (Eigen::Index r = 0; same && r < col.size(); ++r) {
+                same = close(col(r), child(r));
+            }
+            if (same) {
+                prune(j, prune);
+                return;
+            }
+            children.push_back(j);
+        }
+        // the children in postfix order
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            prune(*it, prune);
+        }
+        pruned.push_back(s);
+    };
+    prune(nodes.size() - 1, prune);
+
+    Tree result(std::move(pruned));
+    result.UpdateNodes().Simplify();
+    return result;
+}
+} // namespace Operon
@@ -0,0 +1,172 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+
+#include "core/stream.hpp"
+
+namespace Operon {
+namespace {
+    Dataset FirstRows(const std::string& file, size_t count, bool hasHeader)
+    {
+        Dataset::Cursor cursor;
+        return Dataset::ReadRows(file, cursor, count, hasHeader);
+    }
+}
+
+DatasetStream::DatasetStream(std::string fileName, size_t chunk, size_t d, bool header)
+    : file(std::move(fileName))
+    , chunkRows(chunk)
+    , depth(std::max(d, size_t { 1 }))
+    , hasHeader(header)
+    , sample(FirstRows(file, chunk, header))
+    , state(std::make_shared<State>())
+{
+    Expects(chunkRows > 0);
+    // count the rows with a first pass, which goes through the same bounded reader
+    try {
+        ForEach([&](const Dataset& ds, size_t) { rows += ds.Rows(); });
+    } catch (...) {
+        Stop(); // the destructor is not called if the constructor throws
+        throw;
+    }
+    passes = 0;
+}
+
+DatasetStream::~DatasetStream()
+{
+    Stop();
+}
+
+void DatasetStream::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        state->Stop = true;
+    }
+    state->Changed.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+    // the queued chunks release their slot under the mutex when they are destroyed, so they are moved out of the
+    // queue and destroyed after the mutex is unlocked. the reader has exited, so nothing is queued afterwards
+    decltype(state->Queue) queued;
+    {
+        std::lock_guard<std::mutex> lock(state->Mutex);
+        queued.swap(state->Queue);
+    }
+    queued.clear();
+}
+
+void DatasetStream::Read()
+{
+    auto s = state;
+    bool reserved = false; // a slot was taken for a chunk that has no deleter yet
+    try {
+        while (true) {
+            Dataset::Cursor cursor;
+            while (true) {
+                {
+                    // wait for a free slot before reading, so that at most depth chunks are in memory
+                    std::unique_lock<std::mutex> lock(s->Mutex);
+                    s->Changed.wait(lock, [&]() { return s->Stop || s->Live < depth; });
+                    if (s->Stop) {
+                        return;
+                    }
+                    ++s->Live;
+                    reserved = true;
+                }
+                auto ds = Dataset::ReadRows(file, cursor, chunkRows, hasHeader);
+                size_t bytes = ds.Rows() * ds.Cols() * sizeof(Operon::Scalar);
+                auto release = [s, bytes](const Dataset* p) {
+                    delete p;
+                    {
+                        std::lock_guard<std::mutex> lock(s->Mutex);
+                        --s->Live;
+                        s->Bytes -= bytes;
+                    }
+                    s->Changed.notify_all();
+                };
+                bool end = ds.Rows() == 0;
+                auto p = end ? nullptr : new Dataset(std::move(ds));
+                reserved = false; // the deleter releases the slot from now on
+                std::shared_ptr<const Dataset> chunk(p, release);
+                {
+                    std::lock_guard<std::mutex> lock(s->Mutex);
+                    s->Bytes += bytes;
+                    s->Peak = std::max(s->Peak, s->Bytes);
+                    // an empty chunk marks the end of the pass, its slot is released right away
+                    s->Queue.push_back(end ? nullptr : std::move(chunk));
+                }
+                s->Changed.notify_all();
+                if (end) {
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(s->Mutex);
+            if (reserved) {
+                --s->Live;
+            }
+            s->Error = std::current_exception();
+            s->Queue.push_back(nullptr);
+        }
+        s->Changed.notify_all();
+    }
+}
+
+void DatasetStream::ForEach(std::function<void(const Dataset&, size_t)> f)
+{
+    if (!reader.joinable()) {
+        // a new reader starts from the beginning of the file
+        {
+            std::lock_guard<std::mutex> lock(state->Mutex);
+            state->Stop = false;
+            state->Error = nullptr;
+        }
+        reader = std::thread(&DatasetStream::Read, this);
+    }
+    try {
+        size_t start = 0;
+        while (true) {
+            std::shared_ptr<const Dataset> chunk;
+            {
+                std::unique_lock<std::mutex> lock(state->Mutex);
+                state->Changed.wait(lock, [&]() { return !state->Queue.empty(); });
+                chunk = std::move(state->Queue.front());
+                state->Queue.pop_front();
+                if (!chunk && state->Error) {
+                    std::rethrow_exception(state->Error);
+                }
+            }
+            if (!chunk) {
+                break;
+            }
+            f(*chunk, start);
+            start += chunk->Rows();
+        }
+    } catch (...) {
+        // the pass is abandoned (the reader failed or f threw): the reader is stopped and its queued chunks are
+        // discarded, so that the next call does not see the rest of this pass and starts again from the beginning
+        Stop();
+        throw;
+    }
+    ++passes;
+}
+} // namespace Operon
@@ -30,9 +30,9 @@
 #include "core/tree.hpp"
 
 namespace Operon {
-Tree& Tree::UpdateNodes()
+void UpdateNodes(gsl::span<Node> nodes)
 {
-    for (size_t i = 0; i < nodes.size(); ++i) {
+    for (gsl::index i = 0; i < static_cast<gsl::index>(nodes.size()); ++i) {
         auto& s = nodes[i];
 
         s.Depth = 1;
@@ -41,20 +41,41 @@ Tree& Tree::UpdateNodes()
             s.Arity = s.Length = 0;
             continue;
         }
-        for (auto it = Children(i); it.HasNext(); ++it) {
-            s.Length += it->Length;
-            if (s.Depth < it->Depth) {
-                s.Depth = it->Depth;
+        // the children are found by skipping over the subtrees of the previous children
+        for (gsl::index j = i - 1, k = 0; k < s.Arity; ++k, j -= nodes[j].Length + 1) {
+            s.Length += nodes[j].Length;
+            if (s.Depth < nodes[j].Depth) {
+                s.Depth = nodes[j].Depth;
             }
-            nodes[it.Index()].Parent = i;
+            nodes[j].Parent = i;
         }
         ++s.Depth;
     }
+}
+
+Tree& Tree::UpdateNodes()
+{
+    Operon::UpdateNodes(Nodes());
+    return *this;
+}
+
+// recomputes the depths (subtree heights) from the arities and lengths, without changing the other node fields
+Tree& Tree::UpdateNodeDepth()
+{
+    auto& nodes = Nodes();
+    for (gsl::index i = 0; i < static_cast<gsl::index>(nodes.size()); ++i) {
+        auto& s = nodes[i];
+        s.Depth = 1;
+        for (gsl::index j = i - 1, k = 0; k < s.Arity; ++k, j -= nodes[j].Length + 1) {
+            s.Depth = std::max<uint16_t>(s.Depth, nodes[j].Depth + 1);
+        }
+    }
     return *this;
 }
 
 Tree& Tree::Reduce()
 {
+    auto& nodes = Nodes();
     bool reduced = false;
     for (size_t i = 0; i < nodes.size(); ++i) {
         auto& s = nodes[i];
@@ -80,65 +101,194 @@ Tree& Tree::Reduce()
     return this->UpdateNodes();
 }
 
-Tree& Tree::Sort(Operon::HashMode mode)
+static inline void HashLeaf(Node& s, Operon::HashMode mode)
 {
-    // preallocate memory to reduce fragmentation
-    std::vector<Node> sorted;
-    sorted.reserve(nodes.size());
+    if (mode == Operon::HashMode::Strict) {
+        auto valueHash = xxh::xxhash3<Operon::HashBits>({ s.Value });
+        s.CalculatedHashValue = xxh::xxhash3<Operon::HashBits>({ s.HashValue, valueHash });
+    } else if (mode == Operon::HashMode::Relaxed) {
+        s.CalculatedHashValue = s.HashValue;
+    }
+}
 
-    std::vector<int> children;
-    children.reserve(nodes.size());
+namespace {
+    // buffers reused by Sort and SortPath, so that sorting does not allocate (once they are large enough)
+    struct SortWorkspace {
+        std::vector<gsl::index> Children;
+        std::vector<Operon::Hash> Hashes;
+        std::vector<uint16_t> Position;
+        std::vector<Node> Nodes;
+    };
 
-    std::vector<Operon::Hash> hashes;
-    hashes.reserve(nodes.size());
+    SortWorkspace& Workspace()
+    {
+        thread_local SortWorkspace workspace;
+        return workspace;
+    }
 
-    auto start = nodes.begin();
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        auto& s = nodes[i];
+    // lists the children of node i from right to left (the order in which they are found)
+    inline void GetChildren(gsl::span<const Node> nodes, gsl::index i, std::vector<gsl::index>& children)
+    {
+        children.clear();
+        for (gsl::index j = i - 1, k = 0; k < nodes[i].Arity; ++k, j -= nodes[j].Length + 1) {
+            children.push_back(j);
+        }
+    }
 
-        if (s.IsLeaf()) {
-            if (mode == Operon::HashMode::Strict) {
-                auto valueHash = xxh::xxhash3<Operon::HashBits>({ s.Value });
-                s.CalculatedHashValue = xxh::xxhash3<Operon::HashBits>({ s.HashValue, valueHash });
-            } else if (mode == Operon::HashMode::Relaxed) {
-                s.CalculatedHashValue = s.HashValue;
+    // orders the children (listed right to left) of a commutative node in their canonical order, from left to
+    // right. returns false if they were out of order
+    inline bool OrderChildren(gsl::span<const Node> nodes, std::vector<gsl::index>& children)
+    {
+        if (children.size() == 2) {
+            // the common case
+            auto ordered = !(nodes[children[0]] < nodes[children[1]]);
+            if (ordered) {
+                std::swap(children[0], children[1]);
             }
-            continue;
+            return ordered;
         }
+        auto ordered = std::is_sorted(children.begin(), children.end(), [&](auto a, auto b) { return nodes[b] < nodes[a]; });
+        std::sort(children.begin(), children.end(), [&](auto a, auto b) { return nodes[a] < nodes[b]; });
+        return ordered;
+    }
 
-        auto arity = s.Arity;
-        auto size = s.Length;
-        auto sBegin = start + i - size;
-        auto sEnd = start + i;
+    // the hash value of a function node combines the hash values of its children (given from left to right) with
+    // its own hash value. the children already account for their descendants, so the cost is linear in the arity
+    inline Operon::Hash HashNode(gsl::span<const Node> nodes, const Node& s, const std::vector<gsl::index>& children, std::vector<Operon::Hash>& hashes)
+    {
+        hashes.clear();
+        for (auto c : children) {
+            hashes.push_back(nodes[c].CalculatedHashValue);
+        }
+        hashes.push_back(s.HashValue);
+        return xxh::xxhash3<Operon::HashBits>(hashes.data(), hashes.size() * sizeof(Operon::Hash));
+    }
+} // namespace
 
-        if (s.IsCommutative()) {
-            if (arity == size) {
-                std::sort(sBegin, sEnd);
-            } else {
-                for (auto it = Children(i); it.HasNext(); ++it) {
-                    children.push_back(it.Index());
-                }
-                std::sort(children.begin(), children.end(), [&](int a, int b) { return nodes[a] < nodes[b]; }); // sort child indices
+void SortPath(gsl::span<Node> nodes, gsl::index i, Operon::HashMode mode)
+{
+    auto& ws = Workspace();
+    auto& children = ws.Children;
+    auto& sorted = ws.Nodes;
 
+    bool moved = false;
+    gsl::index root = nodes.size() - 1;
+    for (;;) {
+        auto& s = nodes[i];
+        if (s.IsLeaf()) {
+            HashLeaf(s, mode);
+        } else {
+            GetChildren(nodes, i, children);
+            // only one child changed, so the children are reordered only if it is out of place
+            if (s.IsCommutative() && !std::is_sorted(children.begin(), children.end(), [&](auto a, auto b) { return nodes[b] < nodes[a]; })) {
+                std::stable_sort(children.begin(), children.end(), [&](auto a, auto b) { return nodes[a] < nodes[b]; });
+                sorted.clear();
                 for (auto j : children) {
-                    auto& c = nodes[j];
-                    std::copy_n(start + j - c.Length, c.Length + 1, std::back_inserter(sorted));
+                    std::copy_n(nodes.begin() + j - nodes[j].Length, nodes[j].Length + 1, std::back_inserter(sorted));
                 }
-                std::copy(sorted.begin(), sorted.end(), sBegin);
-                sorted.clear();
-                children.clear();
+                std::copy(sorted.begin(), sorted.end(), nodes.begin() + i - s.Length);
+                moved = true;
+                GetChildren(nodes, i, children);
             }
+            std::reverse(children.begin(), children.end());
+            s.CalculatedHashValue = HashNode(nodes, s, children, ws.Hashes);
         }
-        std::transform(sBegin, sEnd, std::back_inserter(hashes), [](const Node& x) { return x.CalculatedHashValue; });
-        hashes.push_back(s.HashValue);
-        s.CalculatedHashValue = xxh::xxhash3<Operon::HashBits>(hashes);
-        hashes.clear();
+        if (i == root) {
+            break;
+        }
+        // the index of the parent does not change when its children are reordered
+        i = s.Parent;
     }
-    return this->UpdateNodes();
+    // the subtrees that moved need their parent indices updated
+    if (moved) {
+        UpdateNodes(nodes);
+    }
+}
+
+static void Permute(gsl::span<Node> nodes, SortWorkspace& ws)
+{
+    auto& children = ws.Children;
+    auto& position = ws.Position;
+    gsl::index n = nodes.size();
+    position.resize(n);
+    position[n - 1] = n - 1;
+    for (gsl::index i = n - 1; i >= 0; --i) {
+        const auto& s = nodes[i];
+        if (s.IsLeaf()) {
+            continue;
+        }
+        GetChildren(nodes, i, children);
+        if (s.IsCommutative()) {
+            OrderChildren(nodes, children);
+        } else {
+            std::reverse(children.begin(), children.end());
+        }
+        auto start = position[i] - s.Length;
+        for (auto c : children) {
+            start += nodes[c].Length;
+            position[c] = start++;
+        }
+    }
+
+    auto& buffer = ws.Nodes;
+    buffer.resize(n);
+    for (gsl::index i = 0; i < n; ++i) {
+        buffer[position[i]] = nodes[i];
+    }
+    std::copy(buffer.begin(), buffer.end(), nodes.begin());
+}
+
+void Sort(gsl::span<Node> nodes, Operon::HashMode mode)
+{
+    if (nodes.empty()) {
+        return;
+    }
+    auto& ws = Workspace();
+    auto& children = ws.Children;
+    gsl::index n = nodes.size();
+
+    // bottom-up: hash every node, taking the children of commutative nodes in their canonical order, which does not
+    // require moving them
+    bool ordered = true;
+    for (gsl::index i = 0; i < n; ++i) {
+        auto& s = nodes[i];
+        if (s.IsLeaf()) {
+            HashLeaf(s, mode);
+            continue;
+        }
+        GetChildren(nodes, i, children);
+        if (s.IsCommutative()) {
+            ordered &= OrderChildren(nodes, children);
+        } else {
+            std::reverse(children.begin(), children.end());
+        }
+        s.CalculatedHashValue = HashNode(nodes, s, children, ws.Hashes);
+    }
+
+    // top-down: the position of every node in the canonical order (unless the tree is in canonical order already).
+    // a subtree keeps its extent, so the children of a node are laid out one after the other, starting where its
+    // subtree starts. the nodes are then moved in a single pass
+    if (!ordered) {
+        Permute(nodes, ws);
+    }
+    UpdateNodes(nodes);
+}
+
+Tree& Tree::Sort(gsl::index i, Operon::HashMode mode)
+{
+    SortPath(Nodes(), i, mode);
+    return *this;
+}
+
+Tree& Tree::Sort(Operon::HashMode mode)
+{
+    Operon::Sort(Nodes(), mode);
+    return *this;
 }
 
 std::vector<gsl::index> Tree::ChildIndices(gsl::index i) const
 {
+    const auto& nodes = Nodes();
     if (nodes[i].IsLeaf()) {
         return std::vector<gsl::index> {};
     }
@@ -151,6 +301,7 @@ std::vector<gsl::index> Tree::ChildIndices(gsl::index i) const
 
 std::vector<double> Tree::GetCoefficients() const
 {
+    const auto& nodes = Nodes();
     std::vector<double> coefficients;
     for (auto& s : nodes) {
         if (s.IsConstant() || s.IsVariable()) {
@@ -162,6 +313,7 @@ std::vector<double> Tree::GetCoefficients() const
 
 void Tree::SetCoefficients(const std::vector<double>& coefficients)
 {
+    auto& nodes = Nodes();
     size_t idx = 0;
     for (auto& s : nodes) {
         if (s.IsConstant() || s.IsVariable()) {
@@ -172,11 +324,12 @@ void Tree::SetCoefficients(const std::vector<double>& coefficients)
 
 size_t Tree::Depth() const noexcept
 {
-    return nodes.back().Depth;
+    return Nodes().back().Depth;
 }
 
 size_t Tree::VisitationLength() const noexcept
 {
+    const auto& nodes = Nodes();
     return std::transform_reduce(std::execution::unseq, nodes.begin(), nodes.end(), 0UL, std::plus<> {}, [](const auto& node) { return node.Length + 1; });
 }
 
@@ -188,7 +341,7 @@ size_t Tree::Level(gsl::index i) const noexcept
 
     size_t level = 0;
     while (i < root) {
-        i = nodes[i].Parent;
+        i = Nodes()[i].Parent;
         ++level;
     }
     return level;
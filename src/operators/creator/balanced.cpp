@@ -30,12 +30,11 @@ namespace Operon {
             targetLen = std::bernoulli_distribution(0.5)(random) ? targetLen - 1 : targetLen + 1;
         }
 
-        std::uniform_int_distribution<size_t> uniformInt(0, variables_.size() - 1);
         std::normal_distribution<double> normalReal(0, 1);
         auto init = [&](Node& node) {
             if (node.IsLeaf()) {
                 if (node.IsVariable()) {
-                    node.HashValue = variables_[uniformInt(random)].Hash;
+                    node.HashValue = sampler_(random);
                     node.CalculatedHashValue = node.HashValue; 
                 }
                 node.Value = normalReal(random);
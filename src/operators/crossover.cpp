@@ -20,17 +20,19 @@
 #include "operators/crossover.hpp"
 
 namespace Operon {
-static gsl::index SelectRandomBranch(Operon::Random& random, const Tree& tree, double internalProb, size_t maxBranchDepth, size_t maxBranchLength)
+// the node accessors (leaf flag, subtree length and depth) let this work on both tree representations
+template <typename IsLeaf, typename Length, typename Depth>
+static gsl::index SelectRandomBranch(Operon::Random& random, size_t size, IsLeaf isLeaf, Length length, Depth depth, double internalProb, size_t maxBranchDepth, size_t maxBranchLength)
 {
     auto selectInternalNode = std::bernoulli_distribution(internalProb)(random);
-    const auto& nodes = tree.Nodes();
     // create a vector of indices where leafs are in the front and internal nodes in the back
-    std::vector<gsl::index> indices(nodes.size());
+    // (reused between calls, so that crossover does not allocate)
+    thread_local std::vector<gsl::index> indices;
+    indices.resize(size);
     size_t head = 0;
-    size_t tail = nodes.size() - 1;
-    for (size_t i = 0; i < nodes.size(); ++i) {
-        const auto& node = nodes[i];
-        auto idx = node.IsLeaf() ? head++ : tail--;
+    size_t tail = size - 1;
+    for (size_t i = 0; i < size; ++i) {
+        auto idx = isLeaf(i) ? head++ : tail--;
         indices[idx] = i;
     }
     // if we want an internal node, we shuffle the corresponding part of the indices vector
@@ -39,9 +41,8 @@ static gsl::index SelectRandomBranch(Operon::Random& random, const Tree& tree, d
         std::shuffle(indices.begin() + head, indices.end(), random);
         for (size_t i = head; i < indices.size(); ++i) {
             auto idx = indices[i];
-            const auto& node = nodes[idx];
 
-            if (node.Length + 1u > maxBranchLength || node.Depth > maxBranchDepth) {
+            if (length(idx) + 1u > maxBranchLength || depth(idx) > maxBranchDepth) {
                 continue;
             }
 
@@ -54,20 +55,75 @@ static gsl::index SelectRandomBranch(Operon::Random& random, const Tree& tree, d
     return indices[idx];
 }
 
-std::pair<gsl::index, gsl::index> SubtreeCrossover::FindCompatibleSwapLocations(Operon::Random& random, const Tree& lhs, const Tree& rhs) const
+static gsl::index SelectRandomBranch(Operon::Random& random, gsl::span<const Node> nodes, double internalProb, size_t maxBranchDepth, size_t maxBranchLength)
+{
+    return SelectRandomBranch(
+        random, nodes.size(), [&](auto i) { return nodes[i].IsLeaf(); }, [&](auto i) { return nodes[i].Length; }, [&](auto i) { return nodes[i].Depth; }, internalProb, maxBranchDepth, maxBranchLength);
+}
+
+static gsl::index SelectRandomBranch(Operon::Random& random, const CompactTree& tree, gsl::span<const uint16_t> depths, double internalProb, size_t maxBranchDepth, size_t maxBranchLength)
+{
+    return SelectRandomBranch(
+        random, tree.Length(), [&](auto i) { return tree[i].IsLeaf(); }, [&](auto i) { return tree[i].Length; }, [&](auto i) { return depths[i]; }, internalProb, maxBranchDepth, maxBranchLength);
+}
+
+// distance of node i to the root (see Tree::Level)
+static size_t Level(gsl::span<const Node> nodes, gsl::index i)
+{
+    gsl::index root = nodes.size() - 1;
+    size_t level = 0;
+    while (i < root) {
+        i = nodes[i].Parent;
+        ++level;
+    }
+    return level;
+}
+
+std::pair<gsl::index, gsl::index> SubtreeCrossover::FindCompatibleSwapLocations(Operon::Random& random, gsl::span<const Node> lhs, gsl::span<const Node> rhs) const
 {
     auto i = SelectRandomBranch(random, lhs, internalProbability, maxDepth, maxLength);
-    size_t maxBranchDepth    = maxDepth - lhs.Level(i);
-    size_t partialTreeLength = (lhs.Length() - (lhs[i].Length + 1));
+    size_t maxBranchDepth    = maxDepth - Level(lhs, i);
+    size_t partialTreeLength = (lhs.size() - (lhs[i].Length + 1));
     size_t maxBranchLength   = maxLength - partialTreeLength;
 
     auto j = SelectRandomBranch(random, rhs, internalProbability, maxBranchDepth, maxBranchLength);
     return std::make_pair(i, j);
 }
 
+std::pair<gsl::index, gsl::index> SubtreeCrossover::FindCompatibleSwapLocations(Operon::Random& random, const Tree& lhs, const Tree& rhs) const
+{
+    return FindCompatibleSwapLocations(random, gsl::span<const Node>(lhs.Nodes()), gsl::span<const Node>(rhs.Nodes()));
+}
+
 Tree SubtreeCrossover::operator()(Operon::Random& random, const Tree& lhs, const Tree& rhs) const
 {
     auto [i, j] = FindCompatibleSwapLocations(random, lhs, rhs);
-    return Cross(lhs, rhs, i, j);
+    auto child = Cross(lhs, rhs, i, j);
+    if (hashMode) {
+        child.Sort(SwapIndex(lhs.Nodes(), rhs.Nodes(), i, j), *hashMode);
+    }
+    return child;
+}
+
+gsl::span<Node> SubtreeCrossover::operator()(Operon::Random& random, gsl::span<const Node> lhs, gsl::span<const Node> rhs, PopulationArena& arena, gsl::index slot) const
+{
+    auto [i, j] = FindCompatibleSwapLocations(random, lhs, rhs);
+    auto child = arena.Allocate(slot, lhs.size() - lhs[i].Length + rhs[j].Length);
+    Cross(lhs, rhs, i, j, child);
+    if (hashMode) {
+        SortPath(child, SwapIndex(lhs, rhs, i, j), *hashMode);
+    }
+    return child;
+}
+
+CompactTree SubtreeCrossover::operator()(Operon::Random& random, const CompactTree& lhs, const CompactTree& rhs) const
+{
+    auto i = SelectRandomBranch(random, lhs, lhs.Depths(), internalProbability, maxDepth, maxLength);
+    size_t maxBranchDepth    = maxDepth - lhs.Level(i);
+    size_t partialTreeLength = (lhs.Length() - (lhs[i].Length + 1));
+    size_t maxBranchLength   = maxLength - partialTreeLength;
+
+    auto j = SelectRandomBranch(random, rhs, rhs.Depths(), internalProbability, maxBranchDepth, maxBranchLength);
+    return CompactTree::Cross(lhs, rhs, i, j);
 }
 }
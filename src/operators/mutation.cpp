@@ -22,8 +22,12 @@
 namespace Operon {
 Tree OnePointMutation::operator()(Operon::Random& random, Tree tree) const
 {
-    auto& nodes = tree.Nodes();
+    (*this)(random, gsl::span<Node>(tree.Nodes()));
+    return tree;
+}
 
+void OnePointMutation::operator()(Operon::Random& random, gsl::span<Node> nodes) const
+{
     auto leafCount = std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsLeaf(); });
     std::uniform_int_distribution<gsl::index> uniformInt(1, leafCount);
     auto index = uniformInt(random);
@@ -35,23 +39,53 @@ Tree OnePointMutation::operator()(Operon::Random& random, Tree tree) const
     }
 
     std::normal_distribution<double> normalReal(0, 1);
-    tree[i].Value += normalReal(random);
+    nodes[i].Value += normalReal(random);
+    UpdateHashes(nodes, i);
+}
+
+CompactTree OnePointMutation::operator()(Operon::Random& random, CompactTree tree) const
+{
+    // the coefficients are exactly the leaves
+    auto coefficients = tree.Coefficients();
+    std::uniform_int_distribution<gsl::index> uniformInt(1, coefficients.size());
+    auto index = uniformInt(random);
+
+    std::normal_distribution<double> normalReal(0, 1);
+    coefficients[index - 1] += normalReal(random);
 
     return tree;
 }
 
 Tree MultiPointMutation::operator()(Operon::Random& random, Tree tree) const
+{
+    (*this)(random, gsl::span<Node>(tree.Nodes()));
+    return tree;
+}
+
+void MultiPointMutation::operator()(Operon::Random& random, gsl::span<Node> nodes) const
 {
     std::normal_distribution<double> normalReal(0, 1);
-    for (auto& node : tree.Nodes()) {
+    for (auto& node : nodes) {
         if (node.IsLeaf()) {
             node.Value += normalReal(random);
         }
     }
+    // all the leaves changed, the relaxed hash values do not depend on their values
+    if (hashMode == Operon::HashMode::Strict) {
+        Sort(nodes, *hashMode);
+    }
+}
+
+CompactTree MultiPointMutation::operator()(Operon::Random& random, CompactTree tree) const
+{
+    std::normal_distribution<double> normalReal(0, 1);
+    for (auto& c : tree.Coefficients()) {
+        c += normalReal(random);
+    }
     return tree;
 }
 
-Tree MultiMutation::operator()(Operon::Random& random, Tree tree) const
+const MutatorBase& MultiMutation::Select(Operon::Random& random) const
 {
     //auto i = std::discrete_distribution<gsl::index>(probabilities.begin(), probabilities.end())(random);
     auto sum = std::reduce(std::execution::unseq, probabilities.begin(), probabilities.end());
@@ -64,14 +98,32 @@ Tree MultiMutation::operator()(Operon::Random& random, Tree tree) const
             break;
         }
     }
-    auto op = operators[i];
-    return op(random, std::move(tree));
+    return operators[i];
+}
+
+Tree MultiMutation::operator()(Operon::Random& random, Tree tree) const
+{
+    return Select(random)(random, std::move(tree));
+}
+
+CompactTree MultiMutation::operator()(Operon::Random& random, CompactTree tree) const
+{
+    return Select(random)(random, std::move(tree));
+}
+
+void MultiMutation::operator()(Operon::Random& random, gsl::span<Node> nodes) const
+{
+    Select(random)(random, nodes);
 }
 
 Tree ChangeVariableMutation::operator()(Operon::Random& random, Tree tree) const
 {
-    auto& nodes = tree.Nodes();
+    (*this)(random, gsl::span<Node>(tree.Nodes()));
+    return tree;
+}
 
+void ChangeVariableMutation::operator()(Operon::Random& random, gsl::span<Node> nodes) const
+{
     auto leafCount = std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsLeaf(); });
     std::uniform_int_distribution<gsl::index> uniformInt(1, leafCount);
     auto index = uniformInt(random);
@@ -82,18 +134,44 @@ Tree ChangeVariableMutation::operator()(Operon::Random& random, Tree tree) const
             break;
     }
 
-    std::uniform_int_distribution<gsl::index> normalInt(0, variables.size() - 1);
-    tree[i].HashValue = tree[i].CalculatedHashValue = variables[normalInt(random)].Hash;
+    nodes[i].HashValue = nodes[i].CalculatedHashValue = sampler(random);
+    UpdateHashes(nodes, i);
+}
+
+CompactTree ChangeVariableMutation::operator()(Operon::Random& random, CompactTree tree) const
+{
+    auto leafCount = tree.Coefficients().size();
+    std::uniform_int_distribution<gsl::index> uniformInt(1, leafCount);
+    auto index = uniformInt(random);
+
+    size_t i = 0;
+    size_t variable = 0;
+    for (; i < tree.Length(); ++i) {
+        if (tree[i].IsLeaf() && --index == 0)
+            break;
+        variable += tree[i].IsVariable();
+    }
+
+    // as above, the variable is sampled even if the leaf is a constant (which keeps its value)
+    auto hash = sampler(random);
+    if (tree[i].IsVariable()) {
+        tree.Variables()[variable] = hash;
+    }
 
     return tree;
 }
 
 Tree ChangeFunctionMutation::operator()(Operon::Random& random, Tree tree) const {
-    auto& nodes = tree.Nodes();
+    (*this)(random, gsl::span<Node>(tree.Nodes()));
+    return tree;
+}
+
+void ChangeFunctionMutation::operator()(Operon::Random& random, gsl::span<Node> nodes) const
+{
     auto funcCount = std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return !node.IsLeaf(); });
 
     if (funcCount == 0) {
-        return tree;
+        return;
     }
 
     std::uniform_int_distribution<gsl::index> uniformInt(1, funcCount);
@@ -104,7 +182,31 @@ Tree ChangeFunctionMutation::operator()(Operon::Random& random, Tree tree) const
         if (!nodes[i].IsLeaf() && --index == 0)
             break;
     }
-    nodes[i].Type = grammar.SampleRandomSymbol(random, nodes[i].Arity, nodes[i].Arity).Type;
+    auto type = grammar.SampleRandomSymbol(random, nodes[i].Arity, nodes[i].Arity).Type;
+    // the hash value of a function node is given by its type
+    nodes[i].Type = type;
+    nodes[i].HashValue = nodes[i].CalculatedHashValue = static_cast<Operon::Hash>(type);
+    UpdateHashes(nodes, i);
+}
+
+CompactTree ChangeFunctionMutation::operator()(Operon::Random& random, CompactTree tree) const
+{
+    const auto& code = tree.Codes();
+    auto funcCount = std::count_if(code.begin(), code.end(), [](const auto& c) { return !c.IsLeaf(); });
+
+    if (funcCount == 0) {
+        return tree;
+    }
+
+    std::uniform_int_distribution<gsl::index> uniformInt(1, funcCount);
+    auto index = uniformInt(random);
+
+    size_t i = 0;
+    for (; i < code.size(); ++i) {
+        if (!code[i].IsLeaf() && --index == 0)
+            break;
+    }
+    tree.SetType(i, grammar.SampleRandomSymbol(random, code[i].Arity, code[i].Arity).Type);
     return tree;
 }
 
@@ -20,6 +20,8 @@
 
 #include "stat/pearson.hpp"
 
+#include <Eigen/Core>
+
 namespace Operon {
    
     void PearsonsRCalculator::Add(Operon::Scalar x, Operon::Scalar y) 
@@ -75,6 +77,48 @@ namespace Operon {
         sumY += y * w;
     }
 
+    void PearsonsRCalculator::Add(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y)
+    {
+        Expects(x.size() == y.size());
+        if (x.empty()) {
+            return;
+        }
+        Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>> xs(x.data(), x.size());
+        Eigen::Map<const Eigen::Array<Operon::Scalar, Eigen::Dynamic, 1>> ys(y.data(), y.size());
+        auto cx = (xs.cast<double>() - xs.cast<double>().mean()).eval();
+        auto cy = (ys.cast<double>() - ys.cast<double>().mean()).eval();
+
+        PearsonsRCalculator block;
+        block.sumWe = static_cast<double>(x.size());
+        block.sumX = xs.cast<double>().sum();
+        block.sumY = ys.cast<double>().sum();
+        block.sumXX = cx.square().sum();
+        block.sumYY = cy.square().sum();
+        block.sumXY = (cx * cy).sum();
+        Add(block);
+    }
+
+    void PearsonsRCalculator::Add(const PearsonsRCalculator& other)
+    {
+        if (other.sumWe <= 0.) {
+            return;
+        }
+        if (sumWe <= 0.) {
+            *this = other;
+            return;
+        }
+        // Difference of the means, scaled by both weights
+        double deltaX = other.sumX * sumWe - sumX * other.sumWe;
+        double deltaY = other.sumY * sumWe - sumY * other.sumWe;
+        double f = 1. / (sumWe * other.sumWe * (sumWe + other.sumWe));
+        sumXX += other.sumXX + f * deltaX * deltaX;
+        sumYY += other.sumYY + f * deltaY * deltaY;
+        sumXY += other.sumXY + f * deltaX * deltaY;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        sumWe += other.sumWe;
+    }
+
     double PearsonsRCalculator::Coefficient(gsl::span<const Operon::Scalar> x, gsl::span<const Operon::Scalar> y)
     {
         auto xdim = x.size();
@@ -120,10 +164,20 @@ namespace Operon {
         Expects(xdim == weights.size());
         // Inlined computation of Pearson correlation, to avoid allocating objects!
         // This is a numerically stabilized version, avoiding sum-of-squares.
-        double sumXX = 0., sumYY = 0., sumXY = 0., sumWe = weights[0];
-        double sumX = x[0] * sumWe, sumY = y[0] * sumWe;
-        for(size_t i = 1; i < xdim; ++i) {
+        double sumXX = 0., sumYY = 0., sumXY = 0., sumWe = 0.;
+        double sumX = 0., sumY = 0.;
+        for(size_t i = 0; i < xdim; ++i) {
             double xv = x[i], yv = y[i], w = weights[i];
+            // Skip zero weights (eg. rows left out of a bootstrap sample)
+            if (w == 0.) {
+                continue;
+            }
+            if (sumWe == 0.) {
+                sumWe = w;
+                sumX = xv * w;
+                sumY = yv * w;
+                continue;
+            }
             // Delta to previous mean
             double deltaX = xv * sumWe - sumX;
             double deltaY = yv * sumWe - sumY;
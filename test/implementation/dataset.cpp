@@ -0,0 +1,456 @@
+/* This file is part of:
+ * Operon - Large Scale Genetic Programming Framework
+ *
+ * Licensed under the ISC License <https://opensource.org/licenses/ISC> 
+ * Copyright (C) 2019 Bogdan Burlacu 
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE. 
+ */
+#include <catch2/catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+#include "core/dataset.hpp"
+#include "core/eval.hpp"
+#include "core/problem.hpp"
+#include "core/stream.hpp"
+
+namespace Operon {
+namespace Test {
+TEST_CASE("Binary dataset format", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    ds.Save("Poly-10.bin");
+
+    auto mapped = Dataset("Poly-10.bin");
+    REQUIRE(mapped.IsMapped());
+    REQUIRE(mapped.Dimensions() == ds.Dimensions());
+    REQUIRE(mapped.VariableNames() == ds.VariableNames());
+
+    for (const auto& v : ds.Variables()) {
+        REQUIRE(mapped.GetHashValue(v.Name) == v.Hash);
+        auto expected = ds.GetValues(v.Hash);
+        auto actual = mapped.GetValues(v.Hash);
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin(), actual.end()));
+        // columns start at aligned offsets
+        REQUIRE(reinterpret_cast<std::uintptr_t>(actual.data()) % Dataset::BinaryAlignment == 0);
+    }
+
+    // modifying the data detaches it from the file
+    auto copy = mapped;
+    copy.Standardize(0, Range { 0, 100 });
+    REQUIRE(!copy.IsMapped());
+    REQUIRE(mapped.IsMapped());
+    REQUIRE(mapped.Values()(0, 0) == ds.Values()(0, 0));
+
+    // a row count that would overflow the bounds check is rejected instead of reading past the file
+    {
+        std::fstream file("Poly-10.bin", std::ios::binary | std::ios::in | std::ios::out);
+        uint64_t rows = std::numeric_limits<uint64_t>::max() / 4;
+        file.seekp(16); // magic, version and reserved
+        file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+    }
+    REQUIRE_THROWS_WITH(Dataset("Poly-10.bin"), Catch::Contains("truncated data"));
+    std::remove("Poly-10.bin");
+}
+TEST_CASE("CSV parsing", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    REQUIRE(ds.Rows() == 500);
+    REQUIRE(ds.Cols() == 11);
+    REQUIRE(ds.GetValues("X1")[0] == Approx(-0.996123041491053));
+
+    {
+        std::ofstream out("malformed.csv");
+        out << "A,B\n1,2\n3,x\n";
+    }
+    REQUIRE_THROWS_WITH(Dataset("malformed.csv", true), Catch::Contains("line 3, column 2"));
+
+    // the blank lines count for the line numbers
+    {
+        std::ofstream out("malformed.csv");
+        out << "A,B\n1,2\n\n\n3,x\n";
+    }
+    REQUIRE_THROWS_WITH(Dataset("malformed.csv", true), Catch::Contains("line 5, column 2"));
+
+    // too few and too many fields
+    {
+        std::ofstream out("malformed.csv");
+        out << "A,B\n1,2\n3\n";
+    }
+    REQUIRE_THROWS_WITH(Dataset("malformed.csv", true), Catch::Contains("line 3 has 1 fields, expected 2"));
+    {
+        std::ofstream out("malformed.csv");
+        out << "A,B\n1,2\n3,4,5\n";
+    }
+    REQUIRE_THROWS_WITH(Dataset("malformed.csv", true), Catch::Contains("line 3 has 3 fields, expected 2"));
+
+    // the values end up in the right columns
+    {
+        std::ofstream out("wellformed.csv");
+        out << "A,B,C\n1,2,3\n\n4,5,6\n";
+    }
+    Dataset small("wellformed.csv", true);
+    REQUIRE(small.Rows() == 2);
+    REQUIRE(small.GetValues("B")[0] == 2);
+    REQUIRE(small.GetValues("B")[1] == 5);
+    REQUIRE(small.GetValues("C")[1] == 6);
+}
+TEST_CASE("Dataset views", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto copy = ds;
+    REQUIRE(ds.IsShared());
+    REQUIRE(copy.Values().data() == ds.Values().data());
+
+    // variable subset
+    auto subset = ds.View(std::vector<std::string> { "X1", "X2", "Y" });
+    REQUIRE(subset.Variables().size() == 3);
+    REQUIRE(subset.GetValues("X2").data() == ds.GetValues("X2").data());
+
+    // row selection, in reverse order
+    std::vector<gsl::index> indices(ds.Rows());
+    std::iota(indices.rbegin(), indices.rend(), 0);
+    auto reversed = ds.View(indices);
+    REQUIRE(!reversed.IsContiguous());
+    auto x1 = ds.GetValues("X1");
+    auto x1r = reversed.GetValues("X1");
+    REQUIRE(std::equal(x1.rbegin(), x1.rend(), x1r.begin(), x1r.end()));
+
+    std::vector<Operon::Scalar> buffer(10);
+    reversed.Load(ds.GetIndex(ds.GetHashValue("X1")), 0, buffer.size(), buffer.data());
+    REQUIRE(buffer.front() == x1.back());
+
+    // views of views index the storage directly
+    auto twice = reversed.View(indices);
+    auto x1t = twice.GetValues("X1");
+    REQUIRE(std::equal(x1.begin(), x1.end(), x1t.begin(), x1t.end()));
+
+    // copy-on-write
+    auto before = ds.GetValues("X1")[0];
+    copy.Standardize(copy.GetIndex(copy.GetHashValue("X1")), Range { 0, 100 });
+    REQUIRE(copy.Values().data() != ds.Values().data());
+    REQUIRE(ds.GetValues("X1")[0] == before);
+    REQUIRE(copy.GetValues("X1")[0] != before);
+}
+TEST_CASE("Encoded columns", "[implementation]")
+{
+    using Type = Dataset::StorageType;
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto encoded = ds;
+
+    // maximum absolute decoding error for each type, relative to the range of the column
+    std::vector<std::pair<Type, Operon::Scalar>> types {
+        { Type::Float32, 1e-6 }, { Type::Float16, 1e-3 }, { Type::BFloat16, 1e-2 }, { Type::Int16, 1e-4 }, { Type::Int8, 1e-2 }
+    };
+    for (size_t i = 0; i < types.size(); ++i) {
+        encoded.Encode(i, types[i].first);
+    }
+    REQUIRE(encoded.IsEncoded());
+    REQUIRE(!ds.IsEncoded());
+    // the other columns still refer to the full-precision storage, which is counted as a whole
+    REQUIRE(encoded.StorageBytes() > ds.StorageBytes());
+    REQUIRE(ds.IsShared());
+
+    // once every column is encoded, the full-precision storage is released
+    for (size_t i = types.size(); i < ds.Cols(); ++i) {
+        encoded.Encode(i, Type::Float32);
+    }
+    REQUIRE(!ds.IsShared());
+    REQUIRE(encoded.StorageBytes() < ds.StorageBytes());
+
+    for (size_t i = 0; i < types.size(); ++i) {
+        auto x = ds.GetValues(gsl::index(i));
+        auto y = encoded.GetValues(gsl::index(i));
+        auto [min, max] = std::minmax_element(x.begin(), x.end());
+        for (size_t j = 0; j < x.size(); ++j) {
+            REQUIRE(std::abs(x[j] - y[j]) <= types[i].second * (*max - *min));
+        }
+    }
+
+    SECTION("Load")
+    {
+        std::vector<float> buffer(64);
+        encoded.Load(4, 100, buffer.size(), buffer.data());
+        REQUIRE(buffer[0] == static_cast<float>(encoded.GetValues(gsl::index(4))[100]));
+    }
+
+    SECTION("Integer columns are exact")
+    {
+        // the values span less than the range of the type (they are shifted, but not scaled)
+        Dataset ints({ Variable { "A", 1, 0 } }, { { 1, 5, 200, 2, 7 } });
+        ints.Encode(0, Type::Int8);
+        auto values = ints.GetValues(gsl::index(0));
+        REQUIRE(std::vector<Operon::Scalar>(values.begin(), values.end()) == std::vector<Operon::Scalar> { 1, 5, 200, 2, 7 });
+
+        Dataset wide({ Variable { "A", 1, 0 } }, { { 1, 5, 300, 2, 7 } });
+        wide.Encode(0, Type::Int16);
+        values = wide.GetValues(gsl::index(0));
+        REQUIRE(std::vector<Operon::Scalar>(values.begin(), values.end()) == std::vector<Operon::Scalar> { 1, 5, 300, 2, 7 });
+    }
+
+    SECTION("Integer columns wider than the type are quantized")
+    {
+        std::vector<Operon::Scalar> expected { 1, 5, 300, 2, 7 };
+        Dataset wide({ Variable { "A", 1, 0 } }, { expected });
+        wide.Encode(0, Type::Int8);
+        auto values = wide.GetValues(gsl::index(0));
+        auto step = (300 - 1) / Operon::Scalar { 255 };
+        REQUIRE(values[0] == Approx(1));
+        REQUIRE(values[2] == Approx(300));
+        REQUIRE(values[1] != expected[1]);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            REQUIRE(std::abs(values[i] - expected[i]) <= step / 2 + 1e-9);
+        }
+    }
+
+    SECTION("Round trip")
+    {
+        auto file = "encoded.bin";
+        encoded.Save(file);
+        Dataset loaded(file);
+        REQUIRE(loaded.IsMapped());
+        for (size_t i = 0; i < types.size(); ++i) {
+            REQUIRE(loaded.GetStorageType(i) == types[i].first);
+            auto x = encoded.GetValues(gsl::index(i));
+            auto y = loaded.GetValues(gsl::index(i));
+            REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+        }
+        std::remove(file);
+    }
+}
+TEST_CASE("Tiled layout", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto tiled = ds;
+    tiled.Tile();
+    REQUIRE(tiled.IsTiled());
+    REQUIRE(!ds.IsTiled());
+
+    for (const auto& v : ds.Variables()) {
+        auto x = ds.GetValues(v.Index);
+        auto y = tiled.GetValues(v.Index);
+        REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+
+        auto block = tiled.Block(v.Index, 2);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(block.data()) % EIGEN_MAX_ALIGN_BYTES == 0);
+        REQUIRE(block[5] == x[2 * Dataset::TileRows + 5]);
+    }
+
+    // loads crossing block boundaries
+    std::vector<Operon::Scalar> buffer(100);
+    tiled.Load(2, 30, buffer.size(), buffer.data());
+    auto x = ds.GetValues(gsl::index(2));
+    REQUIRE(std::equal(buffer.begin(), buffer.end(), x.begin() + 30));
+}
+TEST_CASE("Row partitions", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    Operon::Random random(1234);
+    auto partition = Partition::KFold(ds.Rows(), 5, random);
+    REQUIRE(partition.Count() == 5);
+    REQUIRE(partition.Rows() == ds.Rows());
+
+    std::vector<gsl::index> rows;
+    for (size_t i = 0; i < partition.Count(); ++i) {
+        rows.insert(rows.end(), partition[i].begin(), partition[i].end());
+    }
+    std::sort(rows.begin(), rows.end());
+    REQUIRE(std::adjacent_find(rows.begin(), rows.end()) == rows.end());
+
+    // the problem trains on four folds and tests on the fifth, without copying the data
+    auto variables = ds.Variables();
+    Problem problem(ds, variables, "Y", partition, 2);
+    REQUIRE(problem.GetDataset().IsShared());
+    REQUIRE(problem.TrainingRange().Size() == ds.Rows() - partition[2].size());
+    REQUIRE(problem.TestRange().End() == ds.Rows());
+
+    auto target = problem.TargetValues();
+    auto original = ds.GetValues("Y");
+    for (size_t i = 0; i < partition[2].size(); ++i) {
+        REQUIRE(target[problem.TestRange().Start() + i] == original[partition[2][i]]);
+    }
+}
+
+TEST_CASE("Lagged variables", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto values = ds.GetValues("X1");
+    std::vector<Operon::Scalar> x1(values.begin(), values.end());
+
+    auto bytes = ds.StorageBytes();
+    ds.AddLags(20);
+    REQUIRE(ds.StorageBytes() == bytes);
+    REQUIRE(ds.MaxLag() == 20);
+    REQUIRE(ds.Variables().size() == 11 * 21);
+
+    auto lagged = ds.GetValues("X1_lag3");
+    REQUIRE(std::isnan(lagged[2]));
+    for (size_t i = 3; i < ds.Rows(); ++i) {
+        REQUIRE(lagged[i] == x1[i - 3]);
+    }
+
+    // the evaluator reads lagged variables through an offset into the base column
+    auto node = Node(NodeType::Variable, ds.GetHashValue("X1_lag3"));
+    node.Value = 2;
+    auto tree = Tree { node };
+    tree.UpdateNodes();
+    auto estimated = Evaluate<Operon::Scalar>(tree, ds, Range { 20, 500 });
+    for (size_t i = 0; i < estimated.size(); ++i) {
+        REQUIRE(estimated[i] == 2 * x1[i + 17]);
+    }
+
+    // lags refer to the storage order, also in row views
+    std::vector<gsl::index> rows { 10, 4, 2 };
+    auto view = ds.View(rows);
+    REQUIRE(view.GetValues("X1_lag3")[0] == x1[7]);
+    REQUIRE(view.GetValues("X1_lag3")[1] == x1[1]);
+    REQUIRE(std::isnan(view.GetValues("X1_lag3")[2]));
+
+    // in a row view the lagged variables are materialized when the values are modified, and they are still
+    // transformed with their base column, whatever the order in which the variables are visited
+    std::vector<gsl::index> reversed(ds.Rows());
+    std::iota(reversed.rbegin(), reversed.rend(), 0);
+    auto x1Index = ds.GetIndex(ds.GetHashValue("X1"));
+    auto lagIndex = ds.GetIndex(ds.GetHashValue("X1_lag3"));
+    auto lagFirst = ds.View(reversed);
+    lagFirst.Standardize(lagIndex, Range { 0, 250 });
+    lagFirst.Standardize(x1Index, Range { 0, 250 });
+    auto baseFirst = ds.View(reversed);
+    baseFirst.Standardize(x1Index, Range { 0, 250 });
+    baseFirst.Standardize(lagIndex, Range { 0, 250 });
+
+    for (auto const& standardized : { lagFirst, baseFirst }) {
+        REQUIRE(standardized.IsMaterializedLag(lagIndex));
+        auto base = standardized.GetValues("X1");
+        auto lagged = standardized.GetValues("X1_lag3");
+        // row j of the view is storage row n - 1 - j, so its lagged value is at row j + 3 of the view
+        for (size_t j = 0; j + 3 < standardized.Rows(); ++j) {
+            REQUIRE(lagged[j] == Approx(base[j + 3]));
+        }
+        REQUIRE(std::isnan(lagged[standardized.Rows() - 1]));
+    }
+}
+TEST_CASE("Appending rows", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+
+    // blocks are appended in place while the reserved capacity lasts
+    Dataset::Cursor cursor;
+    auto grown = Dataset::ReadRows("../data/Poly-10.csv", cursor, 100, true);
+    grown.Reserve(ds.Rows());
+    REQUIRE(grown.Capacity() == ds.Rows());
+    auto data = grown.GetValues("X1").data();
+    while (cursor.Row < ds.Rows()) {
+        grown.Append(Dataset::ReadRows("../data/Poly-10.csv", cursor, 150, true));
+        REQUIRE(grown.GetValues("X1").data() == data);
+    }
+    REQUIRE(grown.Rows() == ds.Rows());
+    for (auto const& v : ds.Variables()) {
+        auto x = grown.GetValues(v.Name);
+        auto y = ds.GetValues(v.Name);
+        REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+    }
+
+    // beyond the capacity the storage grows geometrically, and shared storage is never modified
+    auto copy = grown;
+    copy.Append(ds.Slice(Range { 0, 10 }));
+    REQUIRE(copy.Rows() == ds.Rows() + 10);
+    REQUIRE(copy.Capacity() >= 2 * ds.Rows());
+    REQUIRE(grown.Rows() == ds.Rows());
+    REQUIRE(copy.GetValues("Y")[ds.Rows()] == ds.GetValues("Y")[0]);
+
+    // the block must provide all the variables
+    REQUIRE_THROWS(copy.Append(ds.View(std::vector<std::string> { "X1", "X2" })));
+}
+TEST_CASE("Streaming", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    ds.Save("Poly-10.bin");
+
+    for (auto file : { "../data/Poly-10.csv", "Poly-10.bin" }) {
+        bool hasHeader = std::string(file).find(".csv") != std::string::npos;
+
+        // sequential reads return the same rows and variables as the whole file
+        Dataset::Cursor cursor;
+        auto chunk = Dataset::ReadRows(file, cursor, 100, hasHeader);
+        REQUIRE(chunk.Rows() == 100);
+        REQUIRE(cursor.Row == 100);
+        chunk = Dataset::ReadRows(file, cursor, 100, hasHeader);
+        REQUIRE(chunk.GetHashValue("X1") == ds.GetHashValue("X1"));
+        REQUIRE(chunk.GetValues("X1")[0] == ds.GetValues("X1")[100]);
+
+        DatasetStream stream(file, 64, 3, hasHeader);
+        REQUIRE(stream.Rows() == ds.Rows());
+
+        // every pass visits all the rows in order, with at most depth chunks in memory
+        for (int pass = 0; pass < 2; ++pass) {
+            size_t rows = 0;
+            stream.ForEach([&](const Dataset& c, size_t start) {
+                REQUIRE(start == rows);
+                auto x = c.GetValues("Y");
+                auto y = ds.GetValues("Y").subspan(start, c.Rows());
+                REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+                rows += c.Rows();
+            });
+            REQUIRE(rows == ds.Rows());
+        }
+        REQUIRE(stream.PeakBytes() <= stream.Depth() * stream.ChunkRows() * ds.Cols() * sizeof(Operon::Scalar));
+
+        // a pass abandoned by f is not continued by the next one
+        int calls = 0;
+        REQUIRE_THROWS_WITH(stream.ForEach([&](const Dataset&, size_t) {
+            if (++calls == 2) {
+                throw std::runtime_error("abandoned");
+            }
+        }), "abandoned");
+        size_t rows = 0;
+        stream.ForEach([&](const Dataset& c, size_t start) {
+            REQUIRE(start == rows);
+            REQUIRE(c.GetValues("Y")[0] == ds.GetValues("Y")[start]);
+            rows += c.Rows();
+        });
+        REQUIRE(rows == ds.Rows());
+    }
+    std::remove("Poly-10.bin");
+
+    // a read error is reported by every pass, and the stream recovers once the file is readable again
+    auto write = [](bool malformed) {
+        std::ofstream out("stream.csv");
+        out << "A,B\n";
+        for (int i = 0; i < 100; ++i) {
+            out << i << "," << (malformed && i == 70 ? "x" : std::to_string(2 * i)) << "\n";
+        }
+    };
+    write(false);
+    {
+        DatasetStream stream("stream.csv", 16, 2, true);
+        REQUIRE(stream.Rows() == 100);
+        write(true);
+        for (int pass = 0; pass < 2; ++pass) {
+            REQUIRE_THROWS_WITH(stream.ForEach([](const Dataset&, size_t) {}), Catch::Contains("cannot parse 'x'"));
+        }
+        write(false);
+        size_t rows = 0;
+        stream.ForEach([&](const Dataset& c, size_t start) {
+            REQUIRE(start == rows);
+            rows += c.Rows();
+        });
+        REQUIRE(rows == 100);
+    }
+    std::remove("stream.csv");
+}
+} // namespace Test
+} // namespace Operon
@@ -24,6 +24,7 @@
 #include "core/operator.hpp"
 
 #include <ceres/ceres.h>
+#include <utility>
 
 namespace Operon {
 namespace Test {
@@ -89,6 +90,33 @@ TEST_CASE("Node is small", "[detail]")
     REQUIRE(sizeof(Node) <= size_t{64});
 }
 
+TEST_CASE("Tree copies share nodes", "[detail]")
+{
+    Tree tree { Node(NodeType::Constant), Node(NodeType::Constant), Node(NodeType::Add) };
+    tree.UpdateNodes();
+    REQUIRE(!tree.IsShared());
+
+    auto copy = tree;
+    const auto& shared = copy;
+    REQUIRE(tree.IsShared());
+    REQUIRE(shared.Nodes().data() == std::as_const(tree).Nodes().data());
+
+    // writing through a non-const accessor copies the nodes, leaving the other tree unchanged
+    copy[0].Value = 42;
+    REQUIRE(!tree.IsShared());
+    REQUIRE(!copy.IsShared());
+    REQUIRE(shared.Nodes().data() != std::as_const(tree).Nodes().data());
+    REQUIRE(tree[0].Value != 42);
+
+    auto moved = std::move(copy);
+    REQUIRE(moved[0].Value == 42);
+    REQUIRE(!moved.IsShared());
+
+    Tree empty;
+    REQUIRE(empty.Empty());
+    REQUIRE(empty.HashValue() == 0);
+}
+
 TEST_CASE("Jsf is copyable", "[detail]") 
 {
     RandomGenerator::JsfRand<64> jsf(1234);
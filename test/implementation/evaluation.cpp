@@ -17,12 +17,22 @@
  * PERFORMANCE OF THIS SOFTWARE. 
  */
 
+#include "core/arena.hpp"
 #include "core/dataset.hpp"
 #include "core/eval.hpp"
 #include "core/nnls.hpp"
+#include "core/nnls_batch.hpp"
+#include "core/operator.hpp"
 #include "core/format.hpp"
 #include "core/stats.hpp"
 #include "core/metrics.hpp"
+#include "core/partition.hpp"
+#include "core/simplify.hpp"
+#include "stat/linearscaler.hpp"
+#include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/evaluator.hpp"
+#include "operators/mutation.hpp"
 
 #include <catch2/catch.hpp>
 
@@ -142,6 +152,80 @@ TEST_CASE("Evaluation correctness", "[implementation]")
             fmt::print("{}\t{}\t{}\t{}\n", x3Values[i], x5Values[i], x6Values[i], estimatedValues[i]);
         }
     }
+
+    SECTION("Multiple coefficient sets")
+    {
+        tree = Tree { x3, x6, x5, mul, sub, x1, div };
+        tree.UpdateNodes();
+
+        auto coef = tree.GetCoefficients();
+        Eigen::Array<double, Eigen::Dynamic, Eigen::Dynamic> parameters(5, coef.size());
+        for (gsl::index k = 0; k < parameters.rows(); ++k) {
+            for (gsl::index j = 0; j < parameters.cols(); ++j) {
+                parameters(k, j) = coef[j] * (1 + 0.1 * k);
+            }
+        }
+        auto estimated = Evaluate(tree, ds, range, parameters);
+        REQUIRE(estimated.cols() == parameters.rows());
+
+        for (gsl::index k = 0; k < parameters.rows(); ++k) {
+            std::vector<double> p;
+            for (gsl::index j = 0; j < parameters.cols(); ++j) {
+                p.push_back(parameters(k, j));
+            }
+            auto values = Evaluate<double>(tree, ds, range, p.data());
+            for (size_t i = 0; i < values.size(); ++i) {
+                REQUIRE(values[i] == Approx(estimated(i, k)));
+            }
+        }
+    }
+}
+
+TEST_CASE("Analytic Jacobian", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto range = Range { 0, 100 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    auto x1Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X1"; });
+    auto x2Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X2"; });
+
+    auto x1 = Node(NodeType::Variable, x1Var.Hash);
+    x1.Value = 0.5;
+    auto x2 = Node(NodeType::Variable, x2Var.Hash);
+    x2.Value = 1.5;
+    auto c = Node(NodeType::Constant);
+    c.Value = 0.3;
+
+    // ((exp(c) + c) * x1 - sin(x2)) / c, the subtree exp(c) + c is constant over the data
+    auto tree = Tree { c, Node(NodeType::Exp), c, Node(NodeType::Add), x1, Node(NodeType::Mul), x2, Node(NodeType::Sin), Node(NodeType::Sub), c, Node(NodeType::Div) };
+    tree.UpdateNodes();
+
+    auto coef = tree.GetCoefficients();
+    auto n = range.Size();
+    auto p = coef.size();
+    double const* parameters[] = { coef.data() };
+
+    std::vector<double> residuals(n), jacobian(n * p);
+    double* jacobians[] = { jacobian.data() };
+    AnalyticCostFunction analytic(tree, ds, targetValues, range);
+    analytic.Evaluate(parameters, residuals.data(), jacobians);
+
+    std::vector<double> expectedResiduals(n), expectedJacobian(n * p);
+    double* expectedJacobians[] = { expectedJacobian.data() };
+    ceres::DynamicAutoDiffCostFunction<ResidualEvaluator> autodiff(new ResidualEvaluator(tree, ds, targetValues, range));
+    autodiff.AddParameterBlock(p);
+    autodiff.SetNumResiduals(n);
+    autodiff.Evaluate(parameters, expectedResiduals.data(), expectedJacobians);
+
+    for (size_t i = 0; i < n; ++i) {
+        REQUIRE(residuals[i] == Approx(expectedResiduals[i]));
+    }
+    for (size_t i = 0; i < n * p; ++i) {
+        REQUIRE(jacobian[i] == Approx(expectedJacobian[i]));
+    }
 }
 
 TEST_CASE("Constant optimization (autodiff)", "[implementation]")
@@ -377,6 +461,663 @@ TEST_CASE("Constant optimization (numeric)", "[implementation]")
     fmt::print("{}\n", InfixFormatter::Format(poly10, ds, 6));
 }
 
+TEST_CASE("Constant optimization (variable projection)", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto range = Range { 0, 250 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    auto x1Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X1"; });
+    auto x2Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X2"; });
+    auto x3Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X3"; });
+    auto x4Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X4"; });
+
+    auto x1 = Node(NodeType::Variable, x1Var.Hash);
+    x1.Value = 0.001;
+    auto x2 = Node(NodeType::Variable, x2Var.Hash);
+    x2.Value = 0.001;
+    auto x3 = Node(NodeType::Variable, x3Var.Hash);
+    x3.Value = 0.001;
+    auto x4 = Node(NodeType::Variable, x4Var.Hash);
+    x4.Value = 0.001;
+    auto c = Node(NodeType::Constant);
+    c.Value = 0.001;
+
+    auto add = Node(NodeType::Add);
+    auto sub = Node(NodeType::Sub);
+    auto mul = Node(NodeType::Mul);
+
+    // (x4 - ((x1 * x2) + x3)) + c: the weights of x3, x4 and c enter the model linearly
+    auto tree = Tree { x1, x2, mul, x3, add, x4, sub, c, add };
+    tree.UpdateNodes();
+
+    auto signs = LinearCoefficientSigns(tree);
+    REQUIRE(signs == std::vector<int> { 0, 0, -1, 1, 1 });
+
+    auto mse = [&](const Tree& t) {
+        auto estimated = Evaluate<Operon::Scalar>(t, ds, range);
+        return MeanSquaredError(estimated, targetValues);
+    };
+
+    auto before = mse(tree);
+    auto summary = OptimizeVariableProjection(tree, ds, targetValues, range, 100, true, true);
+    auto after = mse(tree);
+    fmt::print("{}\n", InfixFormatter::Format(tree, ds, 6));
+    fmt::print("mse before: {}, after: {}, iterations: {}\n", before, after, summary.iterations.size());
+    REQUIRE(after < before);
+}
+
+namespace {
+    // exposes the local optimization schedule of the evaluator base class
+    class ScheduleEvaluator : public EvaluatorBase<Individual<1>> {
+    public:
+        using EvaluatorBase<Individual<1>>::EvaluatorBase;
+        using EvaluatorBase<Individual<1>>::ScheduleLocalIterations;
+
+        double operator()(Operon::Random&, Individual<1>&) const override { return 0; }
+    };
+} // namespace
+
+TEST_CASE("Local optimization schedule", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    Problem problem(ds, ds.Variables(), "Y", { 0, 250 }, { 250, 500 });
+
+    // the fitness of the population after local optimization, which does not take part in the schedule
+    std::vector<Individual<1>> pop(9);
+    for (auto& ind : pop) {
+        ind[0] = 0.01;
+    }
+
+    // unoptimized fitness values that are exact in binary floating-point, so the allocated iterations are exact
+    std::vector<Operon::Scalar> unoptimized(9);
+    for (size_t i = 0; i < unoptimized.size(); ++i) {
+        unoptimized[i] = 0.25 * (i + 1);
+    }
+
+    ScheduleEvaluator evaluator(problem);
+    evaluator.LocalOptimizationIterations(50);
+
+    SECTION("No scheduling")
+    {
+        for (auto f : unoptimized) {
+            REQUIRE(evaluator.ScheduleLocalIterations(f) == 50);
+        }
+        evaluator.Prepare(pop);
+        REQUIRE(evaluator.ScheduleLocalIterations(2.25) == 50);
+        REQUIRE(evaluator.SavedLocalIterations() == 0);
+    }
+
+    SECTION("Median")
+    {
+        evaluator.LocalOptimizationQuantile(0.5);
+        // the initial population is fully optimized, and its unoptimized fitness becomes the reference
+        for (auto f : unoptimized) {
+            REQUIRE(evaluator.ScheduleLocalIterations(f) == 50);
+        }
+        REQUIRE(evaluator.SavedLocalIterations() == 0);
+
+        // the threshold is the median unoptimized fitness (1.25) and the best unoptimized fitness is 0.25, even
+        // though every individual in the population is better than both after local optimization
+        evaluator.Prepare(pop);
+        REQUIRE(evaluator.ScheduleLocalIterations(0.25) == 50); // the full budget at the best fitness
+        REQUIRE(evaluator.ScheduleLocalIterations(0.0) == 50);  // and beyond it
+        REQUIRE(evaluator.ScheduleLocalIterations(0.75) == 25); // proportional in between
+        REQUIRE(evaluator.ScheduleLocalIterations(1.25) == 1);  // at least one iteration at the threshold
+        REQUIRE(evaluator.ScheduleLocalIterations(1.5) == 0);   // none above it
+        REQUIRE(evaluator.SavedLocalIterations() == 0 + 0 + 25 + 49 + 50);
+
+        // the next threshold is taken from the offspring scored in this generation (0.0 ... 1.5), with median 0.75
+        evaluator.Prepare(pop);
+        REQUIRE(evaluator.ScheduleLocalIterations(0.75) == 1);
+        REQUIRE(evaluator.ScheduleLocalIterations(1.0) == 0);
+
+        // the reference is forgotten
+        evaluator.Reset();
+        REQUIRE(evaluator.SavedLocalIterations() == 0);
+        REQUIRE(evaluator.ScheduleLocalIterations(2.25) == 50);
+    }
+
+    SECTION("Empty reference")
+    {
+        // without unoptimized fitness values there is no threshold, and every individual is fully optimized
+        evaluator.LocalOptimizationQuantile(0.5);
+        evaluator.Prepare(pop);
+        REQUIRE(evaluator.ScheduleLocalIterations(2.25) == 50);
+        REQUIRE(evaluator.SavedLocalIterations() == 0);
+    }
+}
+
+TEST_CASE("Online evaluation", "[implementation]")
+{
+    using Evaluator = OnlineEvaluator<Individual<1>>;
+    Operon::Random random(1234);
+
+    SECTION("Sliding window")
+    {
+        auto ds = Dataset("../data/Poly-10.csv", true);
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+        Grammar grammar;
+        grammar.SetConfig(Grammar::Arithmetic);
+        BalancedTreeCreator creator { grammar, inputs };
+
+        Range window { 0, 100 };
+        Problem problem(ds, inputs, "Y", window, { 400, 500 });
+        Evaluator online(problem);
+        online.LocalOptimizationIterations(0);
+        Evaluator full(problem);
+        full.LocalOptimizationIterations(0);
+
+        // the last individuals are copies of the first ones, and share their accumulators
+        std::vector<Individual<1>> pop(20);
+        for (size_t i = 0; i < pop.size(); ++i) {
+            if (i < 15) {
+                pop[i].Genotype = creator(random, 20, 10);
+            } else {
+                pop[i] = pop[i - 15];
+            }
+            pop[i][0] = online(random, pop[i]);
+        }
+        std::unordered_set<Operon::Hash> hashes;
+        std::transform(pop.begin(), pop.end(), std::inserter(hashes, hashes.end()), [](auto const& ind) { return ind.Genotype.HashValue(); });
+
+        // the window grows and moves forward: rows enter and leave it at every step
+        for (size_t step = 1; step <= Evaluator::RecomputeInterval + 1; ++step) {
+            auto previous = window;
+            window = Range { window.Start() + 7, window.End() + 10 };
+            problem.TrainingRange(window);
+
+            auto evaluations = online.FitnessEvaluations();
+            online.Update(pop, previous);
+            for (auto const& ind : pop) {
+                auto copy = ind;
+                REQUIRE(ind[0] == Approx(full(random, copy)).margin(1e-6));
+            }
+            // the accumulators are updated incrementally, until they are computed again on the whole window
+            auto recomputed = step <= Evaluator::RecomputeInterval ? 0UL : hashes.size();
+            REQUIRE(online.FitnessEvaluations() - evaluations == recomputed);
+        }
+
+        // without overlap the whole window is evaluated
+        auto previous = window;
+        window = Range { 450, 500 };
+        problem.TrainingRange(window);
+        auto evaluations = online.FitnessEvaluations();
+        online.Update(pop, previous);
+        REQUIRE(online.FitnessEvaluations() - evaluations == hashes.size());
+        for (auto const& ind : pop) {
+            auto copy = ind;
+            REQUIRE(ind[0] == Approx(full(random, copy)).margin(1e-6));
+        }
+    }
+
+    SECTION("Non-finite values")
+    {
+        // log(x) is not finite on the third row
+        std::vector<Operon::Scalar> x(200);
+        std::iota(x.begin(), x.end(), 1);
+        x[2] = -1;
+        std::vector<Variable> variables { { "X", 1234, 0 }, { "Y", 5678, 1 } };
+        Dataset ds(variables, { x, x });
+
+        Range window { 0, 50 };
+        Problem problem(ds, variables, "Y", window, { 150, 200 });
+        Evaluator online(problem);
+        online.LocalOptimizationIterations(0);
+        Evaluator full(problem);
+        full.LocalOptimizationIterations(0);
+
+        auto var = Node(NodeType::Variable, variables[0].Hash);
+        var.Value = 1;
+        Individual<1> ind;
+        ind.Genotype = Tree({ var, Node(NodeType::Log) });
+        ind[0] = online(random, ind);
+
+        for (size_t step = 1; step <= 3; ++step) {
+            auto previous = window;
+            window = Range { window.Start() + 5, window.End() + 5 };
+            problem.TrainingRange(window);
+
+            // the accumulator is computed again on the whole window once the non-finite row left it
+            auto evaluations = online.FitnessEvaluations();
+            online.Update({ &ind, 1 }, previous);
+            REQUIRE(online.FitnessEvaluations() - evaluations == (step == 1 ? 1 : 0));
+
+            auto copy = ind;
+            REQUIRE(ind[0] == Approx(full(random, copy)).margin(1e-6));
+            REQUIRE(ind[0] < 0.1);
+        }
+    }
+}
+
+TEST_CASE("Row weights", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto range = Range { 0, 250 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+    auto x1Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X1"; });
+    auto x2Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X2"; });
+
+    auto x1 = Node(NodeType::Variable, x1Var.Hash);
+    x1.Value = 0.5;
+    auto x2 = Node(NodeType::Variable, x2Var.Hash);
+    x2.Value = 2.0;
+    auto tree = Tree { x1, x2, Node(NodeType::Mul) };
+    tree.UpdateNodes();
+
+    // integer weights give the same results as repeating the rows
+    Operon::Random random(1234);
+    auto counts = Bootstrap(range.Size(), random);
+    std::vector<Operon::Scalar> weights(counts.begin(), counts.end());
+    REQUIRE(std::reduce(weights.begin(), weights.end()) == range.Size());
+
+    auto estimated = Evaluate<Operon::Scalar>(tree, ds, range);
+    std::vector<Operon::Scalar> x;
+    std::vector<Operon::Scalar> y;
+    for (size_t i = 0; i < range.Size(); ++i) {
+        x.insert(x.end(), counts[i], estimated[i]);
+        y.insert(y.end(), counts[i], targetValues[i]);
+    }
+    REQUIRE(MeanSquaredError(estimated, targetValues, weights) == Approx(MeanSquaredError(x, y)));
+    REQUIRE(NormalizedMeanSquaredError(estimated, targetValues, weights) == Approx(NormalizedMeanSquaredError(x, y)));
+    REQUIRE(RSquared(estimated, targetValues, weights) == Approx(RSquared(x, y)));
+
+    auto [a, b] = LinearScalingCalculator::Calculate(estimated.begin(), estimated.end(), targetValues.begin(), weights);
+    auto [a1, b1] = LinearScalingCalculator::Calculate(x.begin(), x.end(), y.begin());
+    REQUIRE(a == Approx(a1));
+    REQUIRE(b == Approx(b1));
+
+    // the weights are shared between copies of the problem and only cover the requested range
+    Problem problem(ds, variables, "Y", range, { 250, 500 });
+    REQUIRE(!problem.IsWeighted());
+    REQUIRE(problem.Weights(range).empty());
+    std::vector<uint8_t> rowCounts(ds.Rows(), 0);
+    std::copy(counts.begin(), counts.end(), rowCounts.begin());
+    problem.SetWeights(rowCounts);
+    REQUIRE(problem.IsWeighted());
+    REQUIRE(problem.Weights(range) == weights);
+
+    // weighted local optimization does not increase the weighted error
+    auto before = MeanSquaredError(estimated, targetValues, weights);
+    OptimizeAutodiff(tree, ds, targetValues, gsl::span<const Operon::Scalar>(weights), range, 50);
+    estimated = Evaluate<Operon::Scalar>(tree, ds, range);
+    auto after = MeanSquaredError(estimated, targetValues, weights);
+    fmt::print("weighted mse before: {}, after: {}\n", before, after);
+    REQUIRE(after <= before);
+}
+
+TEST_CASE("Constant optimization (batched)", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+
+    auto range = Range { 0, 250 };
+    auto targetValues = ds.GetValues("Y").subspan(range.Start(), range.Size());
+
+    auto x1Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X1"; });
+    auto x2Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X2"; });
+    auto x3Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X3"; });
+
+    auto mse = [&](const Tree& t) {
+        auto estimated = Evaluate<Operon::Scalar>(t, ds, range);
+        return MeanSquaredError(estimated, targetValues);
+    };
+
+    // the same structure (x1 * x2) + exp(x3) + c with different starting coefficients
+    std::vector<Tree> trees;
+    for (int i = 0; i < 8; ++i) {
+        auto value = 0.1 + 0.2 * i;
+        auto x1 = Node(NodeType::Variable, x1Var.Hash);
+        auto x2 = Node(NodeType::Variable, x2Var.Hash);
+        auto x3 = Node(NodeType::Variable, x3Var.Hash);
+        auto c = Node(NodeType::Constant);
+        x1.Value = x2.Value = x3.Value = c.Value = value;
+        trees.push_back(Tree { x1, x2, Node(NodeType::Mul), x3, Node(NodeType::Exp), Node(NodeType::Add), c, Node(NodeType::Add) });
+        trees.back().UpdateNodes();
+    }
+
+    std::vector<double> before;
+    std::transform(trees.begin(), trees.end(), std::back_inserter(before), mse);
+
+    std::vector<Tree*> pointers;
+    std::transform(trees.begin(), trees.end(), std::back_inserter(pointers), [](auto& t) { return &t; });
+    auto summaries = OptimizeBatch(pointers, ds, targetValues, range, 100);
+
+    for (size_t i = 0; i < trees.size(); ++i) {
+        auto after = mse(trees[i]);
+        fmt::print("mse before: {}, after: {}, iterations: {}, cost: {} -> {}\n", before[i], after, summaries[i].Iterations, summaries[i].InitialCost, summaries[i].FinalCost);
+        REQUIRE(summaries[i].FinalCost <= summaries[i].InitialCost);
+        REQUIRE(after <= before[i]);
+    }
+}
+
+TEST_CASE("Compact trees", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log);
+    BalancedTreeCreator creator { grammar, inputs };
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+    ChangeVariableMutation changeVar { inputs };
+    ChangeFunctionMutation changeFunc { grammar };
+    OnePointMutation onePoint;
+
+    Operon::Random random(1234);
+    Range range { 0, 250 };
+    for (int k = 0; k < 100; ++k) {
+        auto tree = creator(random, 30, 10);
+        auto compact = CompactTree(tree);
+        REQUIRE(compact.Length() == tree.Length());
+        REQUIRE(compact.Depth() == tree.Depth());
+        REQUIRE(compact.MemoryBytes() < sizeof(Tree) + tree.Length() * sizeof(Node));
+
+        // same values, structure and hash as the tree it was created from
+        auto x = Evaluate<Operon::Scalar>(tree, ds, range);
+        auto y = Evaluate<Operon::Scalar>(compact, ds, range);
+        REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+        auto expanded = compact.ToTree();
+        for (size_t i = 0; i < tree.Length(); ++i) {
+            REQUIRE(expanded[i].HashValue == tree[i].HashValue);
+            REQUIRE(expanded[i].Value == tree[i].Value);
+            REQUIRE(expanded[i].Length == tree[i].Length);
+            REQUIRE(compact.Level(i) == tree.Level(i));
+        }
+        auto sorted = tree;
+        sorted.Sort(Operon::HashMode::Strict);
+        REQUIRE(CompactTree(sorted).HashValue(Operon::HashMode::Strict) == sorted.HashValue());
+
+        // the operators on the compact representation make the same choices as on the tree
+        auto other = creator(random, 20, 10);
+        auto seed = random();
+        Operon::Random r1(seed), r2(seed);
+        auto child = crossover(r1, tree, other);
+        auto compactChild = crossover(r2, compact, CompactTree(other));
+        REQUIRE(compactChild.HashValue(Operon::HashMode::Strict) == CompactTree(child).HashValue(Operon::HashMode::Strict));
+        REQUIRE(compactChild.ToTree().Depth() == child.Depth());
+
+        for (const MutatorBase* mutator : std::initializer_list<const MutatorBase*> { &changeVar, &changeFunc, &onePoint }) {
+            seed = random();
+            Operon::Random r3(seed), r4(seed);
+            auto mutated = (*mutator)(r3, child);
+            auto compactMutated = (*mutator)(r4, compactChild);
+            REQUIRE(compactMutated.HashValue(Operon::HashMode::Strict) == CompactTree(mutated).HashValue(Operon::HashMode::Strict));
+        }
+    }
+}
+
+TEST_CASE("Population arena", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log);
+    BalancedTreeCreator creator { grammar, inputs };
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+    ChangeVariableMutation changeVar { inputs };
+    ChangeFunctionMutation changeFunc { grammar };
+    OnePointMutation onePoint;
+    MultiMutation mutator;
+    mutator.Add(changeVar, 1);
+    mutator.Add(changeFunc, 1);
+    mutator.Add(onePoint, 1);
+
+    const size_t n = 100;
+    PopulationArena arena(n, 50);
+    std::vector<Tree> trees(n);
+
+    Operon::Random random(1234);
+    for (size_t i = 0; i < n; ++i) {
+        trees[i] = creator(random, 30, 10);
+        arena.Assign(i, trees[i]);
+    }
+    arena.Swap();
+    const Node* buffer = arena[0].data();
+    for (size_t i = 0; i < n; ++i) {
+        buffer = std::min<const Node*>(buffer, arena[i].data());
+    }
+
+    Range range { 0, 250 };
+    for (int generation = 0; generation < 10; ++generation) {
+        std::vector<Tree> offspring(n);
+        // the elite is kept as is
+        arena.Keep(0, 0);
+        offspring[0] = trees[0];
+        for (size_t i = 1; i < n; ++i) {
+            std::uniform_int_distribution<size_t> dist(0, n - 1);
+            auto a = dist(random);
+            auto b = dist(random);
+            auto seed = random();
+
+            // the arena operators make the same choices as on the trees
+            Operon::Random r1(seed), r2(seed);
+            auto child = crossover(r1, trees[a], trees[b]);
+            child = mutator(r1, std::move(child));
+            auto nodes = crossover(r2, arena[a], arena[b], arena, i);
+            mutator(r2, nodes);
+
+            REQUIRE(nodes.size() == child.Length());
+            for (size_t j = 0; j < nodes.size(); ++j) {
+                REQUIRE(nodes[j].HashValue == child[j].HashValue);
+                REQUIRE(nodes[j].Value == child[j].Value);
+                REQUIRE(nodes[j].Length == child[j].Length);
+                REQUIRE(nodes[j].Depth == child[j].Depth);
+                REQUIRE(nodes[j].Parent == child[j].Parent);
+            }
+            offspring[i] = std::move(child);
+        }
+        REQUIRE(arena.Used() <= arena.Capacity());
+        arena.Swap();
+        trees.swap(offspring);
+
+        for (size_t i = 0; i < n; ++i) {
+            auto x = Evaluate<Operon::Scalar>(trees[i], ds, range);
+            auto y = Evaluate<Operon::Scalar>(arena[i], ds, range);
+            REQUIRE(std::equal(x.begin(), x.end(), y.begin(), y.end()));
+        }
+    }
+
+    // after an even number of generations the first buffer is in use again, and the offspring were written
+    // to it from the start
+    const Node* first = arena[0].data();
+    for (size_t i = 0; i < n; ++i) {
+        first = std::min<const Node*>(first, arena[i].data());
+    }
+    REQUIRE(first == buffer);
+}
+
+TEST_CASE("Hash-consed population", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log);
+    BalancedTreeCreator creator { grammar, inputs };
+    SubtreeCrossover crossover { 0.9, 10, 50 };
+
+    // a few generations of crossover, so that the individuals share subtrees
+    const size_t n = 100;
+    Operon::Random random(1234);
+    std::vector<Tree> trees(n);
+    std::generate(trees.begin(), trees.end(), [&]() { return creator(random, 30, 10); });
+    std::uniform_int_distribution<size_t> dist(0, n - 1);
+    for (int g = 0; g < 5; ++g) {
+        std::vector<Tree> offspring(n);
+        std::generate(offspring.begin(), offspring.end(), [&]() { return crossover(random, trees[dist(random)], trees[dist(random)]); });
+        trees = std::move(offspring);
+    }
+
+    SubtreeStore store;
+    std::vector<SubtreeStore::Id> roots(n);
+    size_t totalNodes = 0;
+    for (size_t i = 0; i < n; ++i) {
+        trees[i].Sort(Operon::HashMode::Strict);
+        roots[i] = store.Intern(trees[i]);
+        totalNodes += trees[i].Length();
+    }
+    REQUIRE(store.Size() < totalNodes);
+    fmt::print("{} nodes, {} unique subtrees\n", totalNodes, store.Size());
+
+    for (size_t i = 0; i < n; ++i) {
+        auto tree = store.ToTree(roots[i]);
+        REQUIRE(tree.Length() == trees[i].Length());
+        for (size_t j = 0; j < tree.Length(); ++j) {
+            REQUIRE(tree[j].CalculatedHashValue == trees[i][j].CalculatedHashValue);
+        }
+        // the parent of the root is meaningless
+        for (size_t j = 0; j + 1 < tree.Length(); ++j) {
+            REQUIRE(tree[j].Parent == trees[i][j].Parent);
+        }
+    }
+
+    Range range { 0, 100 };
+    auto values = Evaluate<Operon::Scalar>(store, roots, ds, range);
+    for (size_t i = 0; i < n; ++i) {
+        auto expected = Evaluate<Operon::Scalar>(trees[i], ds, range);
+        for (size_t j = 0; j < range.Size(); ++j) {
+            auto v = values[i * range.Size() + j];
+            REQUIRE((v == expected[j] || std::abs(v - expected[j]) <= 1e-6 * std::max(Operon::Scalar { 1 }, std::abs(expected[j]))));
+        }
+    }
+
+    // only the subtrees of the remaining individuals are kept
+    auto size = store.Size();
+    std::vector<SubtreeStore::Id> half(roots.begin(), roots.begin() + n / 2);
+    store.Collect(half);
+    REQUIRE(store.Size() < size);
+    for (size_t i = 0; i < n / 2; ++i) {
+        REQUIRE(store.ToTree(half[i]).HashValue() == trees[i].HashValue());
+    }
+
+    // a different subtree with the same hash value (collision) is stored separately
+    auto x1 = Node(NodeType::Variable, inputs[0].Hash);
+    x1.Value = 1;
+    auto x2 = Node(NodeType::Variable, inputs[1].Hash);
+    x2.Value = 1;
+    auto sum = Tree({ x1, x2, Node(NodeType::Add) }).UpdateNodes();
+    sum.Sort(Operon::HashMode::Strict);
+    auto exp = Tree({ x1, Node(NodeType::Exp) }).UpdateNodes();
+    exp.Sort(Operon::HashMode::Strict);
+    exp[1].CalculatedHashValue = sum[2].CalculatedHashValue;
+    auto a = store.Intern(sum);
+    auto b = store.Intern(exp);
+    REQUIRE(a != b);
+    REQUIRE(store.ToTree(a).Length() == 3);
+    REQUIRE(store.ToTree(b).Length() == 2);
+    REQUIRE(store[b].Root.Type == NodeType::Exp);
+    REQUIRE(store.Intern(sum) == a);
+}
+
+TEST_CASE("Tree simplification", "[implementation]")
+{
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [](const auto& v) { return v.Name != "Y"; });
+
+    auto range = Range { 0, 250 };
+    auto x1Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X1"; });
+    auto x2Var = *std::find_if(variables.begin(), variables.end(), [](auto& v) { return v.Name == "X2"; });
+
+    auto x1 = Node(NodeType::Variable, x1Var.Hash);
+    x1.Value = 2;
+    auto x2 = Node(NodeType::Variable, x2Var.Hash);
+    x2.Value = 1;
+    auto constant = [](Operon::Scalar v) { auto c = Node(NodeType::Constant); c.Value = v; return c; };
+    auto add = Node(NodeType::Add);
+    auto sub = Node(NodeType::Sub);
+    auto mul = Node(NodeType::Mul);
+    auto div = Node(NodeType::Div);
+
+    auto simplify = [](std::initializer_list<Node> nodes) {
+        auto tree = Tree(nodes);
+        tree.UpdateNodes();
+        return tree.Simplify();
+    };
+
+    // identities and constant folding: (x1 * 1) + 0 and (2 + 3) * x1
+    auto tree = simplify({ constant(0), constant(1), x1, mul, add });
+    REQUIRE(tree.Length() == 1);
+    REQUIRE(tree[0].Value == 2);
+    tree = simplify({ x1, constant(3), constant(2), add, mul });
+    REQUIRE(tree.Length() == 1);
+    REQUIRE(tree[0].Value == 10);
+
+    // like terms: 2x1 + 2x1 * 3 - x2 / x2
+    tree = simplify({ x2, x2, div, constant(3), x1, mul, x1, add, sub });
+    REQUIRE(tree.Length() == 3);
+    REQUIRE(tree.Nodes().back().Type == NodeType::Sub);
+    REQUIRE(tree[tree.Length() - 2].Value == 8);
+
+    // x1 * x1 and exp(log(x1))
+    tree = simplify({ x1, x1, mul });
+    REQUIRE(tree.Length() == 2);
+    REQUIRE(tree[1].Type == NodeType::Square);
+    tree = simplify({ x2, Node(NodeType::Log), Node(NodeType::Exp) });
+    REQUIRE(tree.Length() == 1);
+    REQUIRE(tree[0].HashValue == x2.HashValue);
+
+    // semantic introns: x1 + 1e-9 * x2 and sin(x1)^2 + cos(x1)^2
+    x2.Value = 1e-9;
+    tree = Tree({ x2, x1, add }).UpdateNodes();
+    tree = Simplify(tree, ds, range);
+    REQUIRE(tree.Length() == 1);
+    REQUIRE(tree[0].HashValue == x1.HashValue);
+    tree = Tree({ x1, Node(NodeType::Cos), Node(NodeType::Square), x1, Node(NodeType::Sin), Node(NodeType::Square), add }).UpdateNodes();
+    tree = Simplify(tree, ds, range);
+    REQUIRE(tree.Length() == 1);
+    REQUIRE(std::abs(tree[0].Value - 1) < 1e-6);
+
+    // random trees get shorter and keep their values (where they are defined)
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log | NodeType::Square | NodeType::Sqrt);
+    BalancedTreeCreator creator { grammar, inputs };
+    Operon::Random random(1234);
+    size_t before = 0, after = 0, semantic = 0, different = 0;
+    for (int k = 0; k < 1000; ++k) {
+        auto original = creator(random, 50, 10);
+        auto simplified = original;
+        simplified.Simplify();
+        auto pruned = Simplify(original, ds, range);
+        REQUIRE(simplified.Length() <= original.Length());
+        REQUIRE(pruned.Length() <= simplified.Length());
+        before += original.Length();
+        after += simplified.Length();
+        semantic += pruned.Length();
+
+        auto x = Evaluate<Operon::Scalar>(original, ds, range);
+        auto y = Evaluate<Operon::Scalar>(simplified, ds, range);
+        auto z = Evaluate<Operon::Scalar>(pruned, ds, range);
+        bool same = true;
+        for (size_t i = 0; i < range.Size(); ++i) {
+            if (std::isfinite(x[i]) && std::abs(x[i]) < 1e6) {
+                auto tolerance = 1e-3 * std::max(Operon::Scalar { 1 }, std::abs(x[i]));
+                same &= std::abs(x[i] - y[i]) < tolerance && std::abs(x[i] - z[i]) < tolerance;
+            }
+        }
+        different += !same;
+    }
+    fmt::print("average length {:.2f}, simplified {:.2f}, without semantic introns {:.2f}\n", before / 1000.0, after / 1000.0, semantic / 1000.0);
+    // the identities only hold up to the floating-point range (eg. log(exp(x)) = x, unless exp(x) underflows)
+    REQUIRE(different <= 10);
+}
+
 } // namespace Test
 } // namespace Operon
 
@@ -22,8 +22,11 @@
 
 #include "core/tree.hpp"
 #include "core/common.hpp"
+#include "core/compact.hpp"
 #include "core/operator.hpp"
 #include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/mutation.hpp"
 
 namespace Operon {
 namespace Test {
@@ -78,6 +81,112 @@ TEST_CASE("Hash collisions") {
     double s32 = set32.size();
     fmt::print("total nodes: {}, {:.3f}% unique, unique 64-bit hashes: {}, unique 32-bit hashes: {}, collision rate: {:.3f}%\n", totalNodes, s64/totalNodes * 100, s64, s32, (1 - s32/s64) * 100);
 }
+
+TEST_CASE("Commutative hash invariance") {
+    auto x1 = Node(NodeType::Variable, 1);
+    x1.Value = 2;
+    auto x2 = Node(NodeType::Variable, 2);
+    x2.Value = 3;
+    auto x3 = Node(NodeType::Variable, 3);
+    x3.Value = 5;
+
+    auto add = Node(NodeType::Add);
+    auto mul = Node(NodeType::Mul);
+    auto sub = Node(NodeType::Sub);
+    auto exp = Node(NodeType::Exp);
+
+    auto hash = [](Tree tree, Operon::HashMode mode) {
+        tree.UpdateNodes().Sort(mode);
+        // the compact representation of a sorted tree hashes to the same value
+        REQUIRE(CompactTree(tree).HashValue(mode) == tree.HashValue());
+        return tree.HashValue();
+    };
+
+    for (auto mode : { Operon::HashMode::Strict, Operon::HashMode::Relaxed }) {
+        // trees that differ only in the order of the arguments of commutative nodes
+        REQUIRE(hash({ x1, x2, add }, mode) == hash({ x2, x1, add }, mode));
+        REQUIRE(hash({ x1, x2, mul, x3, add }, mode) == hash({ x3, x2, x1, mul, add }, mode));
+        REQUIRE(hash({ x1, exp, x2, x3, add, mul }, mode) == hash({ x3, x2, add, x1, exp, mul }, mode));
+        REQUIRE(hash({ x1, x2, sub, x3, add }, mode) == hash({ x3, x1, x2, sub, add }, mode));
+
+        // the order of the arguments of non-commutative nodes matters
+        REQUIRE(hash({ x1, x2, sub }, mode) != hash({ x2, x1, sub }, mode));
+        REQUIRE(hash({ x1, x2, sub, x3, add }, mode) != hash({ x3, x2, x1, sub, add }, mode));
+    }
+
+    // only the strict mode takes the coefficients into account
+    auto y1 = x1;
+    y1.Value = 7;
+    REQUIRE(hash({ x1, x2, add }, Operon::HashMode::Strict) != hash({ y1, x2, add }, Operon::HashMode::Strict));
+    REQUIRE(hash({ x1, x2, add }, Operon::HashMode::Relaxed) == hash({ x2, y1, add }, Operon::HashMode::Relaxed));
+
+    // random trees: sorting a sorted tree does not change it, and the compact hash agrees with the tree hash
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != "Y"; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log);
+    BalancedTreeCreator creator { grammar, inputs };
+
+    Operon::Random random(1234);
+    for (int k = 0; k < 1000; ++k) {
+        for (auto mode : { Operon::HashMode::Strict, Operon::HashMode::Relaxed }) {
+            auto tree = creator(random, 50, 20);
+            auto h = hash(tree, mode);
+            tree.Sort(mode);
+            REQUIRE(hash(tree, mode) == h);
+        }
+    }
+}
+
+TEST_CASE("Incremental hashing") {
+    auto ds = Dataset("../data/Poly-10.csv", true);
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != "Y"; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic | NodeType::Exp | NodeType::Log);
+    BalancedTreeCreator creator { grammar, inputs };
+
+    for (auto mode : { Operon::HashMode::Strict, Operon::HashMode::Relaxed }) {
+        SubtreeCrossover crossover { 0.9, 20, 100 };
+        OnePointMutation onePoint;
+        MultiPointMutation multiPoint;
+        ChangeVariableMutation changeVar { inputs };
+        ChangeFunctionMutation changeFunc { grammar };
+        crossover.MaintainHashes(mode);
+        for (MutatorBase* mutator : std::initializer_list<MutatorBase*> { &onePoint, &multiPoint, &changeVar, &changeFunc }) {
+            mutator->MaintainHashes(mode);
+        }
+
+        // the children of sorted parents are the same as when they are sorted from scratch
+        auto same = [&](const Tree& tree) {
+            auto sorted = tree;
+            sorted.Sort(mode);
+            for (size_t i = 0; i < tree.Length(); ++i) {
+                if (tree[i].CalculatedHashValue != sorted[i].CalculatedHashValue || tree[i].Parent != sorted[i].Parent) {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        Operon::Random random(1234);
+        for (int k = 0; k < 1000; ++k) {
+            auto lhs = creator(random, 50, 20).Sort(mode);
+            auto rhs = creator(random, 50, 20).Sort(mode);
+            auto child = crossover(random, lhs, rhs);
+            REQUIRE(same(child));
+            for (const MutatorBase* mutator : std::initializer_list<const MutatorBase*> { &onePoint, &multiPoint, &changeVar, &changeFunc }) {
+                child = (*mutator)(random, std::move(child));
+                REQUIRE(same(child));
+            }
+        }
+    }
+}
 } // namespace Test
 } // namespace Operon
 
@@ -21,12 +21,15 @@
 #include "core/eval.hpp"
 #include "core/format.hpp"
 #include "core/grammar.hpp"
+#include "core/screening.hpp"
 #include "core/stats.hpp"
 #include "operators/creator.hpp"
 #include "operators/crossover.hpp"
 #include <algorithm>
 #include <catch2/catch.hpp>
 #include <execution>
+#include <fstream>
+#include <map>
 
 namespace Operon::Test {
 TEST_CASE("Sample nodes from grammar", "[implementation]")
@@ -287,4 +290,57 @@ TEST_CASE("PTC2", "[implementation]")
     }
 
 }
+
+TEST_CASE("Variable screening", "[implementation]")
+{
+    // Y depends on A (non-linearly, uncorrelated) and E (linearly), C is a copy of A and D is constant
+    {
+        std::ofstream out("screening.csv");
+        out << "A,B,C,D,E,Y\n";
+        Operon::Random random(1234);
+        std::uniform_real_distribution<double> uniform(-1, 1);
+        for (int i = 0; i < 5000; ++i) {
+            auto a = uniform(random), b = uniform(random), e = uniform(random);
+            out << a << "," << b << "," << 2 * a << ",1," << e << "," << a * a + 0.2 * e << "\n";
+        }
+    }
+    auto ds = Dataset("screening.csv", true);
+    Problem problem(ds, ds.Variables(), "Y", { 0, 5000 }, { 0, 0 });
+    auto inputs = problem.InputVariables();
+
+    ScreeningConfig config;
+    config.MaxVariables = 3;
+    auto scores = ScreenVariables(problem, config);
+    REQUIRE(scores.size() == inputs.size());
+    auto score = [&](const std::string& name) { return *std::find_if(scores.begin(), scores.end(), [&](const auto& s) { return s.Var.Name == name; }); };
+    REQUIRE(std::abs(score("A").Correlation) < 0.1);
+    REQUIRE(score("A").Score > score("E").Score);
+    REQUIRE(score("E").Score > score("B").Score);
+    REQUIRE(score("A").Selected != score("C").Selected); // redundant
+    REQUIRE(!score("D").Selected); // constant
+    REQUIRE(score("E").Selected);
+    REQUIRE(score("B").Selected); // the cap is not reached
+
+    // the creators only sample the selected variables, the relevant ones more often
+    config.MaxVariables = 2;
+    scores = ScreenVariables(problem, config);
+    auto weights = ScreeningWeights(scores);
+    Grammar grammar;
+    BalancedTreeCreator btc { grammar, inputs };
+    btc.VariableWeights(weights);
+    Operon::Random random(1234);
+    std::map<std::string, size_t> counts;
+    for (int i = 0; i < 1000; ++i) {
+        auto tree = btc(random, 20, 10);
+        for (const auto& node : tree.Nodes()) {
+            if (node.IsVariable()) {
+                ++counts[ds.GetName(node.HashValue)];
+            }
+        }
+    }
+    REQUIRE(counts.size() == 2);
+    REQUIRE(counts.count("E") == 1);
+    REQUIRE(counts.count("A") + counts.count("C") == 1);
+    std::remove("screening.csv");
+}
 }
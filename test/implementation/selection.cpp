@@ -23,6 +23,10 @@
 #include "core/grammar.hpp"
 #include "core/stats.hpp"
 #include "operators/creator.hpp"
+#include "operators/crossover.hpp"
+#include "operators/mutation.hpp"
+#include "operators/reinserter/keepbest.hpp"
+#include "operators/reinserter/replaceworst.hpp"
 #include "operators/selection.hpp"
 #include <algorithm>
 #include <catch2/catch.hpp>
@@ -109,4 +113,178 @@ TEST_CASE("Selection Distribution")
         plotHist(rankedSelector);
     }
 }
+
+namespace {
+    // counts the evaluations, with a constant fitness
+    class CountingEvaluator : public EvaluatorBase<Individual<1>> {
+    public:
+        using EvaluatorBase<Individual<1>>::EvaluatorBase;
+
+        double operator()(Operon::Random&, Individual<1>&) const override
+        {
+            ++this->fitnessEvaluations;
+            return 0.5;
+        }
+    };
+
+    // exposes the cached evaluation of the offspring generators
+    class CachedGenerator : public OffspringGeneratorBase<CountingEvaluator, CrossoverBase, MutatorBase, SelectorBase<Individual<1>, 0>> {
+    public:
+        using Base = OffspringGeneratorBase<CountingEvaluator, CrossoverBase, MutatorBase, SelectorBase<Individual<1>, 0>>;
+        using Base::Base;
+        using Base::Evaluate;
+
+        std::optional<Individual<1>> operator()(Operon::Random&, double, double) const override { return std::nullopt; }
+    };
+} // namespace
+
+TEST_CASE("Fitness cache and duplicates")
+{
+    auto random = Operon::Random(1234);
+    auto ds = Dataset("../data/Poly-10.csv", true);
+
+    auto target = "Y";
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+    using Ind = Individual<1>;
+    constexpr gsl::index Idx = 0;
+
+    Grammar grammar;
+    auto creator = BalancedTreeCreator { grammar, inputs };
+    std::vector<Ind> pop(100);
+    for (auto& ind : pop) {
+        ind.Genotype = creator(random, 20, 10);
+        ind[Idx] = std::uniform_real_distribution(0.0, 1.0)(random);
+    }
+
+    auto variable = [&](const std::string& name, double value) {
+        auto node = Node(NodeType::Variable, ds.GetHashValue(name));
+        node.Value = value;
+        return node;
+    };
+    // x1 * x2 + x3, and the same tree with the arguments of both functions swapped
+    auto x1 = variable("X1", 1);
+    auto x2 = variable("X2", 2);
+    auto x3 = variable("X3", 3);
+    auto tree = Tree({ x1, x2, Node(NodeType::Mul), x3, Node(NodeType::Add) }).UpdateNodes();
+    auto swapped = Tree({ x3, x2, x1, Node(NodeType::Mul), Node(NodeType::Add) }).UpdateNodes();
+    REQUIRE(tree.GetCoefficients() != swapped.GetCoefficients());
+
+    SECTION("Cache")
+    {
+        FitnessCache cache(1000);
+        auto sorted = tree;
+        auto key = sorted.Sort(Operon::HashMode::Strict).HashValue();
+        REQUIRE(!cache.Lookup(key, tree.Length()).has_value());
+        cache.Insert(key, tree.Length(), 0.25, sorted.GetCoefficients());
+
+        // the tree with its commutative arguments in another order hits the cache, and the coefficients of the
+        // entry are in the order of its sorted nodes
+        auto other = swapped;
+        auto entry = cache.Lookup(other.Sort(Operon::HashMode::Strict).HashValue(), other.Length());
+        REQUIRE(entry.has_value());
+        REQUIRE(entry->Fitness == 0.25);
+        REQUIRE(entry->Coefficients == other.GetCoefficients());
+        REQUIRE(cache.Hits() == 1);
+        REQUIRE(cache.Misses() == 1);
+
+        // a tree of another length with the same hash value (collision) misses
+        REQUIRE(!cache.Lookup(key, tree.Length() + 1).has_value());
+        REQUIRE(cache.Misses() == 2);
+
+        cache.Clear();
+        REQUIRE(!cache.Lookup(key, tree.Length()).has_value());
+    }
+
+    SECTION("Cached evaluation")
+    {
+        Problem problem(ds, inputs, target, { 0, 250 }, { 250, 500 });
+        CountingEvaluator evaluator(problem);
+        SubtreeCrossover crossover { 0.9, 10, 50 };
+        OnePointMutation mutator;
+        TournamentSelector<Ind, Idx> selector(5);
+        CachedGenerator generator(evaluator, crossover, mutator, selector, selector);
+        FitnessCache cache(1000);
+        generator.Cache(&cache);
+
+        // a miss evaluates the child, which is sorted, and stores its fitness and coefficients
+        Ind ind;
+        ind.Genotype = tree;
+        REQUIRE(generator.Evaluate(random, ind) == 0.5);
+        REQUIRE(evaluator.FitnessEvaluations() == 1);
+        REQUIRE(cache.Misses() == 1);
+        auto key = ind.Genotype.HashValue();
+        REQUIRE(cache.Lookup(key, tree.Length())->Coefficients == ind.Genotype.GetCoefficients());
+
+        // a hit takes the fitness and the (eg. locally optimized) coefficients of the entry without evaluation
+        std::vector<double> optimized { 4, 5, 6 };
+        cache.Insert(key, tree.Length(), 0.125, optimized);
+        cache.ChargeHits(false);
+        Ind child;
+        child.Genotype = swapped;
+        REQUIRE(generator.Evaluate(random, child) == 0.125);
+        REQUIRE(child.Genotype.GetCoefficients() == optimized);
+        REQUIRE(evaluator.FitnessEvaluations() == 1);
+
+        // charged hits count as one fitness evaluation against the budget
+        cache.ChargeHits(true);
+        child.Genotype = swapped;
+        REQUIRE(generator.Evaluate(random, child) == 0.125);
+        REQUIRE(child.Genotype.GetCoefficients() == optimized);
+        REQUIRE(evaluator.FitnessEvaluations() == 2);
+
+        // an entry with another number of coefficients belongs to another tree, and the child is evaluated
+        cache.Insert(key, tree.Length(), 0.125, { 4, 5 });
+        child.Genotype = swapped;
+        auto coefficients = Tree(swapped).Sort(Operon::HashMode::Strict).GetCoefficients();
+        REQUIRE(generator.Evaluate(random, child) == 0.5);
+        REQUIRE(child.Genotype.GetCoefficients() == coefficients);
+        REQUIRE(evaluator.FitnessEvaluations() == 3);
+        REQUIRE(cache.Lookup(key, tree.Length())->Coefficients == coefficients);
+    }
+
+    SECTION("Reinsertion")
+    {
+        // the survivors are sorted (as by the algorithm) and their hash values are not computed again
+        for (auto& ind : pop) {
+            ind.Genotype.Sort(Operon::HashMode::Strict);
+        }
+
+        // the offspring are copies of the best individuals with a better fitness, and one new individual
+        std::sort(pop.begin(), pop.end(), [&](const auto& lhs, const auto& rhs) { return lhs[Idx] < rhs[Idx]; });
+        std::vector<Ind> pool(pop.begin(), pop.begin() + 10);
+        for (auto& ind : pool) {
+            ind[Idx] = -1;
+        }
+        pool.back().Genotype = creator(random, 20, 10);
+        auto hash = Tree(pool.back().Genotype).Sort(Operon::HashMode::Strict).HashValue();
+
+        auto count = [&](const std::vector<Ind>& individuals) {
+            return std::count_if(individuals.begin(), individuals.end(), [&](const auto& ind) { return ind[Idx] < 0; });
+        };
+
+        auto original = pop;
+        ReplaceWorstReinserter<Ind, Idx> replaceWorst;
+        replaceWorst.RejectDuplicates(true);
+        auto copy = pool;
+        replaceWorst(random, pop, copy);
+        REQUIRE(count(pop) == 1);
+        REQUIRE(std::any_of(pop.begin(), pop.end(), [&](auto& ind) { return ind.Genotype.HashValue() == hash; }));
+
+        pop = original;
+        KeepBestReinserter<Ind, Idx> keepBest;
+        keepBest.RejectDuplicates(true);
+        copy = pool;
+        keepBest(random, pop, copy);
+        REQUIRE(count(pop) == 1);
+
+        pop = original;
+        copy = pool;
+        keepBest.RejectDuplicates(false);
+        keepBest(random, pop, copy);
+        REQUIRE(count(pop) == 10);
+    }
+}
 }
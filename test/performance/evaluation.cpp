@@ -101,6 +101,145 @@ namespace Test {
         }
     }
 
+    // throughput when the input columns are stored in reduced precision
+    TEST_CASE("Encoded columns GPops", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(50, 50);
+        auto creator = BalancedTreeCreator { grammar, inputs };
+        std::vector<Tree> trees(10'000);
+        std::generate(trees.begin(), trees.end(), [&]() { return creator(random, sizeDistribution(random), 1000); });
+
+        Range range { 0, ds.Rows() };
+        auto totalOps = TotalNodes(trees) * range.Size();
+
+        using Type = Dataset::StorageType;
+        std::vector<std::pair<std::string, Type>> types {
+            { "float64", Type::Float64 }, { "float32", Type::Float32 }, { "float16", Type::Float16 },
+            { "bfloat16", Type::BFloat16 }, { "int16", Type::Int16 }, { "int8", Type::Int8 }
+        };
+
+        for (auto const& [name, type] : types) {
+            auto encoded = ds;
+            for (auto const& v : inputs) {
+                encoded.Encode(v.Index, type);
+            }
+
+            Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+            MeanVarianceCalculator calc;
+            BENCHMARK("Parallel")
+            {
+                chronometer.start();
+                std::for_each(std::execution::par_unseq, trees.begin(), trees.end(), [&](const auto& tree) { return Evaluate<float>(tree, encoded, range).size(); });
+                chronometer.finish();
+                auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(chronometer.elapsed()).count() / 1e6;
+                calc.Add(totalOps / elapsed);
+            };
+            fmt::print("\n{},{} bytes,{:.3e} ± {:.3e}\n", name, encoded.StorageBytes(), calc.Mean(), calc.StandardDeviation());
+        }
+    }
+
+    // column-major vs tiled layout, for trees referencing many variables of wide datasets
+    TEST_CASE("Dataset layout GPops", "[performance]")
+    {
+        Operon::Random random(1234);
+        size_t nRows = 10'000;
+        std::vector<size_t> numCols { 10, 100, 1000 };
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(100, 100);
+        std::normal_distribution<Operon::Scalar> normal(0, 1);
+
+        for (auto nCols : numCols) {
+            std::vector<Variable> inputs(nCols);
+            std::vector<std::vector<Operon::Scalar>> values(nCols, std::vector<Operon::Scalar>(nRows));
+            for (size_t i = 0; i < nCols; ++i) {
+                inputs[i] = Variable { fmt::format("X{}", i + 1), i, static_cast<gsl::index>(i) };
+                std::generate(values[i].begin(), values[i].end(), [&]() { return normal(random); });
+            }
+            Dataset columns(inputs, values);
+            Dataset tiled(columns);
+            tiled.Tile();
+
+            auto creator = BalancedTreeCreator { grammar, inputs };
+            std::vector<Tree> trees(1000);
+            std::generate(trees.begin(), trees.end(), [&]() { return creator(random, sizeDistribution(random), 1000); });
+            Range range { 0, nRows };
+            auto totalOps = TotalNodes(trees) * range.Size();
+
+            for (auto const& [name, ds] : { std::pair<std::string, Dataset const&> { "columns", columns }, { "tiled", tiled } }) {
+                Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+                MeanVarianceCalculator calc;
+                BENCHMARK("Sequential")
+                {
+                    chronometer.start();
+                    std::for_each(trees.begin(), trees.end(), [&](const auto& tree) { return Evaluate<Operon::Scalar>(tree, ds, range).size(); });
+                    chronometer.finish();
+                    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(chronometer.elapsed()).count() / 1e6;
+                    calc.Add(totalOps / elapsed);
+                };
+                fmt::print("\n{},{},{:.3e} ± {:.3e}\n", name, nCols, calc.Mean(), calc.StandardDeviation());
+            }
+        }
+    }
+
+    // memory footprint and throughput of the compact tree representation for a population of 1M individuals
+    TEST_CASE("Compact tree GPops", "[performance]")
+    {
+        Operon::Random random(1234);
+        auto ds = Dataset("../data/Friedman-I.csv", true);
+        auto target = "Y";
+        auto variables = ds.Variables();
+        std::vector<Variable> inputs;
+        std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+        Grammar grammar;
+        std::uniform_int_distribution<size_t> sizeDistribution(1, 50);
+        auto creator = BalancedTreeCreator { grammar, inputs };
+        size_t n = 1'000'000;
+        std::vector<Tree> trees(n);
+        std::generate(trees.begin(), trees.end(), [&]() { return creator(random, sizeDistribution(random), 1000); });
+        std::vector<CompactTree> compact(n);
+        std::transform(std::execution::par_unseq, trees.begin(), trees.end(), compact.begin(), [](const auto& tree) { return CompactTree(tree); });
+
+        auto treeBytes = std::transform_reduce(trees.begin(), trees.end(), 0UL, std::plus<> {}, [](const auto& tree) { return sizeof(Tree) + tree.Nodes().capacity() * sizeof(Node); });
+        auto compactBytes = std::transform_reduce(compact.begin(), compact.end(), 0UL, std::plus<> {}, [](const auto& tree) { return tree.MemoryBytes(); });
+        fmt::print("\nbytes per individual: tree {:.1f}, compact {:.1f}\n", treeBytes / static_cast<double>(n), compactBytes / static_cast<double>(n));
+
+        Range range { 0, 100 };
+        auto totalOps = TotalNodes(trees) * range.Size();
+
+        Catch::Benchmark::Detail::ChronometerModel<std::chrono::steady_clock> chronometer;
+        MeanVarianceCalculator calc;
+        BENCHMARK("Parallel")
+        {
+            chronometer.start();
+            std::for_each(std::execution::par_unseq, trees.begin(), trees.end(), [&](const auto& tree) { return Evaluate<Operon::Scalar>(tree, ds, range).size(); });
+            chronometer.finish();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(chronometer.elapsed()).count() / 1e6;
+            calc.Add(totalOps / elapsed);
+        };
+        fmt::print("\ntree,{:.3e} ± {:.3e}\n", calc.Mean(), calc.StandardDeviation());
+
+        calc.Reset();
+        BENCHMARK("Parallel")
+        {
+            chronometer.start();
+            std::for_each(std::execution::par_unseq, compact.begin(), compact.end(), [&](const auto& tree) { return Evaluate<Operon::Scalar>(tree, ds, range).size(); });
+            chronometer.finish();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(chronometer.elapsed()).count() / 1e6;
+            calc.Add(totalOps / elapsed);
+        };
+        fmt::print("\ncompact,{:.3e} ± {:.3e}\n", calc.Mean(), calc.StandardDeviation());
+    }
+
     TEST_CASE("Evaluation performance", "[performance]")
     {
         size_t n = 1000;
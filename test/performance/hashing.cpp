@@ -25,6 +25,7 @@
 #include "core/eval.hpp"
 #include "core/grammar.hpp"
 #include "operators/creator.hpp"
+#include "operators/crossover.hpp"
 
 namespace Operon {
 namespace Test {
@@ -66,6 +67,45 @@ TEST_CASE("Tree hashing performance") {
     fmt::print("\nNodes/second: {:.3e} ± {:.3e}\n", calc.Mean(), calc.StandardDeviation());
 }
 
+TEST_CASE("Incremental hashing performance") {
+    size_t n = 10000;
+    size_t maxLength = 200;
+    size_t maxDepth = 100;
+
+    auto rd = Operon::Random(1234);
+    auto ds = Dataset("../data/Poly-10.csv", true);
+
+    auto target = "Y";
+    auto variables = ds.Variables();
+    std::vector<Variable> inputs;
+    std::copy_if(variables.begin(), variables.end(), std::back_inserter(inputs), [&](const auto& v) { return v.Name != target; });
+
+    Grammar grammar;
+    grammar.SetConfig(Grammar::Arithmetic);
+
+    std::vector<Tree> trees(n);
+    auto btc = BalancedTreeCreator { grammar, inputs };
+    std::generate(trees.begin(), trees.end(), [&]() { return btc(rd, maxLength, maxDepth).Sort(Operon::HashMode::Strict); });
+    std::uniform_int_distribution<size_t> dist(0, n - 1);
+
+    SubtreeCrossover crossover { 0.9, maxDepth, maxLength };
+
+    // the children are sorted from scratch, or only along the path from the swapped subtree to the root
+    BENCHMARK("Crossover + Sort") {
+        for (size_t i = 0; i < n; ++i) {
+            auto child = crossover(rd, trees[dist(rd)], trees[dist(rd)]);
+            child.Sort(Operon::HashMode::Strict);
+        }
+    };
+
+    crossover.MaintainHashes(Operon::HashMode::Strict);
+    BENCHMARK("Crossover + SortPath") {
+        for (size_t i = 0; i < n; ++i) {
+            auto child = crossover(rd, trees[dist(rd)], trees[dist(rd)]);
+        }
+    };
+}
+
 } // namespace Test 
 } // namespace Operon
 